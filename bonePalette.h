@@ -0,0 +1,127 @@
+#ifndef BONE_PALETTE_H
+#define BONE_PALETTE_H
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include "libs/glad/glad.h"
+#include "libs/glm/glm.hpp"
+
+const int BONE_PALETTE_TEXTURE_UNIT = 3; // texture unit reserved for the palette (0 — model textures, 1 and 2 — terrain masks)
+const int BONE_PALETTE_CAPACITY = 16384; // initial buffer size in matrices (16384 x 4 RGBA32F texels — the minimum texture buffer size every OpenGL 3.3 driver supports)
+
+// Class for sending skinning matrices of all skinned draws to GPU through 1 texture buffer (samplerBuffer in model.vs, 4 texels per matrix).
+// Palettes are collected on CPU while draws are queued and sent when the queue is flushed (see RenderQueue::flush), before any queued draw reads them.
+// The first send of a frame orphans the buffer storage (driver hands out fresh memory, while draws of the previous frame keep reading the old one), so uploads never stall on the GPU;
+// within a frame the buffer only grows (up to the driver's texture buffer limit), so an offset handed out by upload stays valid until the end of the frame.
+// Palettes are valid until the end of the frame, so draws of the same pose within a frame can share one (see Model::draw).
+// ________________________________________
+
+class BonePalette
+{
+  public:
+	//! Adds 'count' matrices to the palette of the frame and returns their offset (in matrices) for the 'boneOffset' shader uniform (main thread only).
+	static int upload(const glm::mat4 *matrices, int count)
+	{
+		if (count <= 0)
+			return 0;
+
+		setup();
+
+		if ((int)staged.size() + count > maxCapacity)
+		{
+			std::cout << "[Warning] BonePalette::upload: texture buffer limit reached, pose is skipped." << std::endl;
+			return 0;
+		}
+
+		int offset = staged.size();
+		staged.insert(staged.end(), matrices, matrices + count);
+		return offset;
+	}
+
+	//! Sends matrices added since the last send to GPU with 1 call (called by RenderQueue::flush before queued draws are submitted).
+	static void flush()
+	{
+		if ((int)staged.size() == sent)
+			return;
+
+		setup();
+
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+
+		// first send of the frame, or the buffer is too small — take fresh storage and send the whole palette of the frame
+		if (sent == 0 || (int)staged.size() > capacity)
+		{
+			while (capacity < (int)staged.size())
+				capacity = std::min(capacity * 2, maxCapacity);
+
+			glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+			sent = 0;
+		}
+
+		int count = staged.size() - sent;
+		void *dst = glMapBufferRange(GL_TEXTURE_BUFFER, sent * sizeof(glm::mat4), count * sizeof(glm::mat4), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+		if (dst)
+		{
+			memcpy(dst, staged.data() + sent, count * sizeof(glm::mat4));
+			glUnmapBuffer(GL_TEXTURE_BUFFER);
+		}
+		else
+			glBufferSubData(GL_TEXTURE_BUFFER, sent * sizeof(glm::mat4), count * sizeof(glm::mat4), staged.data() + sent);
+
+		sent = staged.size();
+	}
+
+	//! Binds the palette texture to BONE_PALETTE_TEXTURE_UNIT (texture unit 0 stays active).
+	static void bind()
+	{
+		setup();
+
+		glActiveTexture(GL_TEXTURE0 + BONE_PALETTE_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	//! Starts a new frame: palettes uploaded in previous frames may no longer be shared.
+	static void beginFrame()
+	{
+		frame++;
+		staged.clear();
+		sent = 0;
+	}
+
+	//! Returns the number of the current frame (for sharing palettes within a frame).
+	static unsigned int currentFrame() { return frame; }
+
+  private:
+	static inline unsigned int buffer = 0;			// palette storage
+	static inline unsigned int texture = 0;			// texture buffer view of the storage
+	static inline int capacity = 0;					// storage size in matrices
+	static inline int maxCapacity = 0;				// driver's texture buffer limit in matrices
+	static inline std::vector<glm::mat4> staged;	// palettes of the current frame
+	static inline int sent = 0;						// matrices of 'staged' already sent to the storage
+	static inline unsigned int frame = 1;			// current frame number (0 marks a palette that was never uploaded)
+
+	static void setup()
+	{
+		if (buffer)
+			return;
+
+		int maxTexels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+		maxCapacity = std::max(maxTexels / 4, BONE_PALETTE_CAPACITY);
+		capacity = BONE_PALETTE_CAPACITY;
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer); // each texel is 1 matrix column
+	}
+};
+
+#endif
@@ -83,14 +83,14 @@ class Light
 		glEnableVertexAttribArray(0);
 	}
 
-	void draw(glm::mat4 view, glm::mat4 projection)
+	void draw()
 	{
 		if (!showLighting)
 			return;
 
 		shader.use();
-		shader.setMat4("view", view);
-		shader.setMat4("projection", projection);
+		shader.setMat4("model", glm::translate(glm::mat4(1.0f), lightPos)); // set on each draw, as the program is shared with other users of default shaders
+		shader.setVec3("color", lightColor);
 		glBindVertexArray(VAO);
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 		glBindVertexArray(0);
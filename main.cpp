@@ -100,6 +100,9 @@ int main()
 	// load all OpenGL function pointers
 	gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
 
+	// keep linked shader programs on disk, so that the next start skips shader compilation (does nothing if the driver does not support program binaries)
+	ShaderCache::setBinaryCacheDirectory("shader_cache");
+
 	// setup settings panel (Dear ImGui library)
 	ImGui::CreateContext();
 	ImGui_ImplOpenGL3_Init("#version 330");
@@ -390,6 +393,10 @@ int main()
 			// ImGui::Text("Faces: %d", terrainModel.faceCount);
 
 			ImGui::Text("3D Models: %d", terrainModel.modelCount);
+			ImGui::Text("Draws: %d", RenderQueue::stats.items);
+			ImGui::Text("Switches: %d program, %d texture, %d VAO", RenderQueue::stats.programSwitches, RenderQueue::stats.textureSwitches, RenderQueue::stats.vaoSwitches);
+			ImGui::Text("Animated: %d (%d throttled)", terrainModel.animationStats.animated, terrainModel.animationStats.throttled);
+			ImGui::Text("Poses: %d evaluated, %d from tables", terrainModel.animationStats.poseEvaluations, terrainModel.animationStats.poseTableSamples);
 			ImGui::NewLine();
 			ImGui::Checkbox("Base Mesh (K)", &displayBaseMesh);
 			ImGui::Spacing();
@@ -430,18 +437,20 @@ int main()
 		glm::mat4 view = ourCamera.GetViewMatrix();
 		glm::mat4 projection = glm::perspective(glm::radians(ourCamera.Zoom), (float)currentWindowWidth / (float)currentWindowHeight, 0.1f, 1000.0f);
 
+		FrameData::update(view, projection, ourCamera.Position, ourLight.showLighting); // 1 upload per frame, read by all shaders
+		BonePalette::beginFrame();
+
 		if (!isTerrainViewer && bdaeModel.modelLoaded)
 		{
-			bdaeModel.draw(glm::mat4(1.0f), view, projection, ourCamera.Position, deltaTime, ourLight.showLighting, displayBaseMesh); // render model
+			bdaeModel.draw(glm::mat4(1.0f), deltaTime, displayBaseMesh); // render model
 
-			ourLight.draw(view, projection); // render light cube
+			ourLight.draw(); // render light cube
 
 			// render coordinate axis
 			if (displayBaseMesh)
 			{
 				coordinateAxis.use();
-				coordinateAxis.setMat4("view", view);
-				coordinateAxis.setMat4("projection", projection);
+				coordinateAxis.setMat4("model", glm::mat4(1.0f)); // program is shared with other users of default shaders
 
 				glBindVertexArray(axisVAO);
 				glLineWidth(2.0f);
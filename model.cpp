@@ -1,118 +1,577 @@
+#include <cmath>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <xmmintrin.h> // SSE intrinsics for batched evaluation of animation tracks (see evaluateTracks)
+#endif
 #include "model.h"
+#include "libs/stb_image.h"
 
-//! Renders .bdae model.
-void Model::draw(glm::mat4 model, glm::mat4 view, glm::mat4 projection, glm::vec3 cameraPos, float dt, bool lighting, bool simple)
+//! Parses .bdae model file (see ModelData::load), searches for sounds, and uploads model data to GPU.
+void Model::load(const char *fpath, Sound &sound, bool isTerrainViewer)
 {
-	if (!modelLoaded)
-		return;
+	reset();
 
-	// [FIX] when loading models in terrain viewer mode, some models are corrupted
-	if (VAO == 0)
+	// 1. run the parser (no OpenGL calls)
+	if (ModelData::load(fpath, isTerrainViewer) != 0)
 		return;
 
-	bool isTerrainViewer = (modelCenter == glm::vec3(-1.0f)) ? true : false; // in 3D viewer mode, the model center in initialized (false)
+	boneTotalTransforms.resize(boneNames.size());
+	computeAnimatedBounds();
+	bakePoseTables();
+
+	if (!isTerrainViewer) // 3D model viewer
+	{
+		// compute the model's center in world space for its correct rotation (instead of always rotating around the origin (0, 0, 0))
+		modelCenter = glm::vec3(0.0f);
+
+		if (hasSkinningData) // use skinned vertex positions (linear blend skinning that is normally computed on GPU)
+		{
+			for (int i = 0, n = (int)vertices.size(); i < n; i++)
+			{
+				glm::vec4 skinnedPosCoords = glm::vec4(0.0f);
+
+				for (int j = 0; j < 4; j++)
+				{
+					int boneIndex = vertices[i].BoneIndices[j];
+					float boneWeight = vertices[i].BoneWeights[j];
+
+					if (boneWeight > 0.0f && boneToNodeIdx[boneIndex] >= 0)
+					{
+						int nodeIndex = boneToNodeIdx[boneIndex];
+						glm::mat4 boneTotalTransform = bindShapeMatrix * nodes[nodeIndex].totalTransform * bindPoseMatrices[boneIndex];
+						skinnedPosCoords += boneTotalTransform * boneWeight * glm::vec4(vertices[i].PosCoords, 1.0f);
+					}
+				}
+
+				modelCenter += glm::vec3(skinnedPosCoords);
+			}
+		}
+		else
+		{
+			for (int i = 0, n = (int)vertices.size(); i < n; i++)
+				modelCenter += vertices[i].PosCoords;
+		}
+
+		modelCenter /= vertices.size();
+
+		// 2. search for SOUNDS
+		// ____________________
+
+		sound.searchSoundFiles(fileName, sounds);
 
+		LOG("\nSOUNDS: ", ((sounds.size() != 0) ? sounds.size() : 0));
+
+		for (int i = 0; i < (int)sounds.size(); i++)
+			LOG("[", i + 1, "]  ", sounds[i]);
+	}
+
+	// 3. upload to GPU
+	setupGPU(isTerrainViewer);
+
+	modelLoaded = true;
+	LOG("\033[1m\033[38;2;200;200;200m[Load] BDAE model loaded.\033[0m\n");
+}
+
+//! Takes over model data already parsed elsewhere (e.g. on a worker thread) and uploads it to GPU.
+void Model::load(ModelData &&data, bool isTerrainViewer)
+{
+	reset();
+
+	ModelData::operator=(std::move(data));
+
+	boneTotalTransforms.resize(boneNames.size());
+	computeAnimatedBounds();
+	bakePoseTables();
+
+	setupGPU(isTerrainViewer);
+
+	modelLoaded = true;
+}
+
+//! Uploads parsed model data (vertices, indices, textures, node tree) to GPU.
+void Model::setupGPU(bool isTerrainViewer)
+{
+	// 1. setup buffers
 	if (!isTerrainViewer)
 	{
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, modelCenter); // a trick to build the correct model matrix that rotates the model around its center
-		model = glm::rotate(model, glm::radians(meshPitch), glm::vec3(1, 0, 0));
-		model = glm::rotate(model, glm::radians(meshYaw), glm::vec3(0, 1, 0));
-		model = glm::translate(model, -modelCenter);
+		LOG("\n\033[37m[Load] Uploading vertex data to GPU.\033[0m");
+		glGenVertexArrays(1, &VAO); // generate a Vertex Array Object to store vertex attribute configurations
+		glGenBuffers(1, &VBO);		// generate a Vertex Buffer Object to store vertex data
+
+		glBindVertexArray(VAO); // bind the VAO first so that subsequent VBO bindings and vertex attribute configurations are stored in it correctly
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);																  // bind the VBO
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW); // copy vertex data into the GPU buffer's memory
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0); // define the layout of the vertex data (vertex attribute configuration): index 0, 3 components per vertex, type float, not normalized, with a stride of 52 bytes (sizeof(Vertex) = 12 floats + 4 chars = 52 bytes), and an offset of 0 in the buffer
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(6 * sizeof(float)));
+		glEnableVertexAttribArray(2);
+		glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(Vertex), (void *)(8 * sizeof(float)));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(8 * sizeof(float) + 4 * sizeof(char)));
+		glEnableVertexAttribArray(4);
+
+		uploadIndices();
+	}
+
+	// 2. load texture(s)
+	LOG("\033[37m[Load] Uploading textures to GPU.\033[0m");
+
+	textures.resize(textureNames.size());
+	glGenTextures(textureNames.size(), textures.data()); // generate and store texture ID(s)
+
+	for (int i = 0; i < (int)textureNames.size(); i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, textures[i]); // bind the texture ID so that all upcoming texture operations affect this texture
+
+		// set the texture wrapping parameters
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // for u (x) axis
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); // for v (y) axis
+
+		// set texture filtering parameters
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		int width, height, nrChannels, format;
+		unsigned char *data = stbi_load(textureNames[i].c_str(), &width, &height, &nrChannels, 0); // load the image and its parameters
+
+		if (!data)
+		{
+			std::cerr << "Failed to load texture: " << textureNames[i] << "\n";
+			continue;
+		}
+
+		format = (nrChannels == 4) ? GL_RGBA : GL_RGB;											  // image format
+		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data); // create and store texture image inside the texture object (upload to GPU)
+		glGenerateMipmap(GL_TEXTURE_2D);
+		stbi_image_free(data);
 	}
 
-	if (animationsLoaded && (animationPlaying || isTerrainViewer)) // [TEST] are there animated models among terrain models?
+	// 3. generate a unit icosahedron for node visualization (easier than sphere)
+
+	// icosahedron – 3D geometry with 20 triangular faces, 12 vertices, and 30 edges.
+	// Its vertices can be generated by all even permutations of the coordinates (±1, ±φ, 0), where φ = (1 + √5) / 2 is the golden ratio.
+
+	if (!isTerrainViewer)
 	{
-		float duration = animations[selectedAnimation].first;
-		std::vector<BaseAnimation> &baseAnimations = animations[selectedAnimation].second;
+		const float t = (1.0f + std::sqrt(5.0f)) / 2.0f; // golden ratio
+
+		// 12 vertices of icosahedron (normalize so that all points lie on the unit sphere
+		std::vector<glm::vec3> positions = {
+			glm::normalize(glm::vec3(-1, t, 0)),
+			glm::normalize(glm::vec3(1, t, 0)),
+			glm::normalize(glm::vec3(-1, -t, 0)),
+			glm::normalize(glm::vec3(1, -t, 0)),
+			glm::normalize(glm::vec3(0, -1, t)),
+			glm::normalize(glm::vec3(0, 1, t)),
+			glm::normalize(glm::vec3(0, -1, -t)),
+			glm::normalize(glm::vec3(0, 1, -t)),
+			glm::normalize(glm::vec3(t, 0, -1)),
+			glm::normalize(glm::vec3(t, 0, 1)),
+			glm::normalize(glm::vec3(-t, 0, -1)),
+			glm::normalize(glm::vec3(-t, 0, 1))};
+
+		std::vector<float> vertices;
+
+		for (int i = 0; i < positions.size(); i++)
+		{
+			vertices.push_back(positions[i].x);
+			vertices.push_back(positions[i].y);
+			vertices.push_back(positions[i].z);
+		}
 
+		// 20 faces (triangles) of icosahedron
+		std::vector<unsigned int> indices = {
+			0, 11, 5,
+			0, 5, 1,
+			0, 1, 7,
+			0, 7, 10,
+			0, 10, 11,
+
+			1, 5, 9,
+			5, 11, 4,
+			11, 10, 2,
+			10, 7, 6,
+			7, 1, 8,
+
+			3, 9, 4,
+			3, 4, 2,
+			3, 2, 6,
+			3, 6, 8,
+			3, 8, 9,
+
+			4, 9, 5,
+			2, 4, 11,
+			6, 2, 10,
+			8, 6, 7,
+			9, 8, 1};
+
+		glGenVertexArrays(1, &nodeVAO);
+		glGenBuffers(1, &nodeVBO);
+		glGenBuffers(1, &nodeEBO);
+
+		glBindVertexArray(nodeVAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, nodeVBO);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+		glEnableVertexAttribArray(0);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, nodeEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	}
+}
+
+//! Renders .bdae model in the 3D viewer: advances viewer's own playback state (if playing), then draws the current pose.
+void Model::draw(glm::mat4 model, float dt, bool simple)
+{
+	if (animationsLoaded && animationPlaying)
+	{
 		currentAnimationTime += dt;
 
-		if (currentAnimationTime >= duration)
+		if (currentAnimationTime >= animations[selectedAnimation].duration)
 			currentAnimationTime = 0.0f;
 
-		// update local translation / rotation / scale for each animated node (base animations target specific nodes)
-		for (int i = 0; i < baseAnimations.size(); i++)
-			applyBaseAnimation(baseAnimations[i], currentAnimationTime);
+		draw(model, selectedAnimation, currentAnimationTime, simple);
+	}
+	else
+		draw(model, -1, currentAnimationTime, simple);
 
-		// update total transformation matrix for each node
-		for (int i = 0; i < nodes.size(); i++)
+	RenderQueue::flush();
+}
+
+//! Grows model's bounding box to hold its poses in all loaded animations (sampled at boundsSampleRate), then returns the node tree to the rest pose.
+void Model::computeAnimatedBounds()
+{
+	if (!animationsLoaded)
+		return;
+
+	for (int clip = 0; clip < (int)animations.size(); clip++)
+	{
+		float duration = animations[clip].duration;
+		int sampleCount = std::clamp((int)std::ceil(duration * boundsSampleRate), 1, maxBoundsSamples);
+
+		for (int i = 0; i <= sampleCount; i++)
 		{
-			if (nodes[i].parentIndex == -1)
-				updateNodesTransformationsRecursive(i, glm::mat4(1.0f));
+			evaluatePose(clip, duration * i / sampleCount);
+			growBounds();
 		}
 	}
 
-	shader.use();
-	shader.setMat4("view", view);
-	shader.setMat4("projection", projection);
-	shader.setBool("lighting", lighting);
-	shader.setVec3("cameraPos", cameraPos);
+	resetAnimation();
+}
 
-	// only for skinned (non-static) models: update total transformation matrix for each bone and send to GPU
-	// (final model matrix calculation for these models is done per vertex on GPU, which is how the skinning works)
-	if (hasSkinningData)
+//! Samples each animation clip of a skinned model at poseTableRate into a table of final skinning matrices (clips over poseTableBudget are left out), then returns the node tree to the rest pose.
+void Model::bakePoseTables()
+{
+	poseTables.assign(animations.size(), std::vector<glm::mat4>());
+
+	if (!animationsLoaded || !hasSkinningData || nodes.empty() || bindPoseMatrices.empty() || poseTableBudget <= 0)
+		return;
+
+	// a clip played by many instances costs 1 table lookup per pose instead of track interpolation, node tree update and matrix products; the memory it takes is bounded per clip
+	int boneCount = boneTotalTransforms.size();
+
+	for (int clip = 0; clip < (int)animations.size(); clip++)
 	{
-		if (!nodes.empty() && !bindPoseMatrices.empty())
+		float duration = animations[clip].duration;
+		int frameCount = (int)std::ceil(duration * poseTableRate) + 1; // the last frame holds the end of the clip
+		size_t tableSize = (size_t)frameCount * boneCount * sizeof(glm::mat4);
+
+		if (duration <= 0.0f || boneCount == 0)
+			continue;
+
+		if (tableSize > (size_t)poseTableBudget)
 		{
-			shader.setBool("useSkinning", true);
+			LOG("\033[37m[Load] Animation [", clip + 1, "] pose table needs ", tableSize, " bytes (over budget), evaluated every frame.\033[0m");
+			continue;
+		}
 
-			for (int i = 0, boneCount = boneTotalTransforms.size(); i < boneCount; i++)
-			{
-				int nodeIndex = boneToNodeIdx[i];
-				boneTotalTransforms[i] = bindShapeMatrix * nodes[nodeIndex].totalTransform * bindPoseMatrices[i]; // this is core formula for skeletal animation skinning; the resulting skinning matrix needs to be applied to a vertex to make it move with a specific bone (with respect to this bone weight and influence of other bones; see vertex shader)
-				shader.setMat4("boneTotalTransforms[" + std::to_string(i) + "]", boneTotalTransforms[i]);
-			}
+		std::vector<glm::mat4> &table = poseTables[clip];
+		table.resize((size_t)frameCount * boneCount);
+
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			evaluatePose(clip, std::min(frame / poseTableRate, duration));
+			computeSkinningMatrices(&table[(size_t)frame * boneCount]);
 		}
 	}
+
+	resetAnimation();
+}
+
+//! Fills boneTotalTransforms with the pose of 'clip' at 'time' from its pose table; returns false if the clip has no table.
+bool Model::samplePoseTable(int clip, float time)
+{
+	if (clip < 0 || clip >= (int)poseTables.size() || poseTables[clip].empty())
+		return false;
+
+	poseTableSamples++;
+
+	const std::vector<glm::mat4> &table = poseTables[clip];
+	int boneCount = boneTotalTransforms.size();
+	int frameCount = table.size() / boneCount;
+
+	float frame = std::clamp(time * poseTableRate, 0.0f, frameCount - 1.0f);
+	int frame0 = poseTableLerp ? (int)frame : (int)std::lround(frame);
+	int frame1 = std::min(frame0 + 1, frameCount - 1);
+	float weight = poseTableLerp ? frame - frame0 : 0.0f;
+
+	const glm::mat4 *matrices0 = &table[(size_t)frame0 * boneCount];
+	const glm::mat4 *matrices1 = &table[(size_t)frame1 * boneCount];
+
+	if (weight == 0.0f)
+		std::copy(matrices0, matrices0 + boneCount, boneTotalTransforms.begin());
 	else
-		shader.setBool("useSkinning", false);
+	{
+		// frames are 1 / 30 s apart, so blending matrices component-wise stays close to the evaluated pose
+		for (int i = 0; i < boneCount; i++)
+			boneTotalTransforms[i] = matrices0[i] + (matrices1[i] - matrices0[i]) * weight;
+	}
 
-	// only for non-skinned models: calculate final model matrices for each submesh
-	// (final model matrix calculation for these models is done per submesh on CPU)
-	std::vector<glm::mat4> submeshModelMatrices(totalSubmeshCount);
+	return true;
+}
 
-	for (int i = 0; i < totalSubmeshCount; i++)
+//! Returns the pose of 'clip' at 'time' kept for blending throttled updates (skinning matrices of a skinned model, node transforms otherwise), computing it if it is not kept yet.
+const std::vector<glm::mat4> &Model::heldPose(int clip, float time)
+{
+	unsigned int frame = BonePalette::currentFrame();
+	HeldPose *slot = NULL;
+
+	for (HeldPose &pose : heldPoses)
 	{
-		int meshIndex = submeshToMeshIdx[i];
-		submeshModelMatrices[i] = model;
+		if (pose.clip == clip && pose.time == time)
+		{
+			pose.lastUsedFrame = frame;
+			return pose.matrices;
+		}
+
+		if (!slot || pose.lastUsedFrame < slot->lastUsedFrame)
+			slot = &pose;
+	}
+
+	// not kept yet: take a free slot (storage is reserved once, so kept poses never move), or replace the least recently used pose
+	if ((int)heldPoses.size() < heldPoseCapacity)
+	{
+		heldPoses.reserve(heldPoseCapacity);
+		heldPoses.emplace_back();
+		slot = &heldPoses.back();
+	}
+
+	slot->clip = clip;
+	slot->time = time;
+	slot->lastUsedFrame = frame;
 
-		if (!hasSkinningData)
+	if (hasSkinningData)
+	{
+		// clips with a pose table blend its 2 nearest frames, others are evaluated
+		if (!samplePoseTable(clip, time))
 		{
-			auto it = meshToNodeIdx.find(meshIndex);
+			evaluatePose(clip, time);
+			computeSkinningMatrices(boneTotalTransforms.data());
+		}
 
-			if (it != meshToNodeIdx.end())
-			{
-				int nodeIndex = it->second;
-				submeshModelMatrices[i] *= nodes[nodeIndex].totalTransform;
-			}
+		slot->matrices = boneTotalTransforms;
+	}
+	else
+	{
+		evaluatePose(clip, time);
+		slot->matrices.resize(nodes.size());
+
+		for (int i = 0; i < (int)nodes.size(); i++)
+			slot->matrices[i] = nodes[i].totalTransform;
+	}
+
+	return slot->matrices;
+}
+
+//! Computes skinning matrix of each bone from the pose currently held in the node tree.
+void Model::computeSkinningMatrices(glm::mat4 *matrices)
+{
+	for (int i = 0, boneCount = boneTotalTransforms.size(); i < boneCount; i++)
+	{
+		int nodeIndex = boneToNodeIdx[i];
+
+		if (nodeIndex < 0) // bone without node stays in bind pose
+		{
+			matrices[i] = bindShapeMatrix;
+			continue;
 		}
+
+		matrices[i] = bindShapeMatrix * nodes[nodeIndex].totalTransform * bindPoseMatrices[i]; // this is core formula for skeletal animation skinning; the resulting skinning matrix needs to be applied to a vertex to make it move with a specific bone (with respect to this bone weight and influence of other bones; see vertex shader)
 	}
+}
 
-	// render model
-	glBindVertexArray(VAO);
+//! Returns playback time of animation 'clip' for a clock that keeps running (animations loop).
+float Model::getClipTime(int clip, float clock) const
+{
+	if (!animationsLoaded || clip < 0 || clip >= (int)animations.size())
+		return 0.0f;
+
+	float duration = animations[clip].duration;
+
+	if (duration <= 0.0f)
+		return 0.0f;
+
+	float time = std::fmod(clock, duration);
+	return (time < 0.0f) ? time + duration : time;
+}
+
+//! Poses the node tree at 'time' of animation 'clip'; does nothing if the tree already holds this pose.
+void Model::evaluatePose(int clip, float time)
+{
+	if (!animationsLoaded || clip < 0 || clip >= (int)animations.size())
+		return;
+
+	// model is shared by its instances: the pose is evaluated once per (clip, time), and all instances sampling the same time reuse it
+	if (clip == poseClip && time == poseTime)
+		return;
+
+	// update local translation / rotation / scale for each animated node (tracks target specific nodes)
+	for (int type = 0; type < TRACK_TYPE_COUNT; type++)
+		evaluateTracks(animations[clip].tracks[type], type, time);
+
+	// update total transformation matrix for each node
+	for (int i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i].parentIndex == -1)
+			updateNodesTransformationsRecursive(i, glm::mat4(1.0f));
+	}
+
+	poseClip = clip;
+	poseTime = time;
+	poseEvaluations++;
+}
+
+//! Queues .bdae model posed at 'time' of animation 'clip' for rendering (clip -1 keeps the current pose).
+void Model::draw(glm::mat4 model, int clip, float time, bool simple)
+{
+	drawInstances(model, NULL, 1, clip, time, simple);
+}
+
+//! Queues 'count' instances of the model in the same pose for rendering, 1 draw call per submesh (see RenderQueue); 'transforms' are their world matrices (NULL → 1 non-instanced draw with 'model').
+void Model::drawInstances(glm::mat4 model, const glm::mat4 *transforms, int instanceCount, int clip, float time, bool simple, float nextTime, float blend)
+{
+	if (!modelLoaded || instanceCount <= 0)
+		return;
+
+	// [FIX] when loading models in terrain viewer mode, some models are corrupted
+	if (VAO == 0)
+		return;
+
+	bool isTerrainViewer = (modelCenter == glm::vec3(-1.0f)) ? true : false; // in 3D viewer mode, the model center in initialized (false)
+
+	if (!isTerrainViewer)
+	{
+		model = glm::mat4(1.0f);
+		model = glm::translate(model, modelCenter); // a trick to build the correct model matrix that rotates the model around its center
+		model = glm::rotate(model, glm::radians(meshPitch), glm::vec3(1, 0, 0));
+		model = glm::rotate(model, glm::radians(meshYaw), glm::vec3(0, 1, 0));
+		model = glm::translate(model, -modelCenter);
+	}
+
+	// skinned models draw clips with a pose table straight from it (the node tree is still posed when nodes are displayed in the viewer)
+	bool posedFromTable = hasSkinningData && clip >= 0 && clip < (int)poseTables.size() && !poseTables[clip].empty() && !(simple && !isTerrainViewer);
+
+	// paused viewer (clip -1) holds the last played pose: boneTotalTransforms still hold it, while the node tree is at rest if the pose came from a pose table
+	bool holdPose = !isTerrainViewer && clip < 0 && hasSkinningData && paletteAnimation >= 0;
+
+	// throttled terrain instances blend the kept poses of the 2 tier updates around their time, so each update evaluates 1 new pose per model, clip and phase (see AnimationTier)
+	bool blended = blend > 0.0f && animationsLoaded && clip >= 0 && clip < (int)animations.size();
 
-	if (!simple)
+	if (blended)
 	{
-		shader.setInt("renderMode", 1);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		blendedPose = heldPose(clip, time); // copied before the next pose is requested, which may replace it
 
-		for (int i = 0; i < totalSubmeshCount; i++)
+		const std::vector<glm::mat4> &next = heldPose(clip, nextTime);
+
+		for (int i = 0; i < (int)blendedPose.size(); i++)
+			blendedPose[i] += (next[i] - blendedPose[i]) * blend;
+
+		if (hasSkinningData)
+			boneTotalTransforms = blendedPose;
+	}
+	else if (holdPose)
+		evaluatePose(paletteAnimation, paletteTime); // displayed nodes match the held pose (no work if the tree already holds it)
+	else if (!posedFromTable)
+		evaluatePose(clip, time);
+
+	// draws are submitted later, sorted by state (see RenderQueue), so everything that changes between draws of this model in one frame is captured in the queued items:
+	// the pose (submesh matrices and bone palette offset) and the instance range — world matrices of all instanced draws of the frame are collected here and uploaded at once when the first of them is submitted
+	bool instanced = (transforms != NULL && instanceVBO != 0);
+	int baseInstance = 0;
+
+	if (instanced)
+	{
+		if (instanceFrame != BonePalette::currentFrame())
 		{
-			int meshIndex = submeshToMeshIdx[i];
+			frameInstances.clear();
+			instanceFrame = BonePalette::currentFrame();
+		}
 
-			if (meshIndex < 0)
+		baseInstance = frameInstances.size();
+		frameInstances.insert(frameInstances.end(), transforms, transforms + instanceCount);
+		instancesUploaded = false;
+	}
+
+	// only for skinned (non-static) models: update total transformation matrix for each bone and send to GPU
+	// (final model matrix calculation for these models is done per vertex on GPU, which is how the skinning works)
+	int boneOffset = -1;
+
+	if (hasSkinningData && !nodes.empty() && !bindPoseMatrices.empty())
+	{
+		// the pose only depends on the animation state, so draws of this model with the same state in one frame reuse the palette uploaded by the first of them
+		if (blended || paletteFrame != BonePalette::currentFrame() || (!holdPose && (paletteAnimation != clip || paletteTime != time)))
+		{
+			if (!blended && !holdPose && (!posedFromTable || !samplePoseTable(clip, time)))
+				computeSkinningMatrices(boneTotalTransforms.data());
+
+			// add all bones to the palette of the frame (sent to GPU before the queued draws are submitted)
+			paletteOffset = BonePalette::upload(boneTotalTransforms.data(), boneTotalTransforms.size());
+			paletteFrame = blended ? 0 : BonePalette::currentFrame(); // a blended palette is not shared with draws of other poses
+
+			if (!holdPose && !blended)
 			{
-				std::cout << "[Warning] Model::draw: skipping submesh [" << i << "] --> invalid mesh index [" << meshIndex << "]" << std::endl;
-				continue;
+				paletteAnimation = clip;
+				paletteTime = time;
 			}
+		}
+
+		boneOffset = paletteOffset;
+	}
 
-			shader.setMat4("model", submeshModelMatrices[i]);
+	RenderItem item = {};
+	item.shader = &shader;
+	item.vao = VAO;
+	item.textureTarget = GL_TEXTURE_2D;
+	item.submit = submitSubmesh;
+	item.object = this;
+	item.baseInstance = baseInstance;
+	item.instanceCount = instanced ? instanceCount : 0;
+	item.boneOffset = boneOffset;
 
-			glActiveTexture(GL_TEXTURE0);
+	for (int i = 0; i < totalSubmeshCount; i++)
+	{
+		if (indices[i].empty())
+			continue;
+
+		// only for non-skinned models: calculate final model matrix of the submesh
+		// (final model matrix calculation for these models is done per submesh on CPU; static terrain models have it baked into their vertices, see ModelData::bakeStatic)
+		item.index = i;
+		item.count = indices[i].size();
+		item.transform = model;
 
+		if (!hasSkinningData && submeshNodeIdx[i] >= 0)
+			item.transform *= blended ? blendedPose[submeshNodeIdx[i]] : nodes[submeshNodeIdx[i]].totalTransform;
+
+		if (!simple)
+		{
 			if (alternativeTextureCount > 0 && textureCount == 1)
-				glBindTexture(GL_TEXTURE_2D, textures[selectedTexture]);
+				item.texture = textures[selectedTexture];
 			else if (textureCount > 1)
 			{
 				if (submeshTextureIndex[i] == -1)
@@ -121,196 +580,375 @@ void Model::draw(glm::mat4 model, glm::mat4 view, glm::mat4 projection, glm::vec
 					continue;
 				}
 
-				glBindTexture(GL_TEXTURE_2D, textures[submeshTextureIndex[i]]);
+				item.texture = textures[submeshTextureIndex[i]];
 			}
 			else
-				glBindTexture(GL_TEXTURE_2D, textures[0]);
+				item.texture = textures[0];
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOs[i]);
-			glDrawElements(GL_TRIANGLES, indices[i].size(), GL_UNSIGNED_SHORT, 0);
+			item.renderMode = 1;
+			RenderQueue::add(renderPass, item);
+		}
+		else
+		{
+			// mesh edges (wireframe mode) are drawn before mesh faces (see RenderPass)
+			item.texture = 0;
+			item.renderMode = 2;
+			RenderQueue::add(RENDER_PASS_WIREFRAME, item);
+
+			item.renderMode = 3;
+			RenderQueue::add(renderPass, item);
 		}
 	}
-	else
+
+	// render nodes (only in simple mode; drawn right away, not through the render queue)
+	if (simple && !nodes.empty() && !isTerrainViewer)
 	{
-		// first pass: render mesh edges (wireframe mode)
-		shader.setInt("renderMode", 2);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		defaultShader.use();
 
-		for (int i = 0; i < totalSubmeshCount; i++)
+		glBindVertexArray(nodeVAO);
+
+		for (int i = 0; i < nodes.size(); i++)
 		{
-			shader.setMat4("model", submeshModelMatrices[i]);
+			Node &node = nodes[i];
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOs[i]);
-			glDrawElements(GL_TRIANGLES, indices[i].size(), GL_UNSIGNED_SHORT, 0);
-		}
+			glm::mat4 nodeModel = model * node.totalTransform;
+			nodeModel = glm::scale(nodeModel, glm::vec3(0.05f));
+			defaultShader.setMat4("model", nodeModel);
 
-		// second pass: render mesh faces
-		shader.setInt("renderMode", 3);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+			// set color based on node type
+			glm::vec3 color;
 
-		for (int i = 0; i < totalSubmeshCount; i++)
-		{
-			shader.setMat4("model", submeshModelMatrices[i]);
+			if (node.parentIndex == -1)
+				color = glm::vec3(1.0f, 0.0f, 0.0f); // red for root nodes
+			else if (node.childIndices.empty())
+				color = glm::vec3(0.0f, 0.5f, 1.0f); // blue for leaf nodes
+			else
+				color = glm::vec3(0.0f, 1.0f, 0.0f); // green for normal joint nodes
+
+			defaultShader.setVec3("color", color);
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOs[i]);
-			glDrawElements(GL_TRIANGLES, indices[i].size(), GL_UNSIGNED_SHORT, 0);
+			glDrawElements(GL_TRIANGLES, 60, GL_UNSIGNED_INT, 0); // one icosahedron has 20 faces * 3 indices / face = 60 indices
 		}
 
 		glBindVertexArray(0);
+	}
+}
 
-		// render nodes (only in simple mode)
-		if (!nodes.empty() && !isTerrainViewer)
-		{
-			defaultShader.use();
-			defaultShader.setMat4("projection", projection);
-			defaultShader.setMat4("view", view);
+//! Sets uniforms of a queued submesh draw and issues it (called by RenderQueue::flush with model's program and vertex array bound).
+void Model::submitSubmesh(const RenderItem &item)
+{
+	Model *owner = (Model *)item.object;
+	Shader &shader = owner->shader;
 
-			glBindVertexArray(nodeVAO);
+	shader.setInt("renderMode", item.renderMode);
+	shader.setMat4("model", item.transform);
+	shader.setBool("useSkinning", item.boneOffset >= 0);
 
-			for (int i = 0; i < nodes.size(); i++)
-			{
-				Node &node = nodes[i];
+	if (item.boneOffset >= 0)
+	{
+		BonePalette::bind();
+		shader.setInt("boneOffset", item.boneOffset);
+	}
 
-				glm::mat4 nodeModel = model * node.totalTransform;
-				nodeModel = glm::scale(nodeModel, glm::vec3(0.05f));
-				defaultShader.setMat4("model", nodeModel);
+	// instanced draws: world matrix of each instance is read from the instance buffer (attribute advanced once per instance), 'model' uniform keeps the part shared by all instances (submesh's node transform)
+	shader.setBool("instanced", item.instanceCount > 0);
 
-				// set color based on node type
-				glm::vec3 color;
+	if (item.instanceCount > 0)
+		owner->bindInstances(item.baseInstance);
 
-				if (node.parentIndex == -1)
-					color = glm::vec3(1.0f, 0.0f, 0.0f); // red for root nodes
-				else if (node.childIndices.empty())
-					color = glm::vec3(0.0f, 0.5f, 1.0f); // blue for leaf nodes
-				else
-					color = glm::vec3(0.0f, 1.0f, 0.0f); // green for normal joint nodes
+	// all submeshes share model's element buffer (recorded in its vertex array): the draw starts at the submesh's range and adds its base vertex to every index
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.count, owner->indexType, (void *)(intptr_t)owner->submeshIndexOffsets[item.index], std::max(1, item.instanceCount), owner->submeshBaseVertex[item.index]);
+}
 
-				defaultShader.setVec3("color", color);
+//! Uploads the instance matrices queued in the current frame (once) and points instance attributes at 'baseInstance' (model's vertex array must be bound).
+void Model::bindInstances(int baseInstance)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
 
-				glDrawElements(GL_TRIANGLES, 60, GL_UNSIGNED_INT, 0); // one icosahedron has 20 faces * 3 indices / face = 60 indices
-			}
+	if (!instancesUploaded)
+	{
+		// orphan the previous frame's data (or grow the buffer), so the upload does not wait for draws still reading it
+		if ((int)frameInstances.size() > instanceCapacity)
+			instanceCapacity = std::max((int)frameInstances.size(), instanceCapacity * 2);
 
-			glBindVertexArray(0);
-		}
+		glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, frameInstances.size() * sizeof(glm::mat4), frameInstances.data());
+		instancesUploaded = true;
 	}
+
+	// instance attributes are vertex array state: re-point them only when a draw starts at another instance
+	if (baseInstance != boundInstanceBase)
+	{
+		for (int column = 0; column < 4; column++)
+			glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(baseInstance * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+
+		boundInstanceBase = baseInstance;
+	}
+}
+
+//! Uploads vertex and index buffers of a terrain model on first use by an active tile (all tiles that place the model share them).
+void Model::acquireGPU()
+{
+	if (!modelLoaded)
+		return;
+
+	if (gpuUserCount++ > 0)
+		return;
+
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(6 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+
+	// per-instance world matrix: 4 vec4 columns at locations 5–8, advanced once per instance (filled by drawInstances)
+	glGenBuffers(1, &instanceVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	instanceCapacity = 0;
+	instancesUploaded = false;
+	boundInstanceBase = 0;
+
+	for (int column = 0; column < 4; column++)
+	{
+		glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(column * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(5 + column);
+		glVertexAttribDivisor(5 + column, 1);
+	}
+
+	uploadIndices();
+
+	glBindVertexArray(0);
 }
 
-//! Applies a base animation (translation / rotation / scale) at a specific time, targeting one node.
-void Model::applyBaseAnimation(BaseAnimation &baseAnim, float time)
+//! Packs indices of all submeshes into 1 element buffer, recorded in the currently bound vertex array (16-bit indices unless a submesh needs 32-bit ones).
+void Model::uploadIndices()
 {
-	auto it = nodeNameToIdx.find(baseAnim.targetNodeName); // [TODO] use boneNameToNodeIdx instead
+	// indices are local to each submesh's base vertex, so they fit 16 bits for every mesh parsed from a file; only merged ranges of large baked models may need 32 bits (see ModelData::bakeStatic)
+	size_t indexCount = 0;
+	unsigned int maxIndex = 0;
+
+	for (const std::vector<unsigned int> &submesh : indices)
+	{
+		indexCount += submesh.size();
 
-	if (it == nodeNameToIdx.end())
-		return; // target node not found
+		for (unsigned int index : submesh)
+			maxIndex = std::max(maxIndex, index);
+	}
 
-	int nodeIndex = it->second;
-	Node *node = &nodes[nodeIndex];
+	indexType = (maxIndex > 0xFFFF) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	size_t indexSize = (indexType == GL_UNSIGNED_INT) ? sizeof(unsigned int) : sizeof(unsigned short);
 
-	std::vector<float> &timestamps = baseAnim.timestamps;
-	std::vector<std::vector<float>> &transformations = baseAnim.transformations;
+	std::vector<unsigned short> shortIndices;
+	std::vector<unsigned int> intIndices;
+	submeshIndexOffsets.resize(indices.size());
 
-	if (timestamps.empty() || transformations.empty())
+	for (int i = 0; i < (int)indices.size(); i++)
+	{
+		if (indexType == GL_UNSIGNED_INT)
+		{
+			submeshIndexOffsets[i] = intIndices.size() * indexSize;
+			intIndices.insert(intIndices.end(), indices[i].begin(), indices[i].end());
+		}
+		else
+		{
+			submeshIndexOffsets[i] = shortIndices.size() * indexSize;
+			shortIndices.insert(shortIndices.end(), indices[i].begin(), indices[i].end());
+		}
+	}
+
+	if (EBO == 0)
+		glGenBuffers(1, &EBO);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+	if (indexType == GL_UNSIGNED_INT)
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, intIndices.data(), GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, shortIndices.data(), GL_STATIC_DRAW);
+}
+
+//! Releases terrain model's GPU buffers when the last active tile using it is deactivated.
+void Model::releaseGPU()
+{
+	if (gpuUserCount == 0 || --gpuUserCount > 0)
 		return;
 
-	int keyframeCount = timestamps.size();
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &EBO);
+	glDeleteBuffers(1, &instanceVBO);
+	glDeleteVertexArrays(1, &VAO);
+	VAO = VBO = EBO = instanceVBO = 0;
+	instanceCapacity = 0;
+}
 
-	int keyframe0 = 0, keyframe1 = 0; // indices into the animation data array
+//! Finds the two keys of a track that surround 'time', and returns the position of 'time' between them in [0, 1] range.
+float Model::findKeyframes(AnimationTracks &tracks, int track, float time, int &key0, int &key1)
+{
+	int keyCount = tracks.keyCount[track];
+	const float *times = tracks.times.data() + tracks.firstKey[track];
+
+	// times before the first or after the last key hold that key
+	if (keyCount <= 1)
+	{
+		key0 = key1 = 0; // only one keyframe, use it directly (nothing to interpolate)
+		return 0.0f;
+	}
 
-	float t = 0.0f; // normalized current animation time
+	// playback time mostly moves forward by less than a keyframe between evaluations, so the search starts from the pair found last time and steps forward;
+	// on a jump backwards (loop restart, seek) or far ahead, it falls back to binary search
+	int i = std::min(tracks.cursors[track], keyCount - 2);
 
-	// find two timestamps that surround the current time
-	if (keyframeCount == 1)
-		keyframe0 = keyframe1 = 0; // only one keyframe, use it directly (nothing to interpolate)
+	if (time < times[i])
+		i = -1;
 	else
 	{
-		for (int i = 0; i < keyframeCount - 1; i++)
+		for (int step = 0; i < keyCount - 2 && time > times[i + 1]; step++, i++)
 		{
-			if (time >= timestamps[i] && time <= timestamps[i + 1])
+			if (step == maxKeyframeCursorSteps)
 			{
-				keyframe0 = i;
-				keyframe1 = i + 1;
-				float t0 = timestamps[i];
-				float t1 = timestamps[i + 1];
-
-				if (t1 > t0)
-					t = (time - t0) / (t1 - t0); // convert to range [0, 1]
-				else
-					LOG("[Warning] Model::applyBaseAnimation invalid timestamps data: next timestamp value is lower than previous one. t0 = ", t0, " > t1 = ", t1);
-
+				i = -1;
 				break;
 			}
 		}
 	}
 
-	switch (baseAnim.animationType)
-	{
-	case 1: // translation --> X Y Z
-	{
-		glm::vec3 v0(transformations[keyframe0][0], transformations[keyframe0][1], transformations[keyframe0][2]);
-		glm::vec3 v1(transformations[keyframe1][0], transformations[keyframe1][1], transformations[keyframe1][2]);
-		node->localTranslation = interpolateVec3(v0, v1, t, baseAnim.interpolationType);
-		break;
-	}
-	case 5: // rotation --> X Y Z W (GLM constructor expects W X Y Z)
-	{
-		glm::quat q0(-transformations[keyframe0][3], transformations[keyframe0][0], transformations[keyframe0][1], transformations[keyframe0][2]);
-		glm::quat q1(-transformations[keyframe1][3], transformations[keyframe1][0], transformations[keyframe1][1], transformations[keyframe1][2]);
-		node->localRotation = interpolateQuat(q0, q1, t, baseAnim.interpolationType);
-		break;
-	}
-	case 10: // scale --> X Y Z
-	{
-		glm::vec3 v0(transformations[keyframe0][0], transformations[keyframe0][1], transformations[keyframe0][2]);
-		glm::vec3 v1(transformations[keyframe1][0], transformations[keyframe1][1], transformations[keyframe1][2]);
-		node->localScale = interpolateVec3(v0, v1, t, baseAnim.interpolationType);
-		break;
-	}
-	default:
-		break;
-	}
-}
+	if (i < 0)
+		i = std::clamp((int)(std::upper_bound(times, times + keyCount, time) - times) - 1, 0, keyCount - 2);
 
-//! Interpolates between two floats.
-float Model::interpolateFloat(float a, float b, float t, int interpolationType)
-{
-	// a – previous keyframe value
-	// b – next keyframe value
-	// t – current time between these keyframes, normalized to range [0, 1] (also known as interpolation factor)
+	tracks.cursors[track] = i;
+	key0 = i;
+	key1 = i + 1;
 
-	switch (interpolationType)
+	float t0 = times[i];
+	float t1 = times[i + 1];
+
+	if (t1 <= t0)
 	{
-	case 0: // STEP
-		return a;
-	case 1: // LINEAR
-		return a + (b - a) * t;
-	case 2: // HERMITE (smooth cubic interpolation)
-		return a + (b - a) * (t * t * (3.0f - 2.0f * t));
-	default:
-		return a;
+		LOG("[Warning] Model::findKeyframes invalid timestamps data: next timestamp value is lower than previous one. t0 = ", t0, " > t1 = ", t1);
+		return 0.0f;
 	}
-}
 
-//! Interpolates between two vectors.
-glm::vec3 Model::interpolateVec3(glm::vec3 &a, glm::vec3 &b, float t, int interpolationType)
-{
-	return glm::vec3(
-		interpolateFloat(a.x, b.x, t, interpolationType),
-		interpolateFloat(a.y, b.y, t, interpolationType),
-		interpolateFloat(a.z, b.z, t, interpolationType));
+	return std::clamp((time - t0) / (t1 - t0), 0.0f, 1.0f); // convert to range [0, 1]
 }
 
-//! Interpolates between two quaternions.
-glm::quat Model::interpolateQuat(glm::quat &a, glm::quat &b, float t, int interpolationType)
+//! Evaluates all tracks of one type at a specific time and writes the results to local transformations of their target nodes (4 tracks at a time).
+void Model::evaluateTracks(AnimationTracks &tracks, int type, float time)
 {
-	switch (interpolationType)
+	int trackCount = tracks.targetNodes.size();
+
+	for (int first = 0; first < trackCount; first += 4)
 	{
-	case 0:
-		return a;
-	case 1:
-	case 2:
-		return glm::slerp(a, b, t); // spherical linear interpolation for 2 quaternions
-	default:
-		return a;
+		int count = std::min(4, trackCount - first);
+
+		// gather the surrounding key values of up to 4 tracks and their blend factors (unused lanes blend zeros)
+		alignas(16) float a[4][4] = {}, b[4][4] = {}, f[4] = {};
+
+		for (int j = 0; j < count; j++)
+		{
+			int track = first + j, key0, key1;
+
+			if (tracks.targetNodes[track] < 0 || tracks.keyCount[track] == 0)
+				continue;
+
+			float t = findKeyframes(tracks, track, time, key0, key1);
+
+			// step holds the previous key; hermite eases vectors in and out of keys (rotations are blended with the plain factor)
+			switch (tracks.interpolation[track])
+			{
+			case 1: // LINEAR
+				f[j] = t;
+				break;
+			case 2: // HERMITE (smooth cubic interpolation)
+				f[j] = (type == TRACK_ROTATION) ? t : t * t * (3.0f - 2.0f * t);
+				break;
+			default: // STEP
+				f[j] = 0.0f;
+				break;
+			}
+
+			glm::vec4 value0 = tracks.getKey(type, track, key0), value1 = tracks.getKey(type, track, key1); // decoded on the fly for compressed clips
+			memcpy(a[j], &value0, sizeof(a[j]));
+			memcpy(b[j], &value1, sizeof(b[j]));
+		}
+
+		// blend: a + (b - a) * f; rotations are blended along the shorter arc and normalized (nlerp)
+		alignas(16) float result[4][4];
+
+#if defined(__SSE2__)
+		// transpose to 1 register per component, so each instruction handles the same component of 4 tracks
+		__m128 a0 = _mm_load_ps(a[0]), a1 = _mm_load_ps(a[1]), a2 = _mm_load_ps(a[2]), a3 = _mm_load_ps(a[3]);
+		__m128 b0 = _mm_load_ps(b[0]), b1 = _mm_load_ps(b[1]), b2 = _mm_load_ps(b[2]), b3 = _mm_load_ps(b[3]);
+		_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+		_MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+		__m128 factor = _mm_load_ps(f);
+
+		if (type == TRACK_ROTATION)
+		{
+			__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, b0), _mm_mul_ps(a1, b1)), _mm_add_ps(_mm_mul_ps(a2, b2), _mm_mul_ps(a3, b3)));
+			__m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f)); // sign bit where the quaternions are more than 180° apart
+
+			b0 = _mm_xor_ps(b0, flip), b1 = _mm_xor_ps(b1, flip), b2 = _mm_xor_ps(b2, flip), b3 = _mm_xor_ps(b3, flip);
+		}
+
+		__m128 r0 = _mm_add_ps(a0, _mm_mul_ps(_mm_sub_ps(b0, a0), factor));
+		__m128 r1 = _mm_add_ps(a1, _mm_mul_ps(_mm_sub_ps(b1, a1), factor));
+		__m128 r2 = _mm_add_ps(a2, _mm_mul_ps(_mm_sub_ps(b2, a2), factor));
+		__m128 r3 = _mm_add_ps(a3, _mm_mul_ps(_mm_sub_ps(b3, a3), factor));
+
+		if (type == TRACK_ROTATION)
+		{
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, r0), _mm_mul_ps(r1, r1)), _mm_add_ps(_mm_mul_ps(r2, r2), _mm_mul_ps(r3, r3))));
+			length = _mm_max_ps(length, _mm_set1_ps(FLT_MIN)); // unused lanes are zero
+
+			r0 = _mm_div_ps(r0, length), r1 = _mm_div_ps(r1, length), r2 = _mm_div_ps(r2, length), r3 = _mm_div_ps(r3, length);
+		}
+
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_store_ps(result[0], r0), _mm_store_ps(result[1], r1), _mm_store_ps(result[2], r2), _mm_store_ps(result[3], r3);
+#else
+		for (int j = 0; j < count; j++)
+		{
+			float sign = (type == TRACK_ROTATION && a[j][0] * b[j][0] + a[j][1] * b[j][1] + a[j][2] * b[j][2] + a[j][3] * b[j][3] < 0.0f) ? -1.0f : 1.0f;
+
+			for (int k = 0; k < 4; k++)
+				result[j][k] = a[j][k] + (sign * b[j][k] - a[j][k]) * f[j];
+
+			if (type == TRACK_ROTATION)
+			{
+				float length = std::max(std::sqrt(result[j][0] * result[j][0] + result[j][1] * result[j][1] + result[j][2] * result[j][2] + result[j][3] * result[j][3]), FLT_MIN);
+
+				for (int k = 0; k < 4; k++)
+					result[j][k] /= length;
+			}
+		}
+#endif
+
+		// update local translation / rotation / scale of the target nodes
+		for (int j = 0; j < count; j++)
+		{
+			int track = first + j;
+
+			if (tracks.targetNodes[track] < 0 || tracks.keyCount[track] == 0)
+				continue;
+
+			Node &node = nodes[tracks.targetNodes[track]];
+			const float *value = result[j];
+
+			if (type == TRACK_TRANSLATION)
+				node.localTranslation = glm::vec3(value[0], value[1], value[2]);
+			else if (type == TRACK_ROTATION)
+				node.localRotation = glm::quat(value[3], value[0], value[1], value[2]); // stored X Y Z W, GLM constructor expects W X Y Z
+			else
+				node.localScale = glm::vec3(value[0], value[1], value[2]);
+		}
 	}
 }
 
@@ -318,6 +956,9 @@ glm::quat Model::interpolateQuat(glm::quat &a, glm::quat &b, float t, int interp
 void Model::resetAnimation()
 {
 	currentAnimationTime = 0.0f;
+	poseClip = -1;
+	paletteFrame = 0;
+	paletteAnimation = -1;
 
 	for (int i = 0; i < nodes.size(); i++)
 	{
@@ -339,24 +980,20 @@ void Model::reset()
 {
 	modelLoaded = false;
 
-	fileSize = 0;
-
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &EBO);
+	glDeleteBuffers(1, &instanceVBO);
 
-	VAO = VBO = 0;
+	VAO = VBO = EBO = instanceVBO = 0;
+	instanceCapacity = gpuUserCount = 0;
+	frameInstances.clear();
+	instanceFrame = 0;
+	poseTables.clear();
+	heldPoses.clear();
+	blendedPose.clear();
 
-	if (!EBOs.empty())
-	{
-		glDeleteBuffers(EBOs.size(), EBOs.data());
-		EBOs.clear();
-	}
-
-	vertices.clear();
-	indices.clear();
-	vertexCount = faceCount = 0;
-	totalSubmeshCount = 0;
-	submeshToMeshIdx.clear();
+	submeshIndexOffsets.clear();
 
 	if (!textures.empty())
 	{
@@ -364,9 +1001,7 @@ void Model::reset()
 		textures.clear();
 	}
 
-	textureCount = alternativeTextureCount = selectedTexture = 0;
-	textureNames.clear();
-	submeshTextureIndex.clear();
+	selectedTexture = 0;
 
 	glDeleteVertexArrays(1, &nodeVAO);
 	glDeleteBuffers(1, &nodeVBO);
@@ -374,22 +1009,16 @@ void Model::reset()
 
 	nodeVAO = nodeVBO = nodeEBO = 0;
 
-	nodes.clear();
-	meshToNodeIdx.clear();
-	nodeNameToIdx.clear();
-
-	boneNames.clear();
-	bindPoseMatrices.clear();
 	boneTotalTransforms.clear();
-	boneNameToNodeIdx.clear();
-	hasSkinningData = false;
 
-	animations.clear();
 	currentAnimationTime = 0.0f;
 	selectedAnimation = 0;
-	animationCount = 0;
 	animationPlaying = false;
-	animationsLoaded = false;
+	poseClip = -1;
+	paletteFrame = 0;
+	paletteAnimation = -1;
 
 	sounds.clear();
+
+	clear(); // parsed data
 }
@@ -1,183 +1,132 @@
-#ifndef PARSER_BDAE_H
-#define PARSER_BDAE_H
-
-#include <string>
-#include <vector>
-#include <cstdint>
-#include <unordered_map>
-#include "IReadResFile.h"
-#include "libs/glm/glm.hpp"
-#include "libs/glm/gtc/quaternion.hpp"
+#ifndef MODEL_H
+#define MODEL_H
+
+#include "parserBDAE.h"
 #include "shader.h"
 #include "sound.h"
 #include "light.h"
-
-// if defined, viewer prints detailed model info in terminal
-#define CONSOLE_DEBUG_LOG
-
-template <typename... Args>
-inline void LOG(Args &&...args)
-{
-#ifdef CONSOLE_DEBUG_LOG
-	(std::cout << ... << args) << std::endl;
-#endif
-}
-
-// if defined, viewer works with .bdae version from oac 1.0.3; if undefined, with oac 4.2.5
-#define BETA_GAME_VERSION
-
-#ifdef BETA_GAME_VERSION
-typedef uint32_t BDAEint;
-#else
-typedef uint64_t BDAEint;
-#endif
+#include "bonePalette.h"
+#include "renderQueue.h"
 
 const float meshRotationSensitivity = 0.3f;
-
-// 60 or 80 bytes (depends on .bdae version)
-struct BDAEFileHeader
+const float boundsSampleRate = 10.0f; // animation poses sampled per second of a clip when growing model's bounding box (see computeAnimatedBounds)
+const int maxBoundsSamples = 64;	  // cap on sampled poses per clip
+const float poseTableRate = 30.0f;	  // frames per second of pre-baked pose tables (.bdae animations are authored to be played at 30 FPS)
+const int poseTableBudget = 1 << 20;  // max size of one clip's pose table in bytes; longer clips or larger skeletons are evaluated every frame (0 → pose tables disabled)
+const bool poseTableLerp = true;	  // whether poses between table frames are blended from the 2 nearest frames (false → nearest frame)
+const int heldPoseCapacity = 16;	  // poses of throttled updates kept per model for blending (see Model::heldPose)
+const int maxKeyframeCursorSteps = 4; // keyframes an animation channel's cursor steps forward before its lookup falls back to binary search (see findKeyframes)
+
+// Per-instance animation playback state (a Model may be shared by many placed instances, see Terrain).
+// Instances play their clip from a shared clock shifted by their phase, so instances with the same clip and phase sample the same time and share 1 pose evaluation.
+struct AnimationState
 {
-	unsigned int signature;									// 4 bytes  file signature – 'BRES' for .bdae file
-	unsigned short endianCheck;								// 2 bytes  byte order mark
-	unsigned short version;									// 2 bytes  byte order mark
-	unsigned int sizeOfHeader;								// 4 bytes  header size in bytes
-	unsigned int sizeOfFile;								// 4 bytes  file size in bytes
-	unsigned int numOffsets;								// 4 bytes  number of entries in the offset table
-	unsigned int origin;									// 4 bytes  file origin – always '0' for standalone .bdae files (?)
-	BDAEint offsetOffsetTable;								// 8 bytes  offset to Offset Data section (in bytes, from the beginning of the file)
-	BDAEint offsetStringTable;								// 8 bytes  offset to String Data section
-	BDAEint offsetData;										// 8 bytes  offset to Data section
-	BDAEint offsetRelatedFiles;								// 8 bytes  offset to related file names (?)
-	BDAEint offsetRemovable;								// 8 bytes  offset to Removable section
-	unsigned int sizeOfRemovable;							// 4 bytes  size of Removable section in bytes
-	unsigned int numRemovableChunks;						// 4 bytes  number of removable chunks
-	unsigned int useSeparatedAllocationForRemovableBuffers; // 4 bytes  1: each removable chunk is loaded into its own separately allocated buffer, 0: all chunks in one shared buffer
-	unsigned int sizeOfDynamic;								// 4 bytes  size of dynamic chunk (?)
+	int clip;	 // played animation (index into Model::animations)
+	float phase; // offset from the shared clock in seconds
 };
 
-struct Vertex
+// Distance tier of animation updates: instances at least 'distance' units away from the camera update their pose 'rate' times per second and blend between the last 2 updates in between (rate 0 → every frame).
+// Updated poses are kept and shared: instances of a tier with the same clip and phase sample the same times, so a far crowd costs 1 pose evaluation per update instead of 1 per instance per frame (clips with a pose table blend table frames, see Model::heldPose).
+struct AnimationTier
 {
-	glm::vec3 PosCoords;
-	glm::vec3 Normal;
-	glm::vec2 TexCoords;
-	char BoneIndices[4];  // indices into boneNames array (up to 4 bones can influence 1 vertex)
-	float BoneWeights[4]; // influence weights in [0, 1] range
+	float distance;
+	float rate;
 };
 
-struct Node
-{
-	std::string ID;				   // 1st node name (e.g. 'Bip001_Head-node')
-	std::string mainName;		   // 2nd node name; used for mesh mapping (e.g. 'Bip001_Head')
-	std::string boneName;		   // 3rd node name; used for bone mapping (e.g. 'Bone3')
-	int parentIndex;			   // index of parent node into nodes array (-1 = root)
-	std::vector<int> childIndices; // indices of child nodes into nodes array
-
-	glm::mat4 pivotTransform; // transformation of the child helper PIVOT node (if it exists)
+const AnimationTier defaultAnimationTiers[] = {{0.0f, 0.0f}, {48.0f, 15.0f}, {96.0f, 7.5f}, {160.0f, 3.75f}};
 
-	// original transformation; used for animation reset
-	glm::vec3 defaultTranslation;
-	glm::quat defaultRotation;
-	glm::vec3 defaultScale;
-
-	// own current transformation; updated each frame during animation
-	glm::vec3 localTranslation;
-	glm::quat localRotation;
-	glm::vec3 localScale;
-
-	glm::mat4 totalTransform; // parent * local * pivot
-};
-
-struct BaseAnimation
-{
-	// channel data
-	std::string targetNodeName; // model node that this animation affects
-	int animationType;			// 1 = translation | 5 = rotation | 10 = scale
-
-	// sampler data
-	int interpolationType;							 // 0 = step | 1 = linear | 2 = hermite
-	std::vector<float> timestamps;					 // time values in seconds
-	std::vector<std::vector<float>> transformations; // transformation values (vectors or quaternions)
-};
-
-// Class for loading and rendering 3D model.
+// Class for loading and rendering 3D model (parsed data is inherited from ModelData, see parserBDAE.h).
 // _________________________________________
 
-class Model
+class Model : public ModelData
 {
   public:
 	Shader shader;
-	std::string fileName;
-	std::vector<std::string> textureNames;
-	std::vector<int> submeshTextureIndex;
-	int fileSize, vertexCount, faceCount, totalSubmeshCount;
-	int textureCount, alternativeTextureCount, selectedTexture;
+	int selectedTexture;
 	unsigned int VAO;				// Vertex Attribute Object ID (stores vertex attribute configuration on GPU)
 	unsigned int VBO;				// Vertex Buffer Object ID (stores vertex data on GPU)
-	std::vector<unsigned int> EBOs; // Element Buffer Object ID for each submesh (stores index data on GPU)
-
-	std::vector<Vertex> vertices;					  // vertex data
-	std::vector<std::vector<unsigned short>> indices; // index data for each submesh (triangles)
-	std::vector<unsigned int> textures;				  // texture ID(s)
-	std::vector<std::string> sounds;				  // sound file name(s)
+	unsigned int EBO;				// Element Buffer Object ID (stores index data of all submeshes on GPU, see uploadIndices)
+	unsigned int indexType;			// GL_UNSIGNED_SHORT, or GL_UNSIGNED_INT if a submesh has a local index above 65535
+	std::vector<int> submeshIndexOffsets; // byte offset of each submesh's indices in EBO
+	unsigned int instanceVBO;		// per-instance world matrices for instanced draws (terrain models only)
+	int instanceCapacity;			// size of instanceVBO in matrices
+	std::vector<glm::mat4> frameInstances; // world matrices of all instanced draws queued in the current frame (uploaded to instanceVBO at once when the first of them is submitted)
+	unsigned int instanceFrame;			   // frame that frameInstances belong to
+	bool instancesUploaded;				   // whether instanceVBO holds frameInstances
+	int boundInstanceBase;				   // first matrix of instanceVBO the instance attributes currently point to
+	RenderPass renderPass;				   // render queue pass of textured draws (see RenderQueue)
+	int gpuUserCount;					   // number of active terrain tiles that use the model's GPU buffers (see acquireGPU)
+
+	std::vector<unsigned int> textures; // texture ID(s)
+	std::vector<std::string> sounds;	// sound file name(s)
 
 	glm::vec3 modelCenter; // geometric center of the model
 
+	std::vector<glm::vec3> occluderTriangles; // simplified copy of the geometry rasterized for occlusion culling (terrain models that are large enough only, see OcclusionBuffer::buildOccluderMesh)
+
 	float meshPitch = 0.0f;
 	float meshYaw = 0.0f;
 
 	bool modelLoaded;
 
-	char *DataBuffer; // raw binary content of .bdae file
-
-	std::vector<Node> nodes; // node tree
-	Shader defaultShader;	 // for nodes visualization
+	Shader defaultShader; // for nodes visualization
 	unsigned int nodeVAO, nodeVBO, nodeEBO;
 
-	// skinning data
-	bool hasSkinningData;
-	std::vector<std::string> boneNames;
-	glm::mat4 bindShapeMatrix;					// correction matrix that transforms all model vertices from their raw positions defined in the .bdae file (mesh local space) to skeleton (or "bind pose") space (coordinate system where the skeleton was defined)
-	std::vector<glm::mat4> bindPoseMatrices;	// inverse bind pose matrix for each bone; transforms vertices from their bind positions in skeleton space to the bone's local space
 	std::vector<glm::mat4> boneTotalTransforms; // skinning matrix for each bone (it is node transform * inverse bind pose matrix); this matrix transforms a vertex to node's animated position
+	unsigned int paletteFrame;					// frame in which boneTotalTransforms were last uploaded to the bone palette (see BonePalette)
+	int paletteOffset;							// position of the uploaded matrices in the bone palette
+	int paletteAnimation;						// animation state the uploaded matrices were computed for (draws with the same state in one frame share them)
+	float paletteTime;
 
-	// animation data
-	std::vector<std::pair<float, std::vector<BaseAnimation>>> animations; // all loaded animation files data; for each file: {duration, set of base animations}
-	bool animationsLoaded;												  // whether at least one animation file is loaded
-	bool animationPlaying;												  // whether animation is playing
-	int animationCount;													  // number of animation files found
-	int selectedAnimation;												  // currently selected animation file index
-	float currentAnimationTime;											  // current playback time
-
-	// utility hash tables
-	std::unordered_map<int, int> submeshToMeshIdx;			// (index in EBOs array → ..)
-	std::unordered_map<int, int> meshToNodeIdx;				// (index in meshNames array → index in nodes array)
-	std::unordered_map<std::string, int> nodeNameToIdx;		// (node name → index in nodes array)
-	std::unordered_map<std::string, int> boneNameToNodeIdx; // (bone name → index in nodes array)
-	std::unordered_map<int, int> boneToNodeIdx;				// (index in boneNames array → index in nodes array)
+	// animation work across all models since the last reset (reset by the caller once per frame, see Terrain::draw)
+	static inline int poseEvaluations = 0;	// poses evaluated from animation tracks (see evaluatePose)
+	static inline int poseTableSamples = 0; // poses read from pose tables (see samplePoseTable)
+
+	// pose of a clip at one time, kept while throttled instances blend between 2 updates (see AnimationTier)
+	struct HeldPose
+	{
+		int clip;
+		float time;
+		unsigned int lastUsedFrame;		 // for least recently used replacement
+		std::vector<glm::mat4> matrices; // skinning matrices (skinned model) or total transform of each node
+	};
+
+	std::vector<HeldPose> heldPoses;			  // at most heldPoseCapacity
+	std::vector<glm::mat4> blendedPose;			  // pose of the current blended draw (same layout as HeldPose::matrices)
+
+	std::vector<std::vector<glm::mat4>> poseTables; // skinning matrices of each animation clip pre-baked at poseTableRate, frame after frame (empty → clip is evaluated every frame; see bakePoseTables)
+
+	// animation playback state of the 3D viewer (terrain instances keep their own, see AnimationState)
+	bool animationPlaying;		// whether animation is playing
+	int selectedAnimation;		// currently selected animation file index
+	float currentAnimationTime; // current playback time
+
+	int poseClip;	// animation and time of the pose currently held in the node tree (-1 → no animation evaluated)
+	float poseTime; // (evaluatePose skips the work when asked for the same pose again)
 
 	Model(const char *vertex, const char *fragment)
-		: DataBuffer(NULL),
-		  shader(vertex, fragment),
-		  defaultShader("shaders/default.vs", "shaders/default.fs"),
-		  VAO(0), VBO(0),
-		  nodeVAO(0), nodeVBO(0), nodeEBO(0),
-		  fileSize(0),
-		  vertexCount(0), faceCount(0),
-		  totalSubmeshCount(0),
-		  modelCenter(glm::vec3(-1.0f)),
-		  textureCount(0),
-		  alternativeTextureCount(0),
+		: shader(vertex, fragment),
 		  selectedTexture(0),
-		  hasSkinningData(false),
+		  VAO(0), VBO(0), EBO(0),
+		  indexType(GL_UNSIGNED_SHORT),
+		  instanceVBO(0), instanceCapacity(0),
+		  instanceFrame(0), instancesUploaded(false), boundInstanceBase(0),
+		  renderPass(RENDER_PASS_MODELS),
+		  gpuUserCount(0),
+		  modelCenter(glm::vec3(-1.0f)),
 		  modelLoaded(false),
-		  animationsLoaded(false),
+		  defaultShader("shaders/default.vs", "shaders/default.fs"),
+		  nodeVAO(0), nodeVBO(0), nodeEBO(0),
+		  paletteFrame(0), paletteOffset(0),
+		  paletteAnimation(-1), paletteTime(0.0f),
 		  animationPlaying(false),
-		  animationCount(0),
 		  selectedAnimation(0),
-		  currentAnimationTime(0.0f)
+		  currentAnimationTime(0.0f),
+		  poseClip(-1), poseTime(0.0f)
 	{
 		shader.use();
 		shader.setInt("modelTexture", 0);
+		shader.setInt("bonePalette", BONE_PALETTE_TEXTURE_UNIT);
 		shader.setVec3("lightPos", lightPos);
 		shader.setVec3("lightColor", lightColor);
 		shader.setFloat("ambientStrength", ambientStrength);
@@ -185,47 +134,72 @@ class Model
 		shader.setFloat("specularStrength", specularStrength);
 	}
 
-	// functions for parsing: implemented in parserBDAE.cpp
-	// ____________________
+	// terrain models are freed with the last tile that uses them (see Terrain::evictTile, main thread), so their textures and buffers are freed here too
+	~Model() { reset(); }
 
-	//! Parses .bdae model file: textures, materials, meshes, mesh skin (if exist), and node tree.
-	int init(IReadResFile *file);
+	Model(const Model &) = delete;
+	Model &operator=(const Model &) = delete;
 
-	//! Loads .bdae model file from disk, calls init function and searches for animations, sounds, and alternative colors.
+	//! Parses .bdae model file (see ModelData::load), searches for sounds, and uploads model data to GPU.
 	void load(const char *fpath, Sound &sound, bool isTerrainViewer);
 
-	//! Loads .bdae animation file from disk and parses animation samplers, channels, and data (timestamps and transformations).
-	void loadAnimation(const char *animationFilePath);
+	//! Takes over model data already parsed elsewhere (e.g. on a worker thread) and uploads it to GPU.
+	void load(ModelData &&data, bool isTerrainViewer);
+
+	//! Uploads parsed model data (vertices, indices, textures, node tree) to GPU.
+	void setupGPU(bool isTerrainViewer);
+
+	//! Packs indices of all submeshes into 1 element buffer, recorded in the currently bound vertex array (16-bit indices unless a submesh needs 32-bit ones).
+	void uploadIndices();
+
+	//! Renders .bdae model in the 3D viewer: advances viewer's own playback state (if playing), then draws the current pose (submits the render queue).
+	void draw(glm::mat4 model, float dt, bool simple);
+
+	//! Queues .bdae model posed at 'time' of animation 'clip' for rendering (clip -1 keeps the current pose); camera and lighting switch are taken from the per-frame uniform block, see FrameData.
+	void draw(glm::mat4 model, int clip, float time, bool simple);
+
+	//! Queues 'count' instances of the model in the same pose for rendering, 1 draw call per submesh (see RenderQueue); 'transforms' are their world matrices (NULL → 1 non-instanced draw with 'model').
+	//! 'blend' > 0 draws the pose blended from 'time' towards 'nextTime' (throttled updates, see AnimationTier).
+	void drawInstances(glm::mat4 model, const glm::mat4 *transforms, int count, int clip, float time, bool simple, float nextTime = 0.0f, float blend = 0.0f);
+
+	//! Sets uniforms of a queued submesh draw and issues it (called by RenderQueue::flush with model's program and vertex array bound).
+	static void submitSubmesh(const RenderItem &item);
+
+	//! Uploads the instance matrices queued in the current frame (once) and points instance attributes at 'baseInstance' (model's vertex array must be bound).
+	void bindInstances(int baseInstance);
+
+	//! Uploads vertex and index buffers of a terrain model on first use by an active tile (all tiles that place the model share them).
+	void acquireGPU();
 
-	//! Recursively parses a node and its children.
-	void parseNodesRecursive(int nodeOffset, int parentIndex);
+	//! Releases terrain model's GPU buffers when the last active tile using it is deactivated.
+	void releaseGPU();
 
-	//! Recursively computes total transformation matrix for a node and its children.
-	void updateNodesTransformationsRecursive(int nodeIndex, const glm::mat4 &parentTransform);
+	//! Grows model's bounding box to hold its poses in all loaded animations (sampled at boundsSampleRate), then returns the node tree to the rest pose.
+	void computeAnimatedBounds();
 
-	//! [debug] Recursively prints the node tree.
-	void printNodesRecursive(int nodeIndex, const std::string &prefix, bool isLastChild);
+	//! Samples each animation clip of a skinned model at poseTableRate into a table of final skinning matrices (clips over poseTableBudget are left out), then returns the node tree to the rest pose.
+	void bakePoseTables();
 
-	//! Recursively searches down the tree starting from a given node for the first node with '_PIVOT' in its ID and returns its local transformation matrix.
-	glm::mat4 getPIVOTNodeTransformationRecursive(int nodeIndex);
+	//! Fills boneTotalTransforms with the pose of 'clip' at 'time' from its pose table; returns false if the clip has no table.
+	bool samplePoseTable(int clip, float time);
 
-	// functions for rendering: implemented in model.cpp
-	// ____________________
+	//! Returns the pose of 'clip' at 'time' kept for blending throttled updates (skinning matrices of a skinned model, node transforms otherwise), computing it if it is not kept yet.
+	const std::vector<glm::mat4> &heldPose(int clip, float time);
 
-	//! Renders .bdae model.
-	void draw(glm::mat4 model, glm::mat4 view, glm::mat4 projection, glm::vec3 cameraPos, float dt, bool lighting, bool simple);
+	//! Computes skinning matrix of each bone from the pose currently held in the node tree.
+	void computeSkinningMatrices(glm::mat4 *matrices);
 
-	//! Applies a base animation (translation / rotation / scale) at a specific time, targeting one node.
-	void applyBaseAnimation(BaseAnimation &baseAnim, float time);
+	//! Returns playback time of animation 'clip' for a clock that keeps running (animations loop).
+	float getClipTime(int clip, float clock) const;
 
-	//! Interpolates between two floats.
-	float interpolateFloat(float a, float b, float t, int interpolationType);
+	//! Poses the node tree at 'time' of animation 'clip'; does nothing if the tree already holds this pose.
+	void evaluatePose(int clip, float time);
 
-	//! Interpolates between two vectors.
-	glm::vec3 interpolateVec3(glm::vec3 &a, glm::vec3 &b, float t, int interpolationType);
+	//! Evaluates all tracks of one type at a specific time and writes the results to local transformations of their target nodes (4 tracks at a time).
+	void evaluateTracks(AnimationTracks &tracks, int type, float time);
 
-	//! Interpolates between two quaternions.
-	glm::quat interpolateQuat(glm::quat &a, glm::quat &b, float t, int interpolationType);
+	//! Finds the two keys of a track that surround 'time', and returns the position of 'time' between them in [0, 1] range.
+	static float findKeyframes(AnimationTracks &tracks, int track, float time, int &key0, int &key1);
 
 	//! Resets animation to beginning.
 	void resetAnimation();
@@ -0,0 +1,78 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <string>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include "parserBDAE.h"
+#include "threadPool.h"
+
+// Class for parsing .bdae models concurrently on a thread pool (CPU side only, see ModelData).
+// Each file name is parsed at most once: concurrent requests for the same file wait on one shared future.
+// ________________________________________
+
+class ModelLoader
+{
+  public:
+	typedef std::shared_future<std::shared_ptr<ModelData>> Request; // resolves to parsed data, or NULL if parsing failed
+
+	explicit ModelLoader(unsigned int threadCount = std::thread::hardware_concurrency())
+		: pool(threadCount) {}
+
+	//! Returns the in-flight (or finished) parse request for a .bdae file, starting a new one on the thread pool if the file was not requested before.
+	Request request(const std::string &fname, bool isTerrainViewer)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = requests.find(fname);
+
+		if (it != requests.end())
+			return it->second;
+
+		Request request = pool.enqueue([fname, isTerrainViewer]() -> std::shared_ptr<ModelData>
+									   {
+			std::shared_ptr<ModelData> data = std::make_shared<ModelData>();
+
+			if (data->load(fname.c_str(), isTerrainViewer) != 0)
+				return NULL;
+
+			return data; })
+							  .share();
+
+		requests[fname] = request;
+		return request;
+	}
+
+	//! Forgets a finished request, so that the next request for the file parses it again (failed requests are kept, so that broken files are not parsed repeatedly); returns false if the request was kept.
+	bool forget(const std::string &fname)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = requests.find(fname);
+
+		if (it == requests.end())
+			return true;
+
+		if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready || !it->second.get())
+			return false;
+
+		requests.erase(it);
+		return true;
+	}
+
+	//! Forgets all requests (parsed data stays alive as long as someone holds it).
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requests.clear();
+	}
+
+  private:
+	ThreadPool pool;
+	std::mutex mutex;
+	std::unordered_map<std::string, Request> requests; // (file name → parse request)
+};
+
+#endif
@@ -0,0 +1,360 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "libs/glm/glm.hpp"
+#include "parserBDAE.h"
+
+const int occlusionBufferWidth = 256;  // resolution of the coarse depth buffer (it covers the whole view, so its aspect ratio does not need to match the window)
+const int occlusionBufferHeight = 128; //
+const int maxOccluderTriangles = 2048; // models with more triangles are not used as occluders (too expensive to rasterize every frame)
+const float minOccluderSize = 6.0f;	   // models whose bounding box is smaller than this (in world space units) along both horizontal axes are not used as occluders
+
+// Class for software occlusion culling (CPU only, no OpenGL calls, so it can run and be benchmarked headless, see tools/occlusion_bench.cpp).
+// Each frame, large occluders near the camera (terrain heightfield, big buildings) are rasterized into a coarse depth buffer, which is reduced to a hierarchical-Z pyramid
+// (each texel of a level stores the farthest depth of its 2 x 2 texels on the previous level). A bounding box is hidden if its nearest point is behind the farthest occluder depth
+// over the screen area it covers; the pyramid level is picked so that this area spans at most 2 x 2 texels, so 1 test reads at most 9 values.
+// Depth is stored as z / w of clip space (in [-1, 1] inside the view volume, farther → larger).
+// ________________________________________
+
+class OcclusionBuffer
+{
+  public:
+	// statistics of the current frame (reset by begin)
+	int trianglesRasterized;
+	int boxesTested;
+	int boxesOccluded;
+
+	OcclusionBuffer()
+		: trianglesRasterized(0), boxesTested(0), boxesOccluded(0),
+		  viewProjection(1.0f)
+	{
+		// level sizes halve down to 1 x 1
+		for (int w = occlusionBufferWidth, h = occlusionBufferHeight;; w = std::max(1, w / 2), h = std::max(1, h / 2))
+		{
+			levelSizes.push_back(glm::ivec2(w, h));
+			levels.push_back(std::vector<float>(w * h, 1.0f));
+
+			if (w == 1 && h == 1)
+				break;
+		}
+	}
+
+	//! Starts a new frame: clears the depth buffer to the far plane and sets the camera ('viewProjection' — projection * view matrix).
+	void begin(const glm::mat4 &matrix)
+	{
+		viewProjection = matrix;
+		std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+
+		trianglesRasterized = boxesTested = boxesOccluded = 0;
+	}
+
+	//! Rasterizes a triangle list ('count' vertices, 3 per triangle) placed in the world by 'model' matrix.
+	void addTriangles(const glm::vec3 *vertices, int count, const glm::mat4 &model)
+	{
+		glm::mat4 matrix = viewProjection * model;
+
+		for (int i = 0; i + 2 < count; i += 3)
+			addTriangle(matrix * glm::vec4(vertices[i], 1.0f), matrix * glm::vec4(vertices[i + 1], 1.0f), matrix * glm::vec4(vertices[i + 2], 1.0f));
+	}
+
+	//! Rasterizes a height map of 'size' x 'size' vertices (row-major, rows go along z axis) spaced by 'step' units, with its first vertex at ('originX', 'originZ').
+	void addHeightfield(const float *heights, int size, float originX, float originZ, float step)
+	{
+		// transform each vertex once, cells share them
+		clipVertices.resize(size * size);
+
+		for (int row = 0, v = 0; row < size; row++)
+			for (int col = 0; col < size; col++, v++)
+				clipVertices[v] = viewProjection * glm::vec4(originX + col * step, heights[v], originZ + row * step, 1.0f);
+
+		for (int row = 0; row + 1 < size; row++)
+		{
+			for (int col = 0; col + 1 < size; col++)
+			{
+				int v = row * size + col;
+
+				addTriangle(clipVertices[v], clipVertices[v + size], clipVertices[v + 1]);
+				addTriangle(clipVertices[v + 1], clipVertices[v + size], clipVertices[v + size + 1]);
+			}
+		}
+	}
+
+	//! Rasterizes a triangle given in clip space; the part in front of the near plane is kept.
+	void addTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+	{
+		// most triangles are entirely in front of the near plane (z >= -w)
+		if (a.z >= -a.w && b.z >= -b.w && c.z >= -c.w)
+		{
+			rasterizeTriangle(a, b, c);
+			return;
+		}
+
+		// clip the triangle by the near plane (it becomes a polygon of up to 4 vertices, drawn as a fan)
+		const glm::vec4 *input[3] = {&a, &b, &c};
+		glm::vec4 polygon[4];
+		int polygonSize = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4 &p = *input[i];
+			const glm::vec4 &q = *input[(i + 1) % 3];
+
+			float dp = p.z + p.w; // signed distance to the near plane (>= 0 → in front)
+			float dq = q.z + q.w;
+
+			if (dp >= 0.0f)
+				polygon[polygonSize++] = p;
+
+			if ((dp >= 0.0f) != (dq >= 0.0f))
+				polygon[polygonSize++] = p + (q - p) * (dp / (dp - dq));
+		}
+
+		for (int i = 1; i + 1 < polygonSize; i++)
+			rasterizeTriangle(polygon[0], polygon[i], polygon[i + 1]);
+	}
+
+	//! Builds the hierarchical-Z pyramid from the depth buffer (call after all occluders are added, before testing).
+	void buildHiZ()
+	{
+		// occluders are sampled at pixel centers, so a pixel on a silhouette may be only partly covered (and a pixel on a slope is farther at one of its corners):
+		// each pixel takes the farthest depth of its 3 x 3 neighborhood, which shrinks the occluders by a pixel and keeps the buffer conservative
+		std::vector<float> &depth = levels[0];
+		erodeScratch.resize(depth.size());
+
+		for (int y = 0; y < occlusionBufferHeight; y++)
+		{
+			const float *src = &depth[y * occlusionBufferWidth];
+			float *dst = &erodeScratch[y * occlusionBufferWidth];
+
+			for (int x = 0; x < occlusionBufferWidth; x++)
+				dst[x] = std::max({src[std::max(x - 1, 0)], src[x], src[std::min(x + 1, occlusionBufferWidth - 1)]});
+		}
+
+		for (int y = 0; y < occlusionBufferHeight; y++)
+		{
+			const float *above = &erodeScratch[std::max(y - 1, 0) * occlusionBufferWidth];
+			const float *row = &erodeScratch[y * occlusionBufferWidth];
+			const float *below = &erodeScratch[std::min(y + 1, occlusionBufferHeight - 1) * occlusionBufferWidth];
+			float *dst = &depth[y * occlusionBufferWidth];
+
+			for (int x = 0; x < occlusionBufferWidth; x++)
+				dst[x] = std::max({above[x], row[x], below[x]});
+		}
+
+		for (int l = 1; l < (int)levels.size(); l++)
+		{
+			const std::vector<float> &src = levels[l - 1];
+			std::vector<float> &dst = levels[l];
+			glm::ivec2 srcSize = levelSizes[l - 1], dstSize = levelSizes[l];
+
+			for (int y = 0; y < dstSize.y; y++)
+			{
+				int y0 = std::min(2 * y, srcSize.y - 1), y1 = std::min(2 * y + 1, srcSize.y - 1);
+
+				for (int x = 0; x < dstSize.x; x++)
+				{
+					int x0 = std::min(2 * x, srcSize.x - 1), x1 = std::min(2 * x + 1, srcSize.x - 1);
+
+					dst[y * dstSize.x + x] = std::max(std::max(src[y0 * srcSize.x + x0], src[y0 * srcSize.x + x1]),
+													  std::max(src[y1 * srcSize.x + x0], src[y1 * srcSize.x + x1]));
+				}
+			}
+		}
+	}
+
+	//! Returns false if the axis-aligned box (world space center and half size) is completely hidden behind occluders; boxes crossing the near plane or outside the view are always visible.
+	bool isVisible(const glm::vec3 &center, const glm::vec3 &extent)
+	{
+		boxesTested++;
+
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+		float minDepth = FLT_MAX;
+
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec3 corner = center + extent * glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+			glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+
+			if (clip.z < -clip.w || clip.w <= 0.0f) // box reaches behind the near plane — the camera may be inside it
+				return true;
+
+			float invW = 1.0f / clip.w;
+			float x = (clip.x * invW * 0.5f + 0.5f) * occlusionBufferWidth;
+			float y = (clip.y * invW * 0.5f + 0.5f) * occlusionBufferHeight;
+
+			minX = std::min(minX, x), maxX = std::max(maxX, x);
+			minY = std::min(minY, y), maxY = std::max(maxY, y);
+			minDepth = std::min(minDepth, clip.z * invW);
+		}
+
+		// outside the view (frustum culling handles these)
+		if (maxX < 0.0f || maxY < 0.0f || minX >= occlusionBufferWidth || minY >= occlusionBufferHeight)
+			return true;
+
+		int x0 = std::max(0, (int)minX), x1 = std::min(occlusionBufferWidth - 1, (int)maxX);
+		int y0 = std::max(0, (int)minY), y1 = std::min(occlusionBufferHeight - 1, (int)maxY);
+
+		// pick the finest level on which the covered area spans at most 2 x 2 texels
+		int level = 0;
+
+		while (level + 1 < (int)levels.size() && std::max(x1 - x0, y1 - y0) >> level > 1)
+			level++;
+
+		const std::vector<float> &depth = levels[level];
+		int width = levelSizes[level].x;
+		float maxDepth = -FLT_MAX;
+
+		for (int y = y0 >> level; y <= y1 >> level; y++)
+			for (int x = x0 >> level; x <= x1 >> level; x++)
+				maxDepth = std::max(maxDepth, depth[y * width + x]);
+
+		if (minDepth > maxDepth)
+		{
+			boxesOccluded++;
+			return false;
+		}
+
+		return true;
+	}
+
+	//! Tests a batch of boxes stored as a structure of arrays; only boxes still marked visible are tested, hidden ones are marked 0.
+	void cullBoxes(const float *centerX, const float *centerY, const float *centerZ, const float *extentX, const float *extentY, const float *extentZ, int count, unsigned char *visible)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (visible[i] && !isVisible(glm::vec3(centerX[i], centerY[i], centerZ[i]), glm::vec3(extentX[i], extentY[i], extentZ[i])))
+				visible[i] = 0;
+		}
+	}
+
+	//! Builds model's occluder mesh: triangle list of its rest pose in model space (empty if the model is not suited as an occluder — skinned, too small or too detailed).
+	static void buildOccluderMesh(const ModelData &model, std::vector<glm::vec3> &triangles)
+	{
+		triangles.clear();
+
+		if (model.hasSkinningData || model.boundsMin.x > model.boundsMax.x)
+			return;
+
+		glm::vec3 size = model.boundsMax - model.boundsMin;
+
+		if (size.x < minOccluderSize && size.z < minOccluderSize)
+			return;
+
+		int triangleCount = 0;
+
+		for (const std::vector<unsigned int> &submesh : model.indices)
+			triangleCount += submesh.size() / 3;
+
+		if (triangleCount == 0 || triangleCount > maxOccluderTriangles)
+			return;
+
+		triangles.reserve(triangleCount * 3);
+
+		for (int i = 0; i < model.totalSubmeshCount && i < (int)model.indices.size(); i++)
+		{
+			// same node transform the submesh is drawn with (see Model::drawInstances)
+			glm::mat4 transform(1.0f);
+
+			if (i < (int)model.submeshNodeIdx.size() && model.submeshNodeIdx[i] >= 0)
+				transform = model.nodes[model.submeshNodeIdx[i]].totalTransform;
+
+			const std::vector<unsigned int> &submesh = model.indices[i];
+			const Vertex *base = model.vertices.data() + model.submeshBaseVertex[i];
+			unsigned int vertexCount = model.vertices.size() - model.submeshBaseVertex[i];
+
+			for (int j = 0; j + 2 < (int)submesh.size(); j += 3)
+			{
+				if (submesh[j] >= vertexCount || submesh[j + 1] >= vertexCount || submesh[j + 2] >= vertexCount)
+					continue;
+
+				for (int k = 0; k < 3; k++)
+					triangles.push_back(glm::vec3(transform * glm::vec4(base[submesh[j + k]].PosCoords, 1.0f)));
+			}
+		}
+	}
+
+  private:
+	glm::mat4 viewProjection;
+	std::vector<std::vector<float>> levels; // hierarchical-Z pyramid (level 0 — the depth buffer itself), row-major
+	std::vector<glm::ivec2> levelSizes;		// width and height of each level
+	std::vector<glm::vec4> clipVertices;	// scratch buffer for addHeightfield
+	std::vector<float> erodeScratch;		// scratch buffer for buildHiZ
+
+	//! Rasterizes a clip space triangle that lies in front of the near plane, keeping the nearest depth per pixel (sampled at pixel centers).
+	void rasterizeTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+	{
+		// to buffer coordinates (pixels) and depth
+		glm::vec3 p[3];
+		const glm::vec4 *v[3] = {&a, &b, &c};
+
+		for (int i = 0; i < 3; i++)
+		{
+			float invW = 1.0f / v[i]->w;
+			p[i] = glm::vec3((v[i]->x * invW * 0.5f + 0.5f) * occlusionBufferWidth, (v[i]->y * invW * 0.5f + 0.5f) * occlusionBufferHeight, v[i]->z * invW);
+		}
+
+		float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+
+		if (std::abs(area) < 1e-8f) // degenerate (or seen edge-on)
+			return;
+
+		// both windings are accepted (occluders are not guaranteed to be closed or consistently wound): flip to counter-clockwise
+		if (area < 0.0f)
+		{
+			std::swap(p[1], p[2]);
+			area = -area;
+		}
+
+		int x0 = std::max(0, (int)std::floor(std::min({p[0].x, p[1].x, p[2].x})));
+		int x1 = std::min(occlusionBufferWidth - 1, (int)std::ceil(std::max({p[0].x, p[1].x, p[2].x})));
+		int y0 = std::max(0, (int)std::floor(std::min({p[0].y, p[1].y, p[2].y})));
+		int y1 = std::min(occlusionBufferHeight - 1, (int)std::ceil(std::max({p[0].y, p[1].y, p[2].y})));
+
+		if (x0 > x1 || y0 > y1)
+			return;
+
+		trianglesRasterized++;
+
+		// edge functions e_i(x, y) = A_i * x + B_i * y + C_i (edge opposite to vertex i), stepped incrementally along rows and columns
+		float A[3], B[3], C[3];
+
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec3 &s = p[(i + 1) % 3], &t = p[(i + 2) % 3];
+			A[i] = s.y - t.y;
+			B[i] = t.x - s.x;
+			C[i] = s.x * t.y - s.y * t.x;
+		}
+
+		// depth is affine in screen space: z = z0 + (e_1 * (z1 - z0) + e_2 * (z2 - z0)) / area
+		float invArea = 1.0f / area;
+		float dz1 = (p[1].z - p[0].z) * invArea, dz2 = (p[2].z - p[0].z) * invArea;
+
+		std::vector<float> &depth = levels[0];
+
+		for (int y = y0; y <= y1; y++)
+		{
+			float py = y + 0.5f, px = x0 + 0.5f;
+			float e0 = A[0] * px + B[0] * py + C[0];
+			float e1 = A[1] * px + B[1] * py + C[1];
+			float e2 = A[2] * px + B[2] * py + C[2];
+			float *row = &depth[y * occlusionBufferWidth];
+
+			for (int x = x0; x <= x1; x++, e0 += A[0], e1 += A[1], e2 += A[2])
+			{
+				if (e0 < 0.0f || e1 < 0.0f || e2 < 0.0f)
+					continue;
+
+				float z = p[0].z + e1 * dz1 + e2 * dz2;
+
+				if (z < row[x])
+					row[x] = z;
+			}
+		}
+	}
+};
+
+#endif
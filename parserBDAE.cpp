@@ -1,23 +1,57 @@
-#include "model.h"
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include "parserBDAE.h"
 #include "PackPatchReader.h"
-#include "libs/stb_image.h"
+#include "libs/glm/gtc/matrix_transform.hpp"
+
+//! Returns read-only access to the whole content of a .bdae file: if the file is already held in memory (e.g. an entry decompressed by the archive reader), its buffer is used in place without allocation or copy; otherwise, the file is read once into a single buffer owned by the caller.
+static const char *getFileContent(IReadResFile *file, std::unique_ptr<char[]> &ownedBuffer)
+{
+	long fileSize = file->getSize();
+
+	if (file->isAllInMemory())
+	{
+		long bufferSize = 0;
+		const char *buffer = (const char *)file->getBuffer(&bufferSize);
+
+		if (buffer && bufferSize >= fileSize)
+			return buffer;
+	}
+
+	ownedBuffer.reset(new char[fileSize]);
+
+	file->seek(0);
+	file->read(ownedBuffer.get(), fileSize);
+
+	return ownedBuffer.get();
+}
 
 //! Parses .bdae model file: textures, materials, meshes, mesh skin (if exist), and node tree.
-int Model::init(IReadResFile *file)
+int ModelData::init(IReadResFile *file)
 {
 	LOG("\033[1m\033[38;2;200;200;200m[Init] Starting Model::init..\033[0m\n");
 
-	// 1. read Header data as a structure
+	// 1. get raw binary content of the file (header, offset, string, data, and removable sections) and interpret its beginning as a header structure
 	fileSize = file->getSize();
 	int headerSize = sizeof(struct BDAEFileHeader);
-	struct BDAEFileHeader *header = new BDAEFileHeader;
 
 	LOG("\033[37m[Init] Header size (size of struct): \033[0m", headerSize);
 	LOG("\033[37m[Init] File size (length of file): \033[0m", fileSize);
 	LOG("\033[37m[Init] File name: \033[0m", file->getFileName());
-	LOG("\n\033[37m[Init] At position ", file->getPos(), ", reading header..\033[0m");
+	LOG("\n\033[37m[Init] File is ", (file->isAllInMemory() ? "in memory, parsing it in place.." : "on disk, reading it into memory.."), "\033[0m");
+
+	if (fileSize < headerSize)
+	{
+		LOG("[Error] Model::init file is smaller than the header.");
+		return -1;
+	}
+
+	std::unique_ptr<char[]> ownedBuffer; // only used if the file is not in memory yet
+	DataBuffer = getFileContent(file, ownedBuffer);
 
-	file->read(header, headerSize);
+	const BDAEFileHeader *header = (const BDAEFileHeader *)DataBuffer;
 
 	LOG("_________________");
 	LOG("\nFile Header Data\n");
@@ -42,17 +76,7 @@ int Model::init(IReadResFile *file)
 	LOG("Size of Dynamic Chunk: ", header->sizeOfDynamic);
 	LOG("________________________\n");
 
-	// 2. allocate memory and write header, offset, string, data, and removable sections to buffer storage as a raw binary data
-	unsigned int sizeUnRemovable = fileSize - header->sizeOfDynamic;
-
-	DataBuffer = (char *)malloc(sizeUnRemovable); // main buffer
-
-	memcpy(DataBuffer, header, headerSize); // copy header
-
-	LOG("\n\033[37m[Init] At position ", file->getPos(), ", reading offset, string, model info and model data sections..\033[0m");
-	file->read(DataBuffer + headerSize, sizeUnRemovable - headerSize); // insert after header
-
-	// 3. parse general model info: counts and metadata offsets for textures, materials, meshes, etc.
+	// 2. parse general model info: counts and metadata offsets for textures, materials, meshes, etc.
 
 	LOG("\033[37m[Init] Parsing general model info: counts and metadata offsets for textures, materials, meshes, etc.\033[0m");
 
@@ -63,9 +87,9 @@ int Model::init(IReadResFile *file)
 	int nodeTreeCount, nodeTreeMetadataOffset;
 
 #ifdef BETA_GAME_VERSION
-	char *ptr = DataBuffer + header->offsetData + 76; // points to texture info in the Data section
+	const char *ptr = DataBuffer + header->offsetData + 76; // points to texture info in the Data section
 #else
-	char *ptr = DataBuffer + header->offsetData + 96;
+	const char *ptr = DataBuffer + header->offsetData + 96;
 #endif
 
 	memcpy(&textureCount, ptr, sizeof(int));
@@ -79,7 +103,7 @@ int Model::init(IReadResFile *file)
 	memcpy(&nodeTreeCount, ptr + 72, sizeof(int));
 	memcpy(&nodeTreeMetadataOffset, ptr + 76, sizeof(int));
 
-	// 4. parse TEXTURES AND MATERIALS (materials allow to match submesh with texture)
+	// 3. parse TEXTURES AND MATERIALS (materials allow to match submesh with texture)
 	// ____________________
 
 	LOG("\033[37m[Init] Parsing model metadata and data.\033[0m");
@@ -162,7 +186,7 @@ int Model::init(IReadResFile *file)
 		}
 	}
 
-	// 5. parse MESHES and match submeshes with textures
+	// 4. parse MESHES and match submeshes with textures
 	// ____________________
 
 	LOG("\nMESHES: ", meshCount);
@@ -249,7 +273,7 @@ int Model::init(IReadResFile *file)
 		totalSubmeshCount += submeshCount[i];
 	}
 
-	// 6. parse NODES (nodes allow to position meshes within a model) and match nodes with meshes
+	// 5. parse NODES (nodes allow to position meshes within a model) and match nodes with meshes
 	// ____________________
 
 	if (nodeTreeCount != 1)
@@ -302,6 +326,22 @@ int Model::init(IReadResFile *file)
 		}
 	}
 
+	// resolve the node of each submesh once (draws and bounds index this array instead of going through both hash tables)
+	submeshNodeIdx.assign(totalSubmeshCount, -1);
+
+	for (int i = 0; i < totalSubmeshCount; i++)
+	{
+		auto mesh = submeshToMeshIdx.find(i);
+
+		if (mesh == submeshToMeshIdx.end())
+			continue;
+
+		auto node = meshToNodeIdx.find(mesh->second);
+
+		if (node != meshToNodeIdx.end())
+			submeshNodeIdx[i] = node->second;
+	}
+
 	// compute PIVOT offset (origin around which a mesh transforms) only for nodes that have meshes attached
 	// node tree may have '_PIVOT' helper nodes, which are always terminal nodes and don't have meshes attached. they influence all their parent nodes that are linked to meshes.
 	// at the time we recursively parse the node tree top-down, PIVOT nodes are not yet found since they are leaves of the tree, that's why we calculate their effect here only after parsing; alternatively, we could parse the tree bottom-up
@@ -333,8 +373,8 @@ int Model::init(IReadResFile *file)
 		}
 	}
 
-	// 7. parse VERTICES and INDICES
-	// all vertex data is stored in a single flat vector, while index data is stored in separate vectors for each submesh
+	// 6. parse VERTICES and INDICES
+	// all vertex data is stored in a single flat vector, while index data is stored in separate vectors for each submesh; indices stay local to their mesh (as in the file) and each submesh keeps the position of its mesh's first vertex, so models with more than 65535 vertices in total are drawn correctly
 	// ____________________
 
 	LOG("\n\033[37m[Init] Parsing vertex and index data.\033[0m");
@@ -344,9 +384,9 @@ int Model::init(IReadResFile *file)
 
 	for (int i = 0; i < meshCount; i++)
 	{
-		int vertexBase = vertices.size(); // [FIX] to convert vertex indices from local to global range
+		int vertexBase = vertices.size(); // base vertex of all submeshes of the mesh
 
-		char *meshVertexDataPtr = DataBuffer + meshVertexDataOffset[i] + 4;
+		const char *meshVertexDataPtr = DataBuffer + meshVertexDataOffset[i] + 4;
 
 		for (int j = 0; j < meshVertexCount[i]; j++)
 		{
@@ -363,26 +403,27 @@ int Model::init(IReadResFile *file)
 
 		for (int k = 0; k < submeshCount[i]; k++)
 		{
-			char *submeshIndexDataPtr = DataBuffer + submeshIndexDataOffset[i][k] + 4;
+			const char *submeshIndexDataPtr = DataBuffer + submeshIndexDataOffset[i][k] + 4;
 
 			for (int l = 0; l < submeshTriangleCount[i][k]; l++)
 			{
 				unsigned short triangle[3];
 				memcpy(triangle, submeshIndexDataPtr + l * sizeof(triangle), sizeof(triangle));
 
-				indices[currentSubmeshIndex].push_back(triangle[0] + vertexBase);
-				indices[currentSubmeshIndex].push_back(triangle[1] + vertexBase);
-				indices[currentSubmeshIndex].push_back(triangle[2] + vertexBase);
+				indices[currentSubmeshIndex].push_back(triangle[0]);
+				indices[currentSubmeshIndex].push_back(triangle[1]);
+				indices[currentSubmeshIndex].push_back(triangle[2]);
 				faceCount++;
 			}
 
+			submeshBaseVertex.push_back(vertexBase);
 			currentSubmeshIndex++;
 		}
 	}
 
 	vertexCount = vertices.size();
 
-	// 8. parse BONES and match bones with nodes
+	// 7. parse BONES and match bones with nodes
 	// bone is a "job" given to a node in animated models, allowing it to influence specific vertices rather than the entire mesh; bones form the model’s skeleton, while the influenced (or “skinned”) vertices act as the model’s skin
 	// ____________________
 
@@ -446,7 +487,6 @@ int Model::init(IReadResFile *file)
 		{
 			boneNames.resize(boneCount);
 			bindPoseMatrices.resize(boneCount);
-			boneTotalTransforms.resize(boneCount);
 
 			for (int i = 0; i < boneCount; i++)
 			{
@@ -515,12 +555,12 @@ int Model::init(IReadResFile *file)
 
 	LOG("\n\033[1m\033[38;2;200;200;200m[Init] Finishing Model::init..\033[0m\n");
 
-	delete header;
+	DataBuffer = NULL; // the content is released (or stays owned by the file object) once parsing is done
 	return 0;
 }
 
 //! Recursively parses a node and its children.
-void Model::parseNodesRecursive(int nodeOffset, int parentIndex)
+void ModelData::parseNodesRecursive(int nodeOffset, int parentIndex)
 {
 	// read node data
 	BDAEint name1Offset, name2Offset, name3Offset;
@@ -612,7 +652,7 @@ void Model::parseNodesRecursive(int nodeOffset, int parentIndex)
 }
 
 //! Recursively computes total transformation matrix for a node and its children.
-void Model::updateNodesTransformationsRecursive(int nodeIndex, const glm::mat4 &parentTransform)
+void ModelData::updateNodesTransformationsRecursive(int nodeIndex, const glm::mat4 &parentTransform)
 {
 	Node &currNode = nodes[nodeIndex];
 
@@ -633,7 +673,7 @@ void Model::updateNodesTransformationsRecursive(int nodeIndex, const glm::mat4 &
 }
 
 //! Recursively searches down the tree starting from a given node for the first node with '_PIVOT' in its ID and returns its local transformation matrix.
-glm::mat4 Model::getPIVOTNodeTransformationRecursive(int nodeIndex)
+glm::mat4 ModelData::getPIVOTNodeTransformationRecursive(int nodeIndex)
 {
 	Node &currNode = nodes[nodeIndex];
 
@@ -662,7 +702,7 @@ glm::mat4 Model::getPIVOTNodeTransformationRecursive(int nodeIndex)
 }
 
 //! [debug] Recursively prints the node tree.
-void Model::printNodesRecursive(int nodeIndex, const std::string &prefix, bool isLastChild)
+void ModelData::printNodesRecursive(int nodeIndex, const std::string &prefix, bool isLastChild)
 {
 	std::ostringstream ss;
 	ss << prefix;
@@ -697,11 +737,9 @@ void Model::printNodesRecursive(int nodeIndex, const std::string &prefix, bool i
 		printNodesRecursive(children[i], prefix + (isLastChild ? "    " : "│   "), (i + 1 == children.size()));
 }
 
-//! Loads .bdae model file from disk, calls init function and searches for animations, sounds, and alternative colors.
-void Model::load(const char *fpath, Sound &sound, bool isTerrainViewer)
+//! Loads .bdae model file from disk, calls init function and searches for animations and alternative colors.
+int ModelData::load(const char *fpath, bool isTerrainViewer)
 {
-	reset();
-
 	// 1. load .bdae file
 	CPackPatchReader *bdaeArchive;
 
@@ -711,14 +749,14 @@ void Model::load(const char *fpath, Sound &sound, bool isTerrainViewer)
 		bdaeArchive = new CPackPatchReader(fpath, true, false);
 
 	if (!bdaeArchive)
-		return;
+		return -1;
 
 	IReadResFile *bdaeFile = bdaeArchive->openFile("little_endian_not_quantized.bdae"); // open inner .bdae file
 
 	if (!bdaeFile)
 	{
 		delete bdaeArchive;
-		return;
+		return -1;
 	}
 
 	LOG("\033[1m\033[97mLoading ", fpath, "\033[0m");
@@ -733,54 +771,17 @@ void Model::load(const char *fpath, Sound &sound, bool isTerrainViewer)
 
 	if (result != 0)
 	{
-		if (DataBuffer != NULL)
-		{
-			free(DataBuffer);
-			DataBuffer = NULL;
-		}
+		DataBuffer = NULL;
 
 		delete bdaeFile;
 		delete bdaeArchive;
-		return;
+		return result;
 	}
 
 	LOG("\n\033[37m[Load] BDAE initialization success.\033[0m");
 
 	if (!isTerrainViewer) // 3D model viewer
 	{
-		// compute the model's center in world space for its correct rotation (instead of always rotating around the origin (0, 0, 0))
-		modelCenter = glm::vec3(0.0f);
-
-		if (hasSkinningData) // use skinned vertex positions (linear blend skinning that is normally computed on GPU)
-		{
-			for (int i = 0, n = (int)vertices.size(); i < n; i++)
-			{
-				glm::vec4 skinnedPosCoords = glm::vec4(0.0f);
-
-				for (int j = 0; j < 4; j++)
-				{
-					int boneIndex = vertices[i].BoneIndices[j];
-					float boneWeight = vertices[i].BoneWeights[j];
-
-					if (boneWeight > 0.0f)
-					{
-						int nodeIndex = boneToNodeIdx[boneIndex];
-						glm::mat4 boneTotalTransform = bindShapeMatrix * nodes[nodeIndex].totalTransform * bindPoseMatrices[boneIndex];
-						skinnedPosCoords += boneTotalTransform * boneWeight * glm::vec4(vertices[i].PosCoords, 1.0f);
-					}
-				}
-
-				modelCenter += glm::vec3(skinnedPosCoords);
-			}
-		}
-		else
-		{
-			for (int i = 0, n = (int)vertices.size(); i < n; i++)
-				modelCenter += vertices[i].PosCoords;
-		}
-
-		modelCenter /= vertices.size();
-
 		// 3. process strings retrieved from .bdae
 		const char *subDirStart = std::strstr(modelPath.c_str(), "/model/"); // subpath starts after '/model/' (texture and model files have the same subpath, e.g. 'creature/pet/')
 		const char *subDirEnd = std::strrchr(modelPath.c_str(), '/');		 // last '/' before the file name
@@ -842,7 +843,7 @@ void Model::load(const char *fpath, Sound &sound, bool isTerrainViewer)
 			textureCount++;
 		}
 
-		LOG("\033[37m[Load] Searching for animations, sounds, and alternative colors.\033[0m");
+		LOG("\033[37m[Load] Searching for animations and alternative colors.\033[0m");
 
 		// 4. search for ALTERNATIVE COLOR texture files
 		// ____________________
@@ -1049,17 +1050,7 @@ void Model::load(const char *fpath, Sound &sound, bool isTerrainViewer)
 		LOG("\nANIMATIONS: ", animationCount);
 
 		for (int i = 0; i < animations.size(); i++)
-			LOG("[", i + 1, "] \033[96m", animationFileNames[i], "\033[0m  ", std::fixed, std::setprecision(2), animations[i].first, " sec duration");
-
-		// 6. search for SOUNDS
-		// ____________________
-
-		sound.searchSoundFiles(fileName, sounds);
-
-		LOG("\nSOUNDS: ", ((sounds.size() != 0) ? sounds.size() : 0));
-
-		for (int i = 0; i < (int)sounds.size(); i++)
-			LOG("[", i + 1, "]  ", sounds[i]);
+			LOG("[", i + 1, "] \033[96m", animationFileNames[i], "\033[0m  ", std::fixed, std::setprecision(2), animations[i].duration, " sec duration");
 	}
 	else // terrain viewer
 	{
@@ -1083,158 +1074,211 @@ void Model::load(const char *fpath, Sound &sound, bool isTerrainViewer)
 		}
 	}
 
-	free(DataBuffer);
-	DataBuffer = NULL;
+	// 6. BAKE static terrain models (their node tree never moves, as terrain viewer loads no animations)
+	// ____________________
+
+	if (isTerrainViewer)
+		bakeStatic();
+
+	// 7. compute BOUNDING BOX (used for culling of terrain entities)
+	// ____________________
+
+	computeBounds();
 
 	delete bdaeFile;
 	delete bdaeArchive;
 
-	// 7. setup buffers
-	if (!isTerrainViewer)
+	return 0;
+}
+
+//! Applies node transforms to the vertices of a static model (no skin, no animations) and merges submeshes that share a texture into one index range, so the model draws with 1 call per texture and no per-submesh matrices.
+void ModelData::bakeStatic()
+{
+	if (hasSkinningData || animationsLoaded || staticBaked || totalSubmeshCount == 0)
+		return;
+
+	// 1. move vertices by the node transform of the submesh that uses them (indices are made global here, and local to the merged ranges below)
+	// a vertex shared by submeshes attached to different nodes is duplicated
+	std::vector<Vertex> bakedVertices = vertices;
+	std::vector<std::vector<unsigned int>> bakedIndices = indices;
+	std::vector<int> vertexNode(vertices.size(), -2);  // node each vertex is baked with (-2 → not used by any submesh yet)
+	std::unordered_map<long long, int> vertexCopies; // (vertex index, node) → index of the vertex copy baked with this node
+
+	for (int i = 0; i < totalSubmeshCount && i < (int)indices.size(); i++)
 	{
-		LOG("\n\033[37m[Load] Uploading vertex data to GPU.\033[0m");
-		EBOs.resize(totalSubmeshCount);
-		glGenVertexArrays(1, &VAO);					  // generate a Vertex Array Object to store vertex attribute configurations
-		glGenBuffers(1, &VBO);						  // generate a Vertex Buffer Object to store vertex data
-		glGenBuffers(totalSubmeshCount, EBOs.data()); // generate an Element Buffer Object for each submesh to store index data
-
-		glBindVertexArray(VAO); // bind the VAO first so that subsequent VBO bindings and vertex attribute configurations are stored in it correctly
-
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);																  // bind the VBO
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW); // copy vertex data into the GPU buffer's memory
-
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0); // define the layout of the vertex data (vertex attribute configuration): index 0, 3 components per vertex, type float, not normalized, with a stride of 52 bytes (sizeof(Vertex) = 12 floats + 4 chars = 52 bytes), and an offset of 0 in the buffer
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(6 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(Vertex), (void *)(8 * sizeof(float)));
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(8 * sizeof(float) + 4 * sizeof(char)));
-		glEnableVertexAttribArray(4);
-
-		for (int i = 0; i < totalSubmeshCount; i++)
+		int nodeIndex = submeshNodeIdx[i];
+		glm::mat4 transform = (nodeIndex >= 0) ? nodes[nodeIndex].totalTransform : glm::mat4(1.0f);
+		glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+		for (unsigned int &index : bakedIndices[i])
 		{
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOs[i]);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices[i].size() * sizeof(unsigned short), indices[i].data(), GL_STATIC_DRAW);
+			index += submeshBaseVertex[i];
+
+			if (index >= vertices.size())
+				continue;
+
+			int target = index;
+
+			if (vertexNode[index] == nodeIndex)
+				continue;
+
+			if (vertexNode[index] != -2)
+			{
+				long long key = ((long long)index << 32) | (unsigned int)nodeIndex;
+				auto copy = vertexCopies.find(key);
+
+				if (copy != vertexCopies.end())
+				{
+					index = copy->second;
+					continue;
+				}
+
+				target = bakedVertices.size();
+				bakedVertices.push_back(vertices[index]);
+				vertexCopies[key] = target;
+			}
+			else
+				vertexNode[index] = nodeIndex;
+
+			Vertex &vertex = bakedVertices[target];
+			vertex.PosCoords = glm::vec3(transform * glm::vec4(vertices[index].PosCoords, 1.0f));
+			vertex.Normal = glm::normalize(normalTransform * vertices[index].Normal);
+			index = target;
 		}
 	}
 
-	// 8. load texture(s)
-	LOG("\033[37m[Load] Uploading textures to GPU.\033[0m");
-
-	textures.resize(textureNames.size());
-	glGenTextures(textureNames.size(), textures.data()); // generate and store texture ID(s)
+	// 2. merge submeshes drawn with the same texture (see Model::drawInstances) into one index range, based at its lowest vertex
+	std::vector<std::vector<unsigned int>> mergedIndices;
+	std::vector<int> mergedTextureIndex;
+	std::vector<int> mergedBaseVertex;
 
-	for (int i = 0; i < (int)textureNames.size(); i++)
+	for (int i = 0; i < totalSubmeshCount && i < (int)bakedIndices.size(); i++)
 	{
-		glBindTexture(GL_TEXTURE_2D, textures[i]); // bind the texture ID so that all upcoming texture operations affect this texture
+		if (bakedIndices[i].empty())
+			continue;
 
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // for u (x) axis
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); // for v (y) axis
+		// models with 1 texture draw every submesh with it; submeshes without a texture are never drawn
+		if (textureCount > 1 && submeshTextureIndex[i] == -1)
+			continue;
 
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		int group = 0;
 
-		int width, height, nrChannels, format;
-		unsigned char *data = stbi_load(textureNames[i].c_str(), &width, &height, &nrChannels, 0); // load the image and its parameters
+		while (group < (int)mergedIndices.size() && !(textureCount <= 1 || mergedTextureIndex[group] == submeshTextureIndex[i]))
+			group++;
 
-		if (!data)
+		if (group == (int)mergedIndices.size())
 		{
-			std::cerr << "Failed to load texture: " << textureNames[i] << "\n";
-			continue;
+			mergedIndices.emplace_back();
+			mergedTextureIndex.push_back(submeshTextureIndex[i]);
+			mergedBaseVertex.push_back(INT_MAX);
 		}
 
-		format = (nrChannels == 4) ? GL_RGBA : GL_RGB;											  // image format
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data); // create and store texture image inside the texture object (upload to GPU)
-		glGenerateMipmap(GL_TEXTURE_2D);
-		stbi_image_free(data);
+		mergedIndices[group].insert(mergedIndices[group].end(), bakedIndices[i].begin(), bakedIndices[i].end());
+		mergedBaseVertex[group] = std::min(mergedBaseVertex[group], (int)*std::min_element(bakedIndices[i].begin(), bakedIndices[i].end()));
+	}
+
+	for (int group = 0; group < (int)mergedIndices.size(); group++)
+	{
+		for (unsigned int &index : mergedIndices[group])
+			index -= mergedBaseVertex[group];
 	}
 
-	// 9. generate a unit icosahedron for node visualization (easier than sphere)
+	LOG("\033[37m[Load] Static model baked: ", totalSubmeshCount, " submeshes merged into ", mergedIndices.size(), ".\033[0m");
+
+	vertices = std::move(bakedVertices);
+	indices = std::move(mergedIndices);
+	submeshTextureIndex = std::move(mergedTextureIndex);
+	submeshBaseVertex = std::move(mergedBaseVertex);
+	vertexCount = vertices.size();
+	totalSubmeshCount = indices.size();
 
-	// icosahedron – 3D geometry with 20 triangular faces, 12 vertices, and 30 edges.
-	// Its vertices can be generated by all even permutations of the coordinates (±1, ±φ, 0), where φ = (1 + √5) / 2 is the golden ratio.
+	submeshNodeIdx.assign(totalSubmeshCount, -1);
+	submeshToMeshIdx.clear(); // merged submeshes do not belong to a single mesh
+	staticBaked = true;
+}
 
-	if (!isTerrainViewer)
+//! Computes model's bounding box from its vertices in the rest pose (see boundsMin / boundsMax).
+void ModelData::computeBounds()
+{
+	// skinned model is split into parts by bone, static model by submesh; each part moves rigidly with its bone or node, so the box of a pose is the union of moved part boxes (see growBounds)
+	int partCount = hasSkinningData ? (int)bindPoseMatrices.size() : totalSubmeshCount;
+
+	partBoundsMin.assign(partCount, glm::vec3(FLT_MAX));
+	partBoundsMax.assign(partCount, glm::vec3(-FLT_MAX));
+
+	if (hasSkinningData)
 	{
-		const float t = (1.0f + std::sqrt(5.0f)) / 2.0f; // golden ratio
-
-		// 12 vertices of icosahedron (normalize so that all points lie on the unit sphere
-		std::vector<glm::vec3> positions = {
-			glm::normalize(glm::vec3(-1, t, 0)),
-			glm::normalize(glm::vec3(1, t, 0)),
-			glm::normalize(glm::vec3(-1, -t, 0)),
-			glm::normalize(glm::vec3(1, -t, 0)),
-			glm::normalize(glm::vec3(0, -1, t)),
-			glm::normalize(glm::vec3(0, 1, t)),
-			glm::normalize(glm::vec3(0, -1, -t)),
-			glm::normalize(glm::vec3(0, 1, -t)),
-			glm::normalize(glm::vec3(t, 0, -1)),
-			glm::normalize(glm::vec3(t, 0, 1)),
-			glm::normalize(glm::vec3(-t, 0, -1)),
-			glm::normalize(glm::vec3(-t, 0, 1))};
-
-		std::vector<float> vertices;
-
-		for (int i = 0; i < positions.size(); i++)
+		// a skinned vertex is a weighted average of its positions moved by each influencing bone, so it always lies inside the union of these bones' moved boxes
+		for (const Vertex &vertex : vertices)
 		{
-			vertices.push_back(positions[i].x);
-			vertices.push_back(positions[i].y);
-			vertices.push_back(positions[i].z);
+			for (int j = 0; j < 4; j++)
+			{
+				int boneIndex = (unsigned char)vertex.BoneIndices[j];
+
+				if (vertex.BoneWeights[j] > 0.0f && boneIndex < partCount)
+				{
+					partBoundsMin[boneIndex] = glm::min(partBoundsMin[boneIndex], vertex.PosCoords);
+					partBoundsMax[boneIndex] = glm::max(partBoundsMax[boneIndex], vertex.PosCoords);
+				}
+			}
 		}
+	}
+	else
+	{
+		for (int i = 0; i < partCount && i < (int)indices.size(); i++)
+		{
+			for (unsigned int index : indices[i])
+			{
+				index += submeshBaseVertex[i];
+
+				if (index >= vertices.size())
+					continue;
 
-		// 20 faces (triangles) of icosahedron
-		std::vector<unsigned int> indices = {
-			0, 11, 5,
-			0, 5, 1,
-			0, 1, 7,
-			0, 7, 10,
-			0, 10, 11,
-
-			1, 5, 9,
-			5, 11, 4,
-			11, 10, 2,
-			10, 7, 6,
-			7, 1, 8,
-
-			3, 9, 4,
-			3, 4, 2,
-			3, 2, 6,
-			3, 6, 8,
-			3, 8, 9,
-
-			4, 9, 5,
-			2, 4, 11,
-			6, 2, 10,
-			8, 6, 7,
-			9, 8, 1};
-
-		glGenVertexArrays(1, &nodeVAO);
-		glGenBuffers(1, &nodeVBO);
-		glGenBuffers(1, &nodeEBO);
-
-		glBindVertexArray(nodeVAO);
-
-		glBindBuffer(GL_ARRAY_BUFFER, nodeVBO);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-		glEnableVertexAttribArray(0);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, nodeEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+				partBoundsMin[i] = glm::min(partBoundsMin[i], vertices[index].PosCoords);
+				partBoundsMax[i] = glm::max(partBoundsMax[i], vertices[index].PosCoords);
+			}
+		}
 	}
 
-	modelLoaded = true;
-	LOG("\033[1m\033[38;2;200;200;200m[Load] BDAE model loaded.\033[0m\n");
+	boundsMin = glm::vec3(FLT_MAX);
+	boundsMax = glm::vec3(-FLT_MAX);
+
+	growBounds();
+}
+
+//! Grows model's bounding box to hold the pose currently stored in the node tree.
+void ModelData::growBounds()
+{
+	for (int i = 0, n = (int)partBoundsMin.size(); i < n; i++)
+	{
+		if (partBoundsMin[i].x > partBoundsMax[i].x) // part has no vertices
+			continue;
+
+		glm::mat4 transform(1.0f);
+
+		// same matrices the part is drawn with (see Model::drawInstances)
+		if (hasSkinningData)
+		{
+			auto bone = boneToNodeIdx.find(i);
+
+			if (bone == boneToNodeIdx.end() || bone->second < 0) // bone without node
+				continue;
+
+			transform = bindShapeMatrix * nodes[bone->second].totalTransform * bindPoseMatrices[i];
+		}
+		else if (i < (int)submeshNodeIdx.size() && submeshNodeIdx[i] >= 0)
+			transform = nodes[submeshNodeIdx[i]].totalTransform;
+
+		glm::vec3 center, extent;
+		transformBounds(transform, partBoundsMin[i], partBoundsMax[i], center, extent);
+
+		boundsMin = glm::min(boundsMin, center - extent);
+		boundsMax = glm::max(boundsMax, center + extent);
+	}
 }
 
 //! Loads .bdae animation file from disk and parses animation samplers, channels, and data (timestamps and transformations).
-void Model::loadAnimation(const char *fpath)
+void ModelData::loadAnimation(const char *fpath)
 {
 	CPackPatchReader *bdaeArchive = new CPackPatchReader(fpath, true, false);
 
@@ -1249,16 +1293,17 @@ void Model::loadAnimation(const char *fpath)
 		return;
 	}
 
-	int fileSize = bdaeFile->getSize();
-	int headerSize = sizeof(struct BDAEFileHeader);
-	struct BDAEFileHeader *header = new BDAEFileHeader;
-	bdaeFile->read(header, headerSize);
-
-	char *DataBuffer = (char *)malloc(fileSize);
+	if (bdaeFile->getSize() < (long)sizeof(struct BDAEFileHeader))
+	{
+		delete bdaeFile;
+		delete bdaeArchive;
+		return;
+	}
 
-	memcpy(DataBuffer, header, headerSize);
+	std::unique_ptr<char[]> ownedBuffer; // only used if the file is not in memory yet
+	const char *DataBuffer = getFileContent(bdaeFile, ownedBuffer);
 
-	bdaeFile->read(DataBuffer + headerSize, fileSize - headerSize);
+	const BDAEFileHeader *header = (const BDAEFileHeader *)DataBuffer;
 
 	// parse general animation info
 	// one animation entry is a base animation – rotation / scale / translation of one target node
@@ -1276,8 +1321,8 @@ void Model::loadAnimation(const char *fpath)
 
 	float duration = (endTime - startTime) / 1000.0f; // convert to seconds
 
-	std::vector<BaseAnimation> animation;
-	animation.resize(animationEntryCount);
+	// per animation entry: interpolation type, animation type (1 = translation | 5 = rotation | 10 = scale), and target node
+	std::vector<int> interpolationType(animationEntryCount), animationType(animationEntryCount), targetNode(animationEntryCount, -1);
 
 	// parse SAMPLERS and CHANNELS
 	// ____________________
@@ -1316,7 +1361,7 @@ void Model::loadAnimation(const char *fpath)
 			int timestampValueDataType, transformationValueDataType;
 			int timestampArrayID, transformationArrayID; // indices into the animation data array
 
-			memcpy(&animation[i].interpolationType, DataBuffer + header->offsetData + 60 + samplersAndChannelsMetadataOffset + 12 + i * 40 + samplerDataOffset[i] + j * 32, sizeof(int));
+			memcpy(&interpolationType[i], DataBuffer + header->offsetData + 60 + samplersAndChannelsMetadataOffset + 12 + i * 40 + samplerDataOffset[i] + j * 32, sizeof(int));
 			memcpy(&timestampValueDataType, DataBuffer + header->offsetData + 60 + samplersAndChannelsMetadataOffset + 12 + i * 40 + samplerDataOffset[i] + 4 + j * 32, sizeof(int));
 			memcpy(&timestampArrayID, DataBuffer + header->offsetData + 60 + samplersAndChannelsMetadataOffset + 12 + i * 40 + samplerDataOffset[i] + 12 + j * 32, sizeof(int));
 			memcpy(&transformationValueDataType, DataBuffer + header->offsetData + 60 + samplersAndChannelsMetadataOffset + 12 + i * 40 + samplerDataOffset[i] + 16 + j * 32, sizeof(int));
@@ -1347,8 +1392,11 @@ void Model::loadAnimation(const char *fpath)
 			memcpy(&targetNodeNameLength, DataBuffer + targetNodeNameOffset - 4, sizeof(int));
 			memcpy(&channelType, DataBuffer + header->offsetData + 60 + samplersAndChannelsMetadataOffset + 20 + i * 40 + channelDataOffset[i] + 8 + j * 24, sizeof(int));
 
-			animation[i].targetNodeName = std::string(DataBuffer + targetNodeNameOffset, targetNodeNameLength);
-			animation[i].animationType = channelType;
+			animationType[i] = channelType;
+
+			// bind the channel to its node once, so that playback does no name lookups
+			auto node = nodeNameToIdx.find(std::string(DataBuffer + targetNodeNameOffset, targetNodeNameLength)); // [TODO] use boneNameToNodeIdx instead
+			targetNode[i] = (node != nodeNameToIdx.end()) ? node->second : -1;
 		}
 	}
 
@@ -1371,56 +1419,299 @@ void Model::loadAnimation(const char *fpath)
 		memcpy(&animationDataOffset[i], DataBuffer + header->offsetData + 68 + animationMetadataOffset + 36 + 4 + i * 8, sizeof(int));
 	}
 
+	// group animation entries into tracks by type, and store keys of all tracks of a type in 2 flat arrays (sized once, before they are filled)
+	AnimationClip clip;
+	clip.duration = duration;
+
+	std::vector<int> trackType(animationEntryCount, -1);
+	std::vector<int> keyCount(animationEntryCount, 0);
+	int typeKeyCount[TRACK_TYPE_COUNT] = {0};
+
 	for (int i = 0; i < animationEntryCount; i++)
 	{
-		int timestampValueCount = animationValueCount[timestampDataIndex[i][0]]; // we don't iterate over each animation entry's sampler, assuming there is exactly 1
-
-		for (int j = 0; j < timestampValueCount; j++)
+		switch (animationType[i])
 		{
-			unsigned char frameNumber;
-			memcpy(&frameNumber, DataBuffer + header->offsetData + 68 + animationMetadataOffset + 36 + 4 + i * 8 * 2 + animationDataOffset[timestampDataIndex[i][0]] + j, sizeof(unsigned char));
-			animation[i].timestamps.push_back(frameNumber / 30.0f); // convert to seconds (.bdae animations are authored to be played at 30 FPS)
+		case 1: // translation --> X Y Z
+			trackType[i] = TRACK_TRANSLATION;
+			break;
+		case 5: // rotation --> X Y Z W
+			trackType[i] = TRACK_ROTATION;
+			break;
+		case 10: // scale --> X Y Z
+			trackType[i] = TRACK_SCALE;
+			break;
+		default:
+			LOG("[Warning] Model::loadAnimation unknown animation type: ", animationType[i]);
+			continue;
 		}
 
-		int transformationValueCount = animationValueCount[transformationDataIndex[i][0]];
+		keyCount[i] = std::min(animationValueCount[timestampDataIndex[i][0]], animationValueCount[transformationDataIndex[i][0]]); // we don't iterate over each animation entry's sampler, assuming there is exactly 1
+		typeKeyCount[trackType[i]] += keyCount[i];
+	}
 
-		for (int j = 0; j < transformationValueCount; j++)
-		{
-			std::vector<float> frameTransformation;
+	for (int type = 0; type < TRACK_TYPE_COUNT; type++)
+	{
+		clip.tracks[type].times.reserve(typeKeyCount[type]);
+		clip.tracks[type].values.reserve(typeKeyCount[type]);
+	}
 
-			switch (animation[i].animationType)
-			{
-			case 1: // translation --> X Y Z
-				frameTransformation.resize(3);
-				break;
-			case 5: // rotation --> X Y Z W
-				frameTransformation.resize(4);
-				break;
-			case 10: // scale --> X Y Z
-				frameTransformation.resize(3);
-				break;
-			default:
-				LOG("[Warning] Model::loadAnimation unknown animation type: ", animation[i].animationType);
-				break;
-			}
+	for (int i = 0; i < animationEntryCount; i++)
+	{
+		if (trackType[i] < 0)
+			continue;
+
+		AnimationTracks &tracks = clip.tracks[trackType[i]];
+		int componentCount = (trackType[i] == TRACK_ROTATION) ? 4 : 3;
 
-			int componentCount = frameTransformation.size();
+		tracks.targetNodes.push_back(targetNode[i]);
+		tracks.interpolation.push_back(interpolationType[i]);
+		tracks.firstKey.push_back(tracks.times.size());
+		tracks.keyCount.push_back(keyCount[i]);
+		tracks.cursors.push_back(0);
 
-			for (int k = 0; k < componentCount; k++)
-				memcpy(&frameTransformation[k], DataBuffer + header->offsetData + 68 + animationMetadataOffset + 36 + 12 + i * 8 * 2 + animationDataOffset[transformationDataIndex[i][0]] + j * componentCount * 4 + k * 4, sizeof(float));
+		const unsigned char *frameNumbers = (const unsigned char *)(DataBuffer + header->offsetData + 68 + animationMetadataOffset + 36 + 4 + i * 8 * 2 + animationDataOffset[timestampDataIndex[i][0]]);
+		const char *transformationData = DataBuffer + header->offsetData + 68 + animationMetadataOffset + 36 + 12 + i * 8 * 2 + animationDataOffset[transformationDataIndex[i][0]];
 
-			animation[i].transformations.push_back(frameTransformation);
+		for (int j = 0; j < keyCount[i]; j++)
+		{
+			float value[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+			memcpy(value, transformationData + j * componentCount * 4, componentCount * sizeof(float));
+
+			if (trackType[i] == TRACK_ROTATION)
+				value[3] = -value[3]; // node tree expects W with the opposite sign
+
+			tracks.times.push_back(frameNumbers[j] / 30.0f); // convert to seconds (.bdae animations are authored to be played at 30 FPS)
+			tracks.values.push_back(glm::vec4(value[0], value[1], value[2], value[3]));
 		}
 	}
 
-	animations.push_back({duration, animation});
+#ifdef COMPRESS_ANIMATIONS
+	compressAnimation(clip);
+#endif
 
-	free(DataBuffer);
+	animations.push_back(std::move(clip));
 
-	delete header;
 	delete bdaeFile;
 	delete bdaeArchive;
 
 	animationCount++;
 	animationsLoaded = true;
 }
+
+//! Blends two key values the way animation playback does (see Model::evaluateTracks).
+static glm::vec4 blendKeys(int type, int interpolationType, const glm::vec4 &a, glm::vec4 b, float t)
+{
+	switch (interpolationType)
+	{
+	case 1: // LINEAR
+		break;
+	case 2: // HERMITE
+		if (type != TRACK_ROTATION)
+			t = t * t * (3.0f - 2.0f * t);
+		break;
+	default: // STEP
+		return a;
+	}
+
+	if (type != TRACK_ROTATION)
+		return a + (b - a) * t;
+
+	if (glm::dot(a, b) < 0.0f)
+		b = -b;
+
+	return glm::normalize(a + (b - a) * t);
+}
+
+//! Returns the largest difference between components of two key values (q and -q are the same rotation).
+static float keyError(int type, const glm::vec4 &a, const glm::vec4 &b)
+{
+	glm::vec4 difference = glm::abs(a - b);
+	float error = std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w));
+
+	if (type == TRACK_ROTATION)
+	{
+		difference = glm::abs(a + b);
+		error = std::min(error, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+	}
+
+	return error;
+}
+
+//! Compresses a loaded animation clip: removes keys reproduced by interpolation within animationKeyTolerance and quantizes key values (see AnimationTracks::getKey).
+void ModelData::compressAnimation(AnimationClip &clip)
+{
+	size_t rawSize = 0, compressedSize = 0;
+
+	for (int type = 0; type < TRACK_TYPE_COUNT; type++)
+	{
+		AnimationTracks &tracks = clip.tracks[type];
+		float tolerance = animationKeyTolerance[type];
+		int trackCount = tracks.targetNodes.size();
+
+		if (tracks.compressed || trackCount == 0)
+			continue;
+
+		rawSize += tracks.times.size() * (sizeof(float) + sizeof(glm::vec4));
+
+		std::vector<float> times;
+		std::vector<uint16_t> packedValues;
+		tracks.rangeMin.assign(trackCount, glm::vec3(0.0f));
+		tracks.rangeStep.assign(trackCount, glm::vec3(0.0f));
+
+		for (int track = 0; track < trackCount; track++)
+		{
+			int first = tracks.firstKey[track], keyCount = tracks.keyCount[track];
+			const float *keyTimes = &tracks.times[first];
+			const glm::vec4 *keyValues = &tracks.values[first];
+
+			// 1. remove keys: a key is dropped if blending the last kept key with the key after it reproduces playback of the original keys in between within tolerance
+			// (compared at the keys and inside each original segment, as hermite blends differ between keys too); a constant track keeps 1 key
+			std::vector<int> kept;
+
+			if (keyCount > 0)
+				kept.push_back(0);
+
+			bool constant = true;
+
+			for (int i = 1; i < keyCount && constant; i++)
+				constant = keyError(type, keyValues[i], keyValues[0]) <= tolerance;
+
+			if (!constant)
+			{
+				for (int i = 1; i < keyCount - 1; i++)
+				{
+					int previous = kept.back();
+					bool reproduced = true;
+
+					float span = keyTimes[i + 1] - keyTimes[previous];
+
+					for (int j = previous + 1; j <= i + 1 && reproduced; j++)
+					{
+						for (int sample = 0; sample < animationKeySamples && reproduced; sample++)
+						{
+							// original playback at a fraction of segment [j - 1, j] (the last sample of a segment is key j itself)
+							float fraction = (sample + 1.0f) / animationKeySamples;
+							float time = keyTimes[j - 1] + (keyTimes[j] - keyTimes[j - 1]) * fraction;
+							glm::vec4 original = blendKeys(type, tracks.interpolation[track], keyValues[j - 1], keyValues[j], fraction);
+
+							float t = (span > 0.0f) ? (time - keyTimes[previous]) / span : 0.0f;
+							reproduced = keyError(type, blendKeys(type, tracks.interpolation[track], keyValues[previous], keyValues[i + 1], t), original) <= tolerance;
+						}
+					}
+
+					if (!reproduced)
+						kept.push_back(i);
+				}
+
+				kept.push_back(keyCount - 1);
+			}
+
+			// 2. quantize kept values
+			if (type != TRACK_ROTATION && !kept.empty())
+			{
+				glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+
+				for (int i : kept)
+				{
+					low = glm::min(low, glm::vec3(keyValues[i]));
+					high = glm::max(high, glm::vec3(keyValues[i]));
+				}
+
+				tracks.rangeMin[track] = low;
+				tracks.rangeStep[track] = (high - low) / 65535.0f;
+			}
+
+			tracks.firstKey[track] = times.size();
+			tracks.keyCount[track] = kept.size();
+			tracks.cursors[track] = 0;
+
+			for (int i : kept)
+			{
+				times.push_back(keyTimes[i]);
+				glm::vec4 value = keyValues[i];
+				uint16_t packed[3];
+
+				if (type != TRACK_ROTATION)
+				{
+					for (int k = 0; k < 3; k++)
+						packed[k] = (tracks.rangeStep[track][k] > 0.0f) ? (uint16_t)std::lround((value[k] - tracks.rangeMin[track][k]) / tracks.rangeStep[track][k]) : 0;
+				}
+				else
+				{
+					// smallest three: the largest component (made non-negative, q and -q are the same rotation) is dropped and restored from unit length, the other 3 lie in [-1 / sqrt(2), 1 / sqrt(2)]
+					const float range = 0.70710678f;
+					value = glm::normalize(value);
+					int largest = 0;
+
+					for (int k = 1; k < 4; k++)
+					{
+						if (std::abs(value[k]) > std::abs(value[largest]))
+							largest = k;
+					}
+
+					if (value[largest] < 0.0f)
+						value = -value;
+
+					for (int k = 0, j = 0; k < 4; k++)
+					{
+						if (k != largest)
+							packed[j++] = (uint16_t)std::lround((std::clamp(value[k], -range, range) + range) / (2.0f * range) * 0x7FFF);
+					}
+
+					packed[0] |= (largest >> 1) << 15;
+					packed[1] |= (largest & 1) << 15;
+				}
+
+				packedValues.insert(packedValues.end(), packed, packed + 3);
+			}
+		}
+
+		tracks.times = std::move(times);
+		tracks.packedValues = std::move(packedValues);
+		std::vector<glm::vec4>().swap(tracks.values);
+		tracks.compressed = true;
+
+		compressedSize += tracks.times.size() * (sizeof(float) + 3 * sizeof(uint16_t)) + trackCount * 2 * sizeof(glm::vec3);
+	}
+
+	LOG("\033[37m[Load] Animation compressed: ", rawSize, " → ", compressedSize, " bytes of keys.\033[0m");
+}
+
+//! Clears parsed data.
+void ModelData::clear()
+{
+	fileName.clear();
+	fileSize = 0;
+
+	vertices.clear();
+	indices.clear();
+	vertexCount = faceCount = 0;
+	totalSubmeshCount = 0;
+	submeshToMeshIdx.clear();
+	submeshNodeIdx.clear();
+	submeshBaseVertex.clear();
+	staticBaked = false;
+
+	textureCount = alternativeTextureCount = 0;
+	textureNames.clear();
+	submeshTextureIndex.clear();
+
+	nodes.clear();
+	meshToNodeIdx.clear();
+	nodeNameToIdx.clear();
+
+	boneNames.clear();
+	bindPoseMatrices.clear();
+	boneNameToNodeIdx.clear();
+	boneToNodeIdx.clear();
+	hasSkinningData = false;
+
+	boundsMin = glm::vec3(FLT_MAX);
+	boundsMax = glm::vec3(-FLT_MAX);
+	partBoundsMin.clear();
+	partBoundsMax.clear();
+
+	animations.clear();
+	animationCount = 0;
+	animationsLoaded = false;
+}
@@ -0,0 +1,277 @@
+#ifndef PARSER_BDAE_H
+#define PARSER_BDAE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+#include "IReadResFile.h"
+#include "libs/glm/glm.hpp"
+#include "libs/glm/gtc/quaternion.hpp"
+
+// if defined, viewer prints detailed model info in terminal (headless tools build the parser with NO_CONSOLE_DEBUG_LOG instead, see Makefile)
+#ifndef NO_CONSOLE_DEBUG_LOG
+#define CONSOLE_DEBUG_LOG
+#endif
+
+template <typename... Args>
+inline void LOG(Args &&...args)
+{
+#ifdef CONSOLE_DEBUG_LOG
+	(std::cout << ... << args) << std::endl;
+#endif
+}
+
+// if defined, viewer works with .bdae version from oac 1.0.3; if undefined, with oac 4.2.5
+#define BETA_GAME_VERSION
+
+// if defined, animation clips are compressed when loaded: keys that interpolation of their neighbors reproduces within tolerance are removed, rotations are stored in 48-bit smallest-three form, and translations / scales as 16-bit values within their track's range
+#define COMPRESS_ANIMATIONS
+
+#ifdef BETA_GAME_VERSION
+typedef uint32_t BDAEint;
+#else
+typedef uint64_t BDAEint;
+#endif
+
+// 60 or 80 bytes (depends on .bdae version)
+struct BDAEFileHeader
+{
+	unsigned int signature;									// 4 bytes  file signature – 'BRES' for .bdae file
+	unsigned short endianCheck;								// 2 bytes  byte order mark
+	unsigned short version;									// 2 bytes  byte order mark
+	unsigned int sizeOfHeader;								// 4 bytes  header size in bytes
+	unsigned int sizeOfFile;								// 4 bytes  file size in bytes
+	unsigned int numOffsets;								// 4 bytes  number of entries in the offset table
+	unsigned int origin;									// 4 bytes  file origin – always '0' for standalone .bdae files (?)
+	BDAEint offsetOffsetTable;								// 8 bytes  offset to Offset Data section (in bytes, from the beginning of the file)
+	BDAEint offsetStringTable;								// 8 bytes  offset to String Data section
+	BDAEint offsetData;										// 8 bytes  offset to Data section
+	BDAEint offsetRelatedFiles;								// 8 bytes  offset to related file names (?)
+	BDAEint offsetRemovable;								// 8 bytes  offset to Removable section
+	unsigned int sizeOfRemovable;							// 4 bytes  size of Removable section in bytes
+	unsigned int numRemovableChunks;						// 4 bytes  number of removable chunks
+	unsigned int useSeparatedAllocationForRemovableBuffers; // 4 bytes  1: each removable chunk is loaded into its own separately allocated buffer, 0: all chunks in one shared buffer
+	unsigned int sizeOfDynamic;								// 4 bytes  size of dynamic chunk (?)
+};
+
+struct Vertex
+{
+	glm::vec3 PosCoords;
+	glm::vec3 Normal;
+	glm::vec2 TexCoords;
+	char BoneIndices[4];  // indices into boneNames array (up to 4 bones can influence 1 vertex)
+	float BoneWeights[4]; // influence weights in [0, 1] range
+};
+
+struct Node
+{
+	std::string ID;				   // 1st node name (e.g. 'Bip001_Head-node')
+	std::string mainName;		   // 2nd node name; used for mesh mapping (e.g. 'Bip001_Head')
+	std::string boneName;		   // 3rd node name; used for bone mapping (e.g. 'Bone3')
+	int parentIndex;			   // index of parent node into nodes array (-1 = root)
+	std::vector<int> childIndices; // indices of child nodes into nodes array
+
+	glm::mat4 pivotTransform; // transformation of the child helper PIVOT node (if it exists)
+
+	// original transformation; used for animation reset
+	glm::vec3 defaultTranslation;
+	glm::quat defaultRotation;
+	glm::vec3 defaultScale;
+
+	// own current transformation; updated each frame during animation
+	glm::vec3 localTranslation;
+	glm::quat localRotation;
+	glm::vec3 localScale;
+
+	glm::mat4 totalTransform; // parent * local * pivot
+};
+
+// one base animation (track) animates one transformation of one node; tracks of a clip are grouped by the transformation they animate
+enum AnimationTrackType
+{
+	TRACK_TRANSLATION, // X Y Z
+	TRACK_ROTATION,	   // quaternion
+	TRACK_SCALE,	   // X Y Z
+	TRACK_TYPE_COUNT
+};
+
+// max error of a key removed by clip compression, per track type (model units for translations, quaternion or scale components for the others; see COMPRESS_ANIMATIONS)
+const float animationKeyTolerance[TRACK_TYPE_COUNT] = {0.0005f, 0.0005f, 0.0005f};
+const int animationKeySamples = 4; // points per original key segment where clip compression compares playback before and after removing a key
+
+// All tracks of one type of an animation clip, stored flat: per-track data in parallel arrays, keyframes of all tracks one after another in 2 contiguous arrays.
+// Each key value takes one 16-byte block (vectors are padded with 0, quaternions are stored X Y Z W), so evaluation reads it with 1 SIMD load (see Model::evaluateTracks); compressed clips store 3 x 16 bits per key instead.
+struct AnimationTracks
+{
+	std::vector<int> targetNodes;	// node animated by each track (index into nodes array, resolved when the clip is loaded; -1 → node not found)
+	std::vector<int> interpolation; // interpolation type of each track: 0 = step | 1 = linear | 2 = hermite
+	std::vector<int> firstKey;		// position of each track's first key in 'times' and 'values'
+	std::vector<int> keyCount;		// number of keys of each track
+	std::vector<int> cursors;		// first of the two keys found by the last evaluation of each track (the next lookup starts from it)
+
+	std::vector<float> times;	   // key times in seconds
+	std::vector<glm::vec4> values; // key values (empty if compressed)
+
+	// compressed tracks (see ModelData::compressAnimation)
+	bool compressed = false;
+	std::vector<uint16_t> packedValues; // 3 per key; rotation: 2 bits for the largest component + 3 smallest components in 15 bits each, translation / scale: components in the track's range
+	std::vector<glm::vec3> rangeMin;	// per track: lowest value of each component (translation / scale)
+	std::vector<glm::vec3> rangeStep;	// per track: value of 1 quantization step of each component
+
+	//! Returns a key value of a track, decoded if the tracks are compressed.
+	glm::vec4 getKey(int type, int track, int key) const
+	{
+		int index = firstKey[track] + key;
+
+		if (!compressed)
+			return values[index];
+
+		const uint16_t *packed = &packedValues[index * 3];
+
+		if (type != TRACK_ROTATION)
+			return glm::vec4(rangeMin[track] + rangeStep[track] * glm::vec3(packed[0], packed[1], packed[2]), 0.0f);
+
+		// the largest component is restored from the unit length of the quaternion (it is stored non-negative)
+		const float range = 0.70710678f; // smallest three components lie in [-1 / sqrt(2), 1 / sqrt(2)]
+		int largest = ((packed[0] >> 15) << 1) | (packed[1] >> 15);
+		float smallest[3];
+
+		for (int i = 0; i < 3; i++)
+			smallest[i] = (packed[i] & 0x7FFF) * (2.0f * range / 0x7FFF) - range;
+
+		glm::vec4 value;
+		float sum = 0.0f;
+
+		for (int i = 0, j = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+
+			value[i] = smallest[j++];
+			sum += value[i] * value[i];
+		}
+
+		value[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+		return value;
+	}
+};
+
+struct AnimationClip
+{
+	float duration;							  // in seconds
+	AnimationTracks tracks[TRACK_TYPE_COUNT]; // indexed by AnimationTrackType
+};
+
+// Plain .bdae model data, parsed without any OpenGL calls.
+//! Transforms an axis-aligned box by matrix 'm' and returns the center and half size of the axis-aligned box that encloses the result.
+inline void transformBounds(const glm::mat4 &m, const glm::vec3 &boxMin, const glm::vec3 &boxMax, glm::vec3 &center, glm::vec3 &extent)
+{
+	glm::vec3 localCenter = 0.5f * (boxMin + boxMax);
+	glm::vec3 localExtent = 0.5f * (boxMax - boxMin);
+
+	// center moves as a point; each half size axis is rotated / scaled by the matrix, and its absolute projections onto world axes add up to the new half size
+	center = glm::vec3(m * glm::vec4(localCenter, 1.0f));
+	extent = glm::abs(glm::vec3(m[0])) * localExtent.x + glm::abs(glm::vec3(m[1])) * localExtent.y + glm::abs(glm::vec3(m[2])) * localExtent.z;
+}
+
+// Parsing only touches the object it is called on, so different objects can be parsed concurrently on worker threads; GPU upload is a separate step (see Model class).
+// _________________________________________
+
+class ModelData
+{
+  public:
+	std::string fileName;
+	std::vector<std::string> textureNames;
+	std::vector<int> submeshTextureIndex;
+	int fileSize, vertexCount, faceCount, totalSubmeshCount;
+	int textureCount, alternativeTextureCount;
+
+	std::vector<Vertex> vertices;					  // vertex data
+	std::vector<std::vector<unsigned int>> indices;   // index data for each submesh (triangles), local to the submesh's base vertex
+	std::vector<int> submeshBaseVertex;				  // first vertex of each submesh's index range in 'vertices' (added to its indices when drawn, see glDrawElementsBaseVertex)
+	std::vector<int> submeshNodeIdx;				  // node whose transform positions each submesh (-1 → none, or baked into the vertices; resolved once after parsing, so draws do no hash lookups)
+	bool staticBaked;								  // whether node transforms are applied to the vertices and submeshes are merged by texture (see bakeStatic)
+
+	const char *DataBuffer; // raw binary content of .bdae file (points into the file's own memory when possible; valid only during parsing)
+
+	std::vector<Node> nodes; // node tree
+
+	// skinning data
+	bool hasSkinningData;
+	std::vector<std::string> boneNames;
+	glm::mat4 bindShapeMatrix;				 // correction matrix that transforms all model vertices from their raw positions defined in the .bdae file (mesh local space) to skeleton (or "bind pose") space (coordinate system where the skeleton was defined)
+	std::vector<glm::mat4> bindPoseMatrices; // inverse bind pose matrix for each bone; transforms vertices from their bind positions in skeleton space to the bone's local space
+
+	// animation data
+	std::vector<AnimationClip> animations; // all loaded animation files data
+	bool animationsLoaded;												  // whether at least one animation file is loaded
+	int animationCount;													  // number of animation files found
+
+	// bounding box
+	glm::vec3 boundsMin, boundsMax;						 // model space box that holds the rest pose and all poses of loaded animations (min > max → model has no geometry)
+	std::vector<glm::vec3> partBoundsMin, partBoundsMax; // box of each rigid part in its own space (skinned model: vertices influenced by each bone, as stored in the file; static model: each submesh)
+
+	// utility hash tables
+	std::unordered_map<int, int> submeshToMeshIdx;			// (index in EBOs array → ..)
+	std::unordered_map<int, int> meshToNodeIdx;				// (index in meshNames array → index in nodes array)
+	std::unordered_map<std::string, int> nodeNameToIdx;		// (node name → index in nodes array)
+	std::unordered_map<std::string, int> boneNameToNodeIdx; // (bone name → index in nodes array)
+	std::unordered_map<int, int> boneToNodeIdx;				// (index in boneNames array → index in nodes array)
+
+	ModelData()
+		: fileSize(0),
+		  vertexCount(0), faceCount(0),
+		  totalSubmeshCount(0),
+		  textureCount(0),
+		  alternativeTextureCount(0),
+		  staticBaked(false),
+		  DataBuffer(NULL),
+		  hasSkinningData(false),
+		  animationsLoaded(false),
+		  animationCount(0),
+		  boundsMin(FLT_MAX), boundsMax(-FLT_MAX) {}
+
+	//! Parses .bdae model file: textures, materials, meshes, mesh skin (if exist), and node tree.
+	int init(IReadResFile *file);
+
+	//! Loads .bdae model file from disk, calls init function and searches for animations and alternative colors.
+	int load(const char *fpath, bool isTerrainViewer);
+
+	//! Loads .bdae animation file from disk and parses animation samplers, channels, and data (timestamps and transformations).
+	void loadAnimation(const char *animationFilePath);
+
+	//! Compresses a loaded animation clip: removes keys reproduced by interpolation within animationKeyTolerance and quantizes key values (see AnimationTracks::getKey).
+	void compressAnimation(AnimationClip &clip);
+
+	//! Applies node transforms to the vertices of a static model (no skin, no animations) and merges submeshes that share a texture into one index range, so the model draws with 1 call per texture and no per-submesh matrices.
+	void bakeStatic();
+
+	//! Computes model's bounding box from its vertices in the rest pose (see boundsMin / boundsMax).
+	void computeBounds();
+
+	//! Grows model's bounding box to hold the pose currently stored in the node tree.
+	void growBounds();
+
+	//! Recursively parses a node and its children.
+	void parseNodesRecursive(int nodeOffset, int parentIndex);
+
+	//! Recursively computes total transformation matrix for a node and its children.
+	void updateNodesTransformationsRecursive(int nodeIndex, const glm::mat4 &parentTransform);
+
+	//! [debug] Recursively prints the node tree.
+	void printNodesRecursive(int nodeIndex, const std::string &prefix, bool isLastChild);
+
+	//! Recursively searches down the tree starting from a given node for the first node with '_PIVOT' in its ID and returns its local transformation matrix.
+	glm::mat4 getPIVOTNodeTransformationRecursive(int nodeIndex);
+
+	//! Clears parsed data.
+	void clear();
+};
+
+#endif
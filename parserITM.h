@@ -157,43 +157,18 @@ inline void loadEntity(CZipResReader *physicsArchive, const char *fname, const E
 		break;
 	}
 
-	/* 4. load .bdae model
-	   Models are stored in global terrain's cache for memory optimization.
-	   This is handled via smart shared pointer (for each model) that does automatic reference counting and deletion. When model is found in cache, a copy of the shared pointer is created.
+	/* 4. request .bdae model
+	   Models are parsed concurrently on the terrain's thread pool; each file is parsed only once, even if many entities use it (see ModelLoader).
+	   Placement is stored in the tile until it is handed over to the main thread, where models are created and attached (see Terrain::resolveTileModels).
 	 ____________________ */
 
-	std::shared_ptr<Model> bdaeModel;
+	// build OpenGL style model matrix: scale -> rotate -> translate
+	glm::mat4 model = glm::mat4(1.0f);
+	model = glm::translate(glm::mat4(1.0f), glm::vec3(entityInfo.relativePos.X + tileOff.X, entityInfo.relativePos.Y + tileOff.Y, entityInfo.relativePos.Z + tileOff.Z));
+	model *= glm::mat4_cast(glm::quat(-entityInfo.rotation.W, entityInfo.rotation.X, entityInfo.rotation.Y, entityInfo.rotation.Z));
+	model *= glm::scale(glm::mat4(1.0f), glm::vec3(entityInfo.scale.X, entityInfo.scale.Y, entityInfo.scale.Z));
 
-	auto it = bdaeModelCache.find(fname);
-
-	if (it != bdaeModelCache.end()) // reuse cached model
-		bdaeModel = it->second;
-	else // not cached — create, load and insert to cache on success
-	{
-		std::shared_ptr<Model> newModel = std::make_shared<Model>("shaders/model.vs", "shaders/model.fs"); // create new model object and init shared pointer to handle its ownership
-		Sound empty(true);
-		newModel->load(fname, empty, true);
-
-		if (newModel->modelLoaded)
-		{
-			bdaeModel = newModel;
-			bdaeModelCache[fname] = bdaeModel; // add to global cache with filename as a key for quick lookup
-		}
-		else
-			std::cout << "[Warning] Failed to load 3D model: " << fname << std::endl;
-	}
-
-	if (bdaeModel)
-	{
-		// build OpenGL style model matrix: scale -> rotate -> translate
-		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(glm::mat4(1.0f), glm::vec3(entityInfo.relativePos.X + tileOff.X, entityInfo.relativePos.Y + tileOff.Y, entityInfo.relativePos.Z + tileOff.Z));
-		model *= glm::mat4_cast(glm::quat(-entityInfo.rotation.W, entityInfo.rotation.X, entityInfo.rotation.Y, entityInfo.rotation.Z));
-		model *= glm::scale(glm::mat4(1.0f), glm::vec3(entityInfo.scale.X, entityInfo.scale.Y, entityInfo.scale.Z));
-
-		tile->models.emplace_back(bdaeModel, model); // add to tile's data (entities may use the same .bdae model, but located / scaled differently in world space, so we store pairs shared pointer + model matrix)
-		terrain.modelCount++;
-	}
+	tile->pendingModels.push_back(PendingModel{fname, model, terrain.modelLoader.request(fname, true)}); // each tile is loaded by one thread, so no locking is needed
 }
 
 #endif
@@ -1,6 +1,8 @@
 #ifndef PARSER_PHY_H
 #define PARSER_PHY_H
 
+#include <mutex>
+
 #define PHYSICS_FACE_SIZE 4
 
 #define PHYSICS_GEOM_TYPE_SPHERE 1
@@ -28,6 +30,7 @@ struct GeometryInfo
 
 // terrain's global cache for .phy models vertex data (key — filename, value — shared pointer)
 inline std::unordered_map<std::string, std::shared_ptr<std::pair<std::vector<float>, std::vector<unsigned short>>>> physicsModelCache;
+inline std::mutex physicsModelCacheMutex; // tiles are loaded on several threads at once
 
 // Class for loading physics geometry.
 // ___________________________________
@@ -117,15 +120,23 @@ class Physics
 				offset += 36;
 
 				std::string cacheKey = std::string(fname) + "#" + std::to_string(i); // (using just file name as a key for unsorted map does not work because all physics meshes of the same .phy file would share one key)
-				auto it = physicsModelCache.find(cacheKey);
+				std::shared_ptr<std::pair<std::vector<float>, std::vector<unsigned short>>> cachedMesh;
 
-				if (it != physicsModelCache.end()) // reuse cached model
+				{
+					std::lock_guard<std::mutex> lock(physicsModelCacheMutex);
+					auto it = physicsModelCache.find(cacheKey);
+
+					if (it != physicsModelCache.end())
+						cachedMesh = it->second;
+				}
+
+				if (cachedMesh) // reuse cached model
 				{
 					offset += vertexCount * 3 * sizeof(float);
 					offset += faceCount * PHYSICS_FACE_SIZE * sizeof(short);
 
 					node = new Physics(0.0f, pos, hx, hy, hz, PHYSICS_GEOM_TYPE_MESH);
-					node->mesh = it->second;
+					node->mesh = cachedMesh;
 				}
 				else // not cached — build vertex data and insert to cache on success
 				{
@@ -160,7 +171,10 @@ class Physics
 					node->mesh = std::make_shared<std::pair<std::vector<float>, std::vector<unsigned short>>>(std::move(vertices), std::move(indices)); // init shared pointer for vertex data (we share only vertices and indices, but not Physics objects! move vectors, no extra copy)
 
 					if (node->mesh)
-						physicsModelCache[cacheKey] = node->mesh; // add to global cache with filename as a key for quick lookup
+					{
+						std::lock_guard<std::mutex> lock(physicsModelCacheMutex);
+						physicsModelCache.emplace(cacheKey, node->mesh); // add to global cache with filename as a key for quick lookup (if another thread parsed the same mesh meanwhile, its entry is kept)
+					}
 					else
 						std::cout << "[Debug] Physics::load: failed to load " << fname << std::endl;
 				}
@@ -2,7 +2,7 @@
 #include "terrain.h"
 
 //! Processes a single .trn file of a terrain tile and returns a newly created TileTerrain object with the tile's terrain surface data saved.
-TileTerrain *TileTerrain::load(IReadResFile *trnFile, int &gridX, int &gridZ, Terrain &terrain)
+TileTerrain *TileTerrain::load(IReadResFile *trnFile, int &gridX, int &gridZ, std::vector<unsigned char> &scratch)
 {
 	// 1. load .trn file into memory
 	// ____________________
@@ -14,11 +14,11 @@ TileTerrain *TileTerrain::load(IReadResFile *trnFile, int &gridX, int &gridZ, Te
 
 	trnFile->seek(0);
 	int fileSize = (int)trnFile->getSize();
-	unsigned char *buffer = loadBuffer;
 
-	if (fileSize > DEFAULT_LOAD_BUFFER_SIZE)
-		buffer = new unsigned char[fileSize];
+	if ((int)scratch.size() < fileSize)
+		scratch.resize(fileSize); // grows to the largest .trn file once, then is reused
 
+	unsigned char *buffer = scratch.data();
 	trnFile->read(buffer, fileSize);
 
 	// 2. parse .trn file header, retrieve: tile's position on the grid, bounding box
@@ -40,7 +40,7 @@ TileTerrain *TileTerrain::load(IReadResFile *trnFile, int &gridX, int &gridZ, Te
 	int stringDataOffset = sizeof(TRNFileHeader) + ChunksInTile * sizeof(ChunkInfo) + ((UnitsInTileRow + 1) * (UnitsInTileCol + 1)) * 7 + 1;
 	memcpy(&textureCount, buffer + stringDataOffset, sizeof(int));
 
-	int sizeOfName[textureCount], newTexNameIndex[textureCount];
+	int sizeOfName[textureCount];
 	int prevPosition = 0;
 
 	for (int i = 0; i < textureCount; i++)
@@ -63,19 +63,8 @@ TileTerrain *TileTerrain::load(IReadResFile *trnFile, int &gridX, int &gridZ, Te
 
 		prevPosition += sizeOfName[i];
 
-		// register texture per-terrain – globally: check if texture name already exists in the list of unique names (if it doesn't, add it and assign a new index; if it does, reuse the existing index); used to pre-load all terrain textures
-		std::vector<std::string>::iterator namePos = std::find(terrain.uniqueTextureNames.begin(), terrain.uniqueTextureNames.end(), textureName);
-
-		if (namePos == terrain.uniqueTextureNames.end())
-		{
-			terrain.uniqueTextureNames.push_back(textureName);
-			newTexNameIndex[i] = (int)terrain.uniqueTextureNames.size() - 1;
-		}
-		else
-			newTexNameIndex[i] = (int)std::distance(terrain.uniqueTextureNames.begin(), namePos);
-
-		// register texture per-tile – locally; used to select textures from global list when creating tile's texture map
-		tileTerrain->textureIndices.push_back(newTexNameIndex[i]);
+		// register texture per-tile – locally; global registration (terrain's list of unique names) is done on the main thread, when the tile is handed over (see Terrain::registerTileTextures)
+		tileTerrain->textureNames.push_back(textureName);
 	}
 
 	// 4. parse chunk data section, retrieve: textures and other metadata about each chunk
@@ -89,15 +78,8 @@ TileTerrain *TileTerrain::load(IReadResFile *trnFile, int &gridX, int &gridZ, Te
 		for (int j = 0; j < ChunksInTileCol; j++, index++)
 		{
 			ChunkInfo *chunk = (ChunkInfo *)(buffer + chunkOffset); // read the next chunk header
-			tileTerrain->chunks[index] = *chunk;					// copy its data into the tile's chunk array
+			tileTerrain->chunks[index] = *chunk;					// copy its data into the tile's chunk array (texture indices are local until registration)
 			chunkOffset += sizeof(ChunkInfo);
-
-			if (tileTerrain->chunks[index].texNameIndex1 != -1)
-				tileTerrain->chunks[index].texNameIndex1 = newTexNameIndex[tileTerrain->chunks[index].texNameIndex1];
-			if (tileTerrain->chunks[index].texNameIndex2 != -1)
-				tileTerrain->chunks[index].texNameIndex2 = newTexNameIndex[tileTerrain->chunks[index].texNameIndex2];
-			if (tileTerrain->chunks[index].texNameIndex3 != -1)
-				tileTerrain->chunks[index].texNameIndex3 = newTexNameIndex[tileTerrain->chunks[index].texNameIndex3];
 		}
 	}
 
@@ -172,8 +154,5 @@ TileTerrain *TileTerrain::load(IReadResFile *trnFile, int &gridX, int &gridZ, Te
 		}
 	}
 
-	if (buffer != loadBuffer)
-		delete[] buffer;
-
 	return tileTerrain;
 }
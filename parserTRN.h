@@ -9,7 +9,6 @@
 #include "AABB.h"
 #include "Quaternion.h"
 #include "terrain.h"
-#include "water.h"
 #include "CZipResReader.h"
 #include "model.h"
 #include "parserPHY.h"
@@ -20,21 +19,71 @@
 #define UnitsInTileRow 64
 #define UnitsInTileCol 64
 
-#define DEFAULT_LOAD_BUFFER_SIZE 102400 // 100 KB
-
-const int visibleRadiusTiles = 4;																						// (2r + 1)^2 = (2 * 4 + 1)^2 = 81 visible tiles around the camera
+const int visibleRadiusTiles = 16;																						// (2r + 1)^2 = (2 * 16 + 1)^2 = 1089 visible tiles around the camera (covers the far plane; distant chunks are drawn at lower LOD)
 const float loadRadiusSq = (visibleRadiusTiles * UnitsInTileRow) * (visibleRadiusTiles * UnitsInTileRow);				// squared loading radius in world space units
 const float unloadRadiusSq = ((visibleRadiusTiles + 2) * UnitsInTileRow) * ((visibleRadiusTiles + 2) * UnitsInTileRow); // squared unloading radius in world space units (+2 margin prevents visual lag)
 
-static unsigned char loadBuffer[DEFAULT_LOAD_BUFFER_SIZE]; // static read buffer to load .trn files into memory without dynamic allocation
+const int prefetchRadiusTiles = visibleRadiusTiles + 2;																	 // tiles within this radius are read from disk in the background, ahead of GPU activation
+const int evictRadiusTiles = visibleRadiusTiles + 4;																	 // tiles beyond this radius are freed from CPU memory
+const float prefetchRadiusSq = (prefetchRadiusTiles * UnitsInTileRow) * (prefetchRadiusTiles * UnitsInTileRow);			 // squared prefetch radius in world space units
+const float evictRadiusSq = (evictRadiusTiles * UnitsInTileRow) * (evictRadiusTiles * UnitsInTileRow);					 // squared eviction radius in world space units
+const int maxLoadedTiles = 1280;																							 // cap on tiles kept in CPU memory; least recently used tiles outside the prefetch radius are freed first
+const int modelVisibleRadiusTiles = 4;																					 // 3D models are drawn only for tiles within this radius
+const float modelVisibleRadiusSq = (modelVisibleRadiusTiles * UnitsInTileRow) * (modelVisibleRadiusTiles * UnitsInTileRow); // squared model drawing radius in world space units
+const float minModelScreenSize = 0.004f;																				 // 3D models whose bounding sphere covers less than this fraction of the screen height are not drawn
+const int occluderRadiusTiles = 3;																						 // terrain of visible tiles within this radius is rasterized into the occlusion buffer (see Terrain::updateOcclusion)
+const int maxOccludersPerFrame = 24;																					 // cap on large 3D models rasterized into the occlusion buffer per frame (the nearest ones are taken)
+const float minOccluderScreenSize = 0.1f;																				 // only 3D models covering at least this fraction of the screen height are used as occluders
+const float chunkLodDistance = 96.0f;																					 // chunks closer than this (horizontally) are drawn at full resolution; each next LOD level starts at twice the distance
+const int maskRadiusTiles = 6;																							 // mask layers are read and uploaded only for active tiles within this radius (farther chunks are drawn at low LOD without them)
+const float maskLoadRadiusSq = (maskRadiusTiles * UnitsInTileRow) * (maskRadiusTiles * UnitsInTileRow);					 // squared mask loading radius in world space units
+const float maskUnloadRadiusSq = ((maskRadiusTiles + 2) * UnitsInTileRow) * ((maskRadiusTiles + 2) * UnitsInTileRow);	 // squared mask unloading radius in world space units (+2 margin prevents thrashing)
+const int maxMaskUploadsPerFrame = 4;																					 // cap on mask textures uploaded to GPU per frame
+const int maxTilesAddedPerFrame = 4;																					 // cap on streamed tiles handed over to the main thread per frame (texture upload and model creation), so that camera movement does not stall rendering
+
+static std::unordered_map<std::string, std::weak_ptr<Model>> bdaeModelCache; // terrain's global cache for .bdae models (key — filename, value — weak pointer; a model is freed once no loaded tile uses it)
+
+// .bdae model placement requested by a tile entity; resolved when the tile is handed over to the main thread
+struct PendingModel
+{
+	std::string fileName;
+	glm::mat4 model;
+	ModelLoader::Request request;
+};
 
-static std::unordered_map<std::string, std::shared_ptr<Model>> bdaeModelCache; // terrain's global cache for .bdae models (key — filename, value — shared pointer)
+// placed .bdae model of a tile entity (the Model itself is shared by all entities using the same file, so everything specific to one placement lives here)
+struct ModelInstance
+{
+	std::shared_ptr<Model> model;
+	glm::mat4 transform;	  // model matrix (placement in world space)
+	AnimationState animation; // playback state
+	glm::vec3 boundsCenter;	  // world space bounding box (model's box moved by the transform; entities do not move, so it is computed once, see Terrain::resolveTileModels)
+	glm::vec3 boundsExtent;	  // (half size)
+};
 
 // 1 tile = 8 × 8 chunks = 64 × 64 units = 65 x 65 vertices
 
 // Vertices:   o──o──o──o──o   ← 4 units → 5 vertices
 // Units:       ── ── ── ──
 
+#define VerticesInTileRow (UnitsInTileRow + 1)
+#define VerticesInTileCol (UnitsInTileCol + 1)
+#define UnitsInChunkRow (UnitsInTileRow / ChunksInTileRow)
+#define UnitsInChunkCol (UnitsInTileCol / ChunksInTileCol)
+#define ChunkLodLevels 4 // level L draws every 2^L-th vertex of a chunk: 8 x 8, 4 x 4, 2 x 2, 1 x 1 square cells
+#define OccluderCellSize 4 // terrain is rasterized into the occlusion buffer as a coarser height map with 4 x 4 unit cells
+#define OccluderVerticesInTileRow (UnitsInTileRow / OccluderCellSize + 1)
+
+// 12 bytes, repeated VerticesInTileRow x VerticesInTileCol = 4225 times per tile
+// x and z of a terrain vertex are implied by its index in the tile's grid (see Terrain::gridEBO and terrain vertex shader)
+struct TerrainVertex
+{
+	short height;		// 2 bytes  height in 1/100 world space units (as stored in .trn file)
+	short padding;		// 2 bytes  keeps the next attributes 4-byte aligned
+	glm::i8vec4 normal; // 4 bytes  normal vector in range [-127, 127] (w unused)
+	glm::u8vec4 color;	// 4 bytes  vertex color (main textures blending weights)
+};
+
 // 24 bytes
 struct TRNFileHeader
 {
@@ -76,37 +125,58 @@ class TileTerrain
   public:
 	unsigned int trnVAO, trnVBO, navVAO, navVBO, phyVAO, phyVBO;
 	unsigned int terrainVertexCount, navmeshVertexCount, physicsVertexCount;
-	std::vector<float> terrainVertices, navigationVertices, physicsVertices; // vertex data
+	std::vector<TerrainVertex> terrainVertices;							 // terrain surface vertex data (indexed by terrain's shared grid index buffer)
+	std::vector<float> navigationVertices, physicsVertices;				 // vertex data
+	glm::ivec3 chunkTextures[ChunksInTile];								 // per-chunk indices into terrain's global texture array on GPU
 	std::vector<Physics *> physicsGeometry;									 // .phy models
-	std::vector<std::pair<std::shared_ptr<Model>, glm::mat4>> models;		 // .bdae models
-	unsigned int textureMap;												 // .trn textures
-	unsigned int maskTexture;												 // .msk + .shw mask layers texture
-	Water water;															 // water surface
+	std::vector<ModelInstance> models;										 // .bdae models
+	unsigned int maskTexture;												 // .msk mask layers texture (RG: primary, secondary), uploaded only while the tile is near the camera
+	unsigned int shadowTexture;												 // .shw pre-rendered shadows texture (R), 0 if the tile has none
+	bool maskRequested;														 // flag that indicates whether mask layers are being read in the background or are on GPU
+	std::vector<float> waterVertices;										 // water surface (chunks with the same water level merged into larger quads), drawn by terrain's shared water renderer
 	bool activated;															 // flag that indicates whether a tile is uploaded to GPU
 
+	std::vector<std::string> textureNames;			 // tile's texture names, in .trn order (chunks refer to them until the tile is registered in terrain's global list)
 	std::vector<int> textureIndices;				 // indices of all tile's texture names in terrain's global list
+	std::vector<std::shared_ptr<std::vector<unsigned char>>> textureImages; // decoded surface textures (256 x 256 RGBA with mipmaps) in textureNames order, NULL if already on GPU; released after GPU upload
+	std::vector<PendingModel> pendingModels;		 // .bdae models requested by tile's entities, waiting to be created on the main thread
+	unsigned int lastUsedFrame;						 // last frame the tile was inside the prefetch radius (for least recently used eviction)
 	float startX, startZ;							 // position on the grid in world space coordinates
 	float Y[UnitsInTileRow + 1][UnitsInTileCol + 1]; // height map
 	AABB BBox;										 // bounding box
 
+	float chunkMinY[ChunksInTile], chunkMaxY[ChunksInTile];					  // height range of each chunk (bounding boxes for occlusion culling)
+	float occluderY[OccluderVerticesInTileRow][OccluderVerticesInTileRow]; // coarse height map for occlusion culling (see Terrain::getTerrainVertices)
+
+	// chunk draws of the current frame, recorded by Terrain::draw and issued with 1 call when the tile is submitted from the render queue (see Terrain::submitTile)
+	GLsizei chunkDrawCounts[ChunksInTile];
+	const void *chunkDrawOffsets[ChunksInTile];
+	GLint chunkDrawBaseVertices[ChunksInTile];
+	int chunkLodSteps[ChunksInTile]; // indexed by chunk position
+	int chunkDrawCount;
+
 	ChunkInfo chunks[ChunksInTile];
 
 	glm::u8vec4 colors[UnitsInTileRow + 1][UnitsInTileCol + 1]; // vertex colors
 	glm::vec3 normals[UnitsInTileRow + 1][UnitsInTileCol + 1];	// normal vectors
 
 	TileTerrain()
-		: startX(0), startZ(0),
-		  trnVAO(0), trnVBO(0),
+		: trnVAO(0), trnVBO(0),
 		  navVAO(0), navVBO(0),
 		  phyVAO(0), phyVBO(0),
 		  terrainVertexCount(0),
 		  navmeshVertexCount(0),
 		  physicsVertexCount(0),
-		  textureMap(0),
 		  maskTexture(0),
-		  activated(false)
+		  shadowTexture(0),
+		  maskRequested(false),
+		  activated(false),
+		  lastUsedFrame(0),
+		  startX(0), startZ(0),
+		  chunkDrawCount(0)
 	{
 		memset(&chunks, 0, sizeof(chunks));
+		memset(&chunkTextures, 0, sizeof(chunkTextures));
 		memset(&Y, 0, sizeof(Y));
 	};
 
@@ -119,18 +189,18 @@ class TileTerrain
 		glDeleteBuffers(1, &navVBO);
 		glDeleteBuffers(1, &phyVBO);
 
-		if (textureMap)
-		{
-			glDeleteTextures(1, &textureMap);
-			textureMap = 0;
-		}
-
 		if (maskTexture)
 		{
 			glDeleteTextures(1, &maskTexture);
 			maskTexture = 0;
 		}
 
+		if (shadowTexture)
+		{
+			glDeleteTextures(1, &shadowTexture);
+			shadowTexture = 0;
+		}
+
 		trnVAO = trnVBO = navVAO = navVBO = phyVAO = phyVBO = 0;
 
 		terrainVertexCount = navmeshVertexCount = physicsVertexCount = 0;
@@ -138,15 +208,17 @@ class TileTerrain
 		terrainVertices.clear();
 		navigationVertices.clear();
 		physicsVertices.clear();
+		textureNames.clear();
 		textureIndices.clear();
+		textureImages.clear();
+		pendingModels.clear();
 
 		models.clear();
-
-		water.release();
+		waterVertices.clear();
 	}
 
-	//! Processes a single .trn file of a terrain tile and returns a newly created TileTerrain object with the tile's terrain surface data saved.
-	static TileTerrain *load(IReadResFile *trnFile, int &gridX, int &gridZ, Terrain &terrain);
+	//! Processes a single .trn file of a terrain tile and returns a newly created TileTerrain object with the tile's terrain surface data saved (thread-safe: 'scratch' is caller's read buffer, reused across calls).
+	static TileTerrain *load(IReadResFile *trnFile, int &gridX, int &gridZ, std::vector<unsigned char> &scratch);
 };
 
 #endif
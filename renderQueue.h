@@ -0,0 +1,139 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "shader.h"
+#include "bonePalette.h"
+#include "libs/glad/glad.h"
+#include "libs/glm/glm.hpp"
+
+// passes of the frame, drawn in this order; each pass has its own fixed-function state (see RenderQueue::setPassState)
+enum RenderPass
+{
+	RENDER_PASS_WIREFRAME,	 // mesh edges (simple mode models, physics debug); drawn first, so faces drawn later at the same depth do not hide them
+	RENDER_PASS_TERRAIN,	 // terrain surface
+	RENDER_PASS_MODELS,		 // 3D models (their textures have soft alpha edges, so they are blended over the terrain)
+	RENDER_PASS_TRANSLUCENT, // physics debug faces, water (submission order is kept)
+	RENDER_PASS_SKY,		 // skybox and distant hills behind everything, without depth writes (submission order is kept)
+	RENDER_PASS_COUNT
+};
+
+// One draw of the frame: the state the queue binds (program, vertex array, texture on unit 0) plus the data its submit function needs to set the item's own uniforms and issue the draw call(s).
+struct RenderItem
+{
+	uint64_t key;							// sort key (set by RenderQueue::add)
+	Shader *shader;							// program
+	unsigned int vao;						// vertex array
+	unsigned int texture;					// texture on unit 0 (0 → none)
+	unsigned int textureTarget;				// GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+	void (*submit)(const RenderItem &item); // sets item's uniforms and issues its draw call(s); must leave program, vertex array and texture unit 0 as they are
+	void *object;							// owner of the draw data (Model, TileTerrain, Water)
+	int renderMode;							// fragment shader mode (textured, wireframe, faces, ...)
+	int index;								// submesh index (models)
+	int first, count;						// vertex or index range
+	int baseInstance, instanceCount;		// range in model's instance buffer (instanceCount 0 → not instanced)
+	int boneOffset;							// position of the pose in the bone palette (-1 → not skinned)
+	glm::mat4 transform;					// 'model' uniform
+};
+
+// Class for collecting all draws of a frame (terrain, water, models, physics debug, sky) and submitting them sorted by state, so that each program, texture and vertex array is bound once per run of items that use it.
+// Sort key (64 bits): pass (3) | program (13) | texture (16) | vertex array (16) | submission order (16); in passes that keep submission order, all bits below the pass hold the submission order.
+// Object names are truncated to their bit fields: a collision only costs an extra switch, the bound state is always compared in full.
+// ________________________________________
+
+class RenderQueue
+{
+  public:
+	// state changes of the last flush (to measure what sorting saves)
+	struct Stats
+	{
+		int items;
+		int programSwitches;
+		int textureSwitches;
+		int vaoSwitches;
+	};
+
+	static inline Stats stats = {0, 0, 0, 0};
+
+	//! Queues a draw in 'pass' (its key is built here).
+	static void add(RenderPass pass, RenderItem &item)
+	{
+		uint64_t order = items.size() & 0xFFFF;
+
+		if (pass == RENDER_PASS_TRANSLUCENT || pass == RENDER_PASS_SKY)
+			item.key = ((uint64_t)pass << 61) | items.size();
+		else
+			item.key = ((uint64_t)pass << 61) | ((uint64_t)(item.shader->shaderProgram & 0x1FFF) << 48) | ((uint64_t)(item.texture & 0xFFFF) << 32) | ((uint64_t)(item.vao & 0xFFFF) << 16) | order;
+
+		items.push_back(item);
+	}
+
+	//! Sends bone palettes of the frame, sorts queued draws and submits them, skipping redundant program, texture and vertex array binds; then clears the queue and restores default state.
+	static void flush()
+	{
+		stats = {(int)items.size(), 0, 0, 0};
+
+		// skinning matrices of queued draws are sent before any of them is submitted
+		BonePalette::flush();
+
+		std::sort(items.begin(), items.end(), [](const RenderItem &a, const RenderItem &b)
+				  { return a.key < b.key; });
+
+		int pass = -1;
+		unsigned int program = 0, vao = 0, texture = 0;
+
+		for (const RenderItem &item : items)
+		{
+			int itemPass = (int)(item.key >> 61);
+
+			if (itemPass != pass)
+			{
+				setPassState(itemPass);
+				pass = itemPass;
+			}
+
+			if (item.shader->shaderProgram != program)
+			{
+				item.shader->use();
+				program = item.shader->shaderProgram;
+				stats.programSwitches++;
+			}
+
+			if (item.texture != 0 && item.texture != texture)
+			{
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(item.textureTarget, item.texture);
+				texture = item.texture;
+				stats.textureSwitches++;
+			}
+
+			if (item.vao != vao)
+			{
+				glBindVertexArray(item.vao);
+				vao = item.vao;
+				stats.vaoSwitches++;
+			}
+
+			item.submit(item);
+		}
+
+		setPassState(-1);
+		glBindVertexArray(0);
+		items.clear();
+	}
+
+  private:
+	static inline std::vector<RenderItem> items;
+
+	//! Sets fixed-function state of a pass (-1 → default state).
+	static void setPassState(int pass)
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, (pass == RENDER_PASS_WIREFRAME) ? GL_LINE : GL_FILL);
+		glDepthMask((pass == RENDER_PASS_SKY) ? GL_FALSE : GL_TRUE);
+		glDepthFunc((pass == RENDER_PASS_SKY) ? GL_LEQUAL : GL_LESS);
+	}
+};
+
+#endif
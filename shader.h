@@ -2,41 +2,168 @@
 #define SHADER_H // define a macro SHADER_H (to mark that this header file has been included)
 
 #include <string>
+#include <vector>
 #include <fstream> // for reading files
 #include <sstream> // for handling string streams
+#include <iostream>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
 #include "libs/glad/glad.h"
 #include "libs/glm/glm.hpp"
 #include "libs/glm/gtc/type_ptr.hpp"
 
-class Shader
+// uniform buffer binding point of the per-frame uniform block (see FrameData)
+const unsigned int FRAME_DATA_BINDING = 0;
+
+// process-wide registry of linked shader programs, keyed by source paths and defines: every Shader built from the same sources shares 1 program (so uniforms set once, e.g. in a constructor, must have the same value for all users)
+// programs live until clear() is called; optionally, linked programs are saved to disk (glProgramBinary) so that the next start skips GLSL compilation
+class ShaderCache
 {
 public:
-    unsigned int shaderProgram;
-
-    // constructor that generates the graphics pipeline on the fly when the class instance is initialized
-    Shader(const char *vertexPath, const char *fragmentPath)
-    {
-        // 1. retrieve the vertex/fragment shader source code from filePath
-        std::string vertexCode, fragmentCode;
-        std::ifstream vShaderFile, fShaderFile;
-        std::stringstream vShaderStream, fShaderStream;
-
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        // read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-        // convert into C-style string because OpenGL expects a pointer to char array
-        const char *vertexShaderSource = vertexCode.c_str();
-        const char *fragmentShaderSource = fragmentCode.c_str();
-
-        // 2. compile shaders
+    // linked program and locations of its uniforms, resolved on first use
+    struct Program
+    {
+        unsigned int id;
+        std::unordered_map<std::string, int> uniformLocations;
+
+        int location(const std::string &name)
+        {
+            auto it = uniformLocations.find(name);
+
+            if (it != uniformLocations.end())
+                return it->second;
+
+            int location = glGetUniformLocation(id, name.c_str());
+            uniformLocations.emplace(name, location);
+            return location;
+        }
+    };
+
+    //! Returns the program built from the given shader files with 'defines' inserted after the #version line; compiles and links it on first request only (main thread only).
+    static Program *acquire(const char *vertexPath, const char *fragmentPath, const std::string &defines)
+    {
+        std::string key = std::string(vertexPath) + "|" + fragmentPath + "|" + defines;
+
+        auto it = programs.find(key);
+
+        if (it != programs.end())
+            return &it->second;
+
+        std::string vertexCode = readFile(vertexPath);
+        std::string fragmentCode = readFile(fragmentPath);
+
+        if (!defines.empty())
+        {
+            insertDefines(vertexCode, defines);
+            insertDefines(fragmentCode, defines);
+        }
+
+        unsigned int program = 0;
+        std::string binaryPath;
+
+        if (binaryCacheAvailable())
+        {
+            // the binary is only valid for the same sources on the same driver, so both are part of its name
+            std::string driver = std::string((const char *)glGetString(GL_VENDOR)) + (const char *)glGetString(GL_RENDERER) + (const char *)glGetString(GL_VERSION);
+            uint64_t hash = fnv1a(vertexCode + '\0' + fragmentCode + '\0' + driver);
+
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+            binaryPath = (std::filesystem::path(binaryDirectory) / name).string();
+
+            program = loadBinary(binaryPath);
+        }
+
+        if (!program)
+        {
+            program = compile(vertexCode.c_str(), fragmentCode.c_str(), !binaryPath.empty());
+
+            if (!binaryPath.empty())
+                saveBinary(binaryPath, program);
+        }
+
+        // attach the per-frame uniform block, if the program declares it (binding is not part of the program binary, so it is set on both paths)
+        unsigned int blockIndex = glGetUniformBlockIndex(program, "FrameData");
+
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, blockIndex, FRAME_DATA_BINDING);
+
+        Program &entry = programs[key];
+        entry.id = program;
+        return &entry;
+    }
+
+    //! Enables the on-disk program binary cache in the given directory (created if missing); empty path disables it.
+    static void setBinaryCacheDirectory(const std::string &directory)
+    {
+        binaryDirectory = directory;
+
+        if (!directory.empty())
+        {
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+        }
+    }
+
+    //! Deletes all programs (they must no longer be in use).
+    static void clear()
+    {
+        for (auto &entry : programs)
+            glDeleteProgram(entry.second.id);
+
+        programs.clear();
+    }
+
+private:
+    static inline std::unordered_map<std::string, Program> programs; // linked programs (key — "vertex path|fragment path|defines"); nodes are stable, so Shader objects keep pointers to them
+    static inline std::string binaryDirectory;                       // on-disk program binary cache, disabled if empty
+
+    static std::string readFile(const char *path)
+    {
+        std::ifstream file(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
+    }
+
+    // defines must follow the #version directive, which has to be the first line of a shader
+    static void insertDefines(std::string &code, const std::string &defines)
+    {
+        size_t lineEnd = (code.compare(0, 8, "#version") == 0) ? code.find('\n') : std::string::npos;
+
+        if (lineEnd == std::string::npos)
+            code.insert(0, defines + "\n");
+        else
+            code.insert(lineEnd + 1, defines + "\n");
+    }
+
+    static uint64_t fnv1a(const std::string &data)
+    {
+        uint64_t hash = 14695981039346656037ull;
+
+        for (unsigned char c : data)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    // program binaries need OpenGL 4.1 or ARB_get_program_binary, and a driver that supports at least 1 binary format
+    static bool binaryCacheAvailable()
+    {
+        if (binaryDirectory.empty() || !glProgramBinary || !glGetProgramBinary || !glProgramParameteri)
+            return false;
+
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }
+
+    static unsigned int compile(const char *vertexShaderSource, const char *fragmentShaderSource, bool retrievable)
+    {
         unsigned int vertexShader;
         vertexShader = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
@@ -47,13 +174,134 @@ public:
         glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
         glCompileShader(fragmentShader);
 
-        shaderProgram = glCreateProgram();
+        unsigned int shaderProgram = glCreateProgram();
         glAttachShader(shaderProgram, vertexShader);
         glAttachShader(shaderProgram, fragmentShader);
+
+        if (retrievable)
+            glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
         glLinkProgram(shaderProgram);
 
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
+
+        return shaderProgram;
+    }
+
+    // cached file layout: binary format (GLenum), then the binary itself; returns 0 if there is no usable binary (missing, or rejected by an updated driver)
+    static unsigned int loadBinary(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+
+        if (!file)
+            return 0;
+
+        GLenum format = 0;
+
+        if (!file.read((char *)&format, sizeof(format)))
+            return 0;
+
+        // rest of the file is the binary (reading through stream iterators does not set eofbit, so only its size tells a truncated file)
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        if (binary.empty())
+            return 0;
+
+        unsigned int program = glCreateProgram();
+        glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+        if (!linked)
+        {
+            glDeleteProgram(program);
+            return 0;
+        }
+
+        return program;
+    }
+
+    static void saveBinary(const std::string &path, unsigned int program)
+    {
+        GLint linked = GL_FALSE, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+        if (!linked || length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+        std::ofstream file(path, std::ios::binary);
+
+        if (!file)
+        {
+            std::cout << "[Warning] Failed to write shader binary cache: " << path << std::endl;
+            return;
+        }
+
+        file.write((const char *)&format, sizeof(format));
+        file.write(binary.data(), binary.size());
+    }
+};
+
+// frame-constant shader data: 1 std140 uniform block 'FrameData', updated once per frame and read by all shaders that declare it
+// (layout must match the block declared in shaders: mat4 view, mat4 projection, vec3 cameraPos, bool lighting)
+class FrameData
+{
+public:
+    //! Uploads frame-constant data and binds the buffer to FRAME_DATA_BINDING (main thread only; call once per frame before rendering).
+    static void update(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &cameraPos, bool lighting)
+    {
+        Block block;
+        block.view = view;
+        block.projection = projection;
+        block.cameraPos = cameraPos;
+        block.lighting = lighting ? 1 : 0;
+
+        if (!buffer)
+        {
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), NULL, GL_DYNAMIC_DRAW);
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, buffer);
+    }
+
+private:
+    // std140 mirror of the shader block: mat4 columns and vec3 are 16-byte aligned, a scalar may fill the 4th component after a vec3
+    struct Block
+    {
+        glm::mat4 view;       // offset 0
+        glm::mat4 projection; // offset 64
+        glm::vec3 cameraPos;  // offset 128
+        int lighting;         // offset 140 (GLSL bool is 4 bytes)
+    };
+
+    static_assert(sizeof(Block) == 144, "FrameData must match std140 layout");
+
+    static inline unsigned int buffer = 0;
+};
+
+class Shader
+{
+public:
+    unsigned int shaderProgram;    // shared with all Shader objects built from the same sources (see ShaderCache)
+    ShaderCache::Program *program; // registry entry with cached uniform locations
+
+    // constructor that takes the graphics pipeline from the program registry, building it on the fly on first use
+    // 'defines' (e.g. "#define USE_SKINNING") are inserted after the #version line and select a separate program variant
+    Shader(const char *vertexPath, const char *fragmentPath, const std::string &defines = "")
+        : program(ShaderCache::acquire(vertexPath, fragmentPath, defines))
+    {
+        shaderProgram = program->id;
     }
 
     // define a class function that activates shader program
@@ -65,32 +313,52 @@ public:
     // utility functions to set uniform variables
     void setInt(const std::string &name, int value) const
     {
-        glUniform1i(glGetUniformLocation(shaderProgram, name.c_str()), value);
+        glUniform1i(program->location(name), value);
     }
 
     void setFloat(const std::string &name, float value) const
     {
-        glUniform1f(glGetUniformLocation(shaderProgram, name.c_str()), value);
+        glUniform1f(program->location(name), value);
     }
 
     void setBool(const std::string &name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(shaderProgram, name.c_str()), (int)value);
+        glUniform1i(program->location(name), (int)value);
+    }
+
+    void setVec2(const std::string &name, glm::vec2 value) const
+    {
+        glUniform2fv(program->location(name), 1, glm::value_ptr(value));
     }
 
     void setVec3(const std::string &name, glm::vec3 value) const
     {
-        glUniform3fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, glm::value_ptr(value));
+        glUniform3fv(program->location(name), 1, glm::value_ptr(value));
+    }
+
+    void setIntArray(const std::string &name, int count, const int *values) const
+    {
+        glUniform1iv(program->location(name), count, values);
+    }
+
+    void setIvec3Array(const std::string &name, int count, const glm::ivec3 *values) const
+    {
+        glUniform3iv(program->location(name), count, glm::value_ptr(values[0]));
     }
 
     void setVec4(const std::string &name, glm::vec4 value) const
     {
-        glUniform4fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, glm::value_ptr(value));
+        glUniform4fv(program->location(name), 1, glm::value_ptr(value));
     }
 
     void setMat4(const std::string &name, glm::mat4 value) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+        glUniformMatrix4fv(program->location(name), 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    void setMat4Array(const std::string &name, int count, const glm::mat4 *values) const
+    {
+        glUniformMatrix4fv(program->location(name), count, GL_FALSE, glm::value_ptr(values[0]));
     }
 };
 
@@ -2,8 +2,15 @@
 
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 projection;
-uniform mat4 view;
+// frame-constant data shared by all shaders, updated once per frame (see FrameData in shader.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    bool lighting;
+};
+
 uniform mat4 model;
 
 void main()
@@ -13,12 +13,19 @@ in vec3 PosWorldSpace;
 in vec3 Normal;
 in vec2 TexCoord;
 
+// frame-constant data shared by all shaders, updated once per frame (see FrameData in shader.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    bool lighting;
+};
+
 // input from application (same for all fragments within single draw call)
-uniform vec3 cameraPos;
 uniform sampler2D modelTexture;
 uniform int renderMode; // 1 = textured, 2 = wireframe (mesh edges), 3 = mesh faces
 
-uniform bool lighting;
 uniform vec3 lightPos;
 uniform vec3 lightColor;
 uniform float ambientStrength;
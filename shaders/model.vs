@@ -7,14 +7,23 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
 layout (location = 3) in ivec4 aBoneIndices;
 layout (location = 4) in vec4 aBoneWeights;
+layout (location = 5) in mat4 aInstanceModel; // per-instance world matrix (instanced draws only; occupies locations 5–8)
+
+// frame-constant data shared by all shaders, updated once per frame (see FrameData in shader.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    bool lighting;
+};
 
 // input from application (same for all vertices within single draw call)
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
+uniform bool instanced; // whether the world matrix comes from aInstanceModel ('model' then holds only submesh's node transform)
 
-const int MAX_BONES = 128;
-uniform mat4 boneTotalTransforms[MAX_BONES];
+uniform samplerBuffer bonePalette; // skinning matrices of all skinned draws in the frame, 4 texels (columns) per matrix (see BonePalette)
+uniform int boneOffset;            // position of this draw's first bone in the palette
 uniform bool useSkinning;
 
 // output to fragment shader
@@ -22,6 +31,13 @@ out vec3 PosWorldSpace;
 out vec3 Normal;
 out vec2 TexCoord;
 
+// skinning matrix for each bone (it is node transform * inverse bind pose matrix)
+mat4 boneTotalTransform(int bone)
+{
+    int texel = (boneOffset + bone) * 4;
+    return mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1), texelFetch(bonePalette, texel + 2), texelFetch(bonePalette, texel + 3));
+}
+
 void main()
 {
     vec4 position = vec4(aPos, 1.0);
@@ -39,10 +55,10 @@ void main()
            B_i — bone skinning matrix  */
 
         mat4 blendedBoneMatrix = mat4(0.0);
-        blendedBoneMatrix += boneTotalTransforms[aBoneIndices.x] * aBoneWeights.x;
-        blendedBoneMatrix += boneTotalTransforms[aBoneIndices.y] * aBoneWeights.y;
-        blendedBoneMatrix += boneTotalTransforms[aBoneIndices.z] * aBoneWeights.z;
-        blendedBoneMatrix += boneTotalTransforms[aBoneIndices.w] * aBoneWeights.w;
+        blendedBoneMatrix += boneTotalTransform(aBoneIndices.x) * aBoneWeights.x;
+        blendedBoneMatrix += boneTotalTransform(aBoneIndices.y) * aBoneWeights.y;
+        blendedBoneMatrix += boneTotalTransform(aBoneIndices.z) * aBoneWeights.z;
+        blendedBoneMatrix += boneTotalTransform(aBoneIndices.w) * aBoneWeights.w;
         
         position = blendedBoneMatrix * vec4(aPos, 1.0); // apply skinning (move vertex to the weighted position)
         normal = mat3(blendedBoneMatrix) * aNormal;
@@ -50,6 +66,7 @@ void main()
     
     Normal = normal;
     TexCoord = aTexCoord;
-    PosWorldSpace = vec3(model * position);             // transform vertex position from object to world space (for lighting calculations in fragment shader)
-    gl_Position = projection * view * model * position; // transform vertex position from object to clip space
+    mat4 world = instanced ? aInstanceModel * model : model;
+    PosWorldSpace = vec3(world * position);             // transform vertex position from object to world space (for lighting calculations in fragment shader)
+    gl_Position = projection * view * world * position; // transform vertex position from object to clip space
 }
@@ -6,7 +6,6 @@ in vec2 TexCoord;
 
 out vec4 FragColor;
 
-uniform vec3 cameraPos;
 uniform sampler2D modelTexture;
 
 void main()
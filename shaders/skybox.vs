@@ -7,13 +7,20 @@ out vec3 PosWorldSpace;
 out vec3 Normal;
 out vec2 TexCoord;
 
-uniform mat4 projection;
-uniform mat4 view;
+// frame-constant data shared by all shaders, updated once per frame (see FrameData in shader.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    bool lighting;
+};
+
 uniform mat4 model;
 
 void main()
 {
     TexCoord = aTexCoord;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
+    vec4 pos = projection * mat4(mat3(view)) * vec4(aPos, 1.0); // rotation only, so the sky stays centered on the camera
     gl_Position = pos.xyww; // a trick to force z = w so that after perspective division, depth is always 1.0, which is the max depth value at the far plane
 }
\ No newline at end of file
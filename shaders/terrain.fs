@@ -4,18 +4,27 @@ in vec3 PosWorldSpace;
 in vec3 Normal;
 in vec2 TexCoord1;
 in vec2 TexCoord2;
-in float TexIdx1;
-in float TexIdx2;
-in float TexIdx3;
 in vec4 TexBlendWeights;
-in vec3 Barycentric;
+in vec2 GridPos;
+
+// frame-constant data shared by all shaders, updated once per frame (see FrameData in shader.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    bool lighting;
+};
 
-uniform vec3 cameraPos;
 uniform sampler2DArray baseTextureArray;
-uniform sampler2D maskTexture;
+uniform sampler2D maskTexture;      // primary (R) and secondary (G) mask layers of the tile
+uniform sampler2D shadowTexture;    // pre-rendered shadows of the tile (R)
+uniform bool hasMask;               // false while tile's mask layers are not on GPU
+uniform bool hasShadow;             // false if the tile has no pre-rendered shadows
 uniform int renderMode;
+uniform ivec3 chunkTextures[64];    // main textures indices into per tile texture array, per chunk (8 x 8 chunks per tile)
+uniform int chunkLodSteps[64];      // distance between vertices of each chunk's LOD level in square units (1, 2, 4 or 8)
 
-uniform bool lighting;
 uniform vec3 lightPos;
 uniform vec3 lightColor;
 uniform float ambientStrength;
@@ -30,14 +39,18 @@ void main()
 {
 if (renderMode == 1)
 {
-        vec4 color1 = texture(baseTextureArray, vec3(TexCoord1, TexIdx1));
-        vec4 color2 = texture(baseTextureArray, vec3(TexCoord1, TexIdx2));
-        vec4 color3 = texture(baseTextureArray, vec3(TexCoord1, TexIdx3));
-        vec4 mask = texture(maskTexture, TexCoord2);
+        ivec2 chunk = clamp(ivec2(GridPos / 8.0), 0, 7);
+        vec3 texIdx = vec3(chunkTextures[chunk.y * 8 + chunk.x]);
+
+        vec4 color1 = texture(baseTextureArray, vec3(TexCoord1, texIdx.x));
+        vec4 color2 = texture(baseTextureArray, vec3(TexCoord1, texIdx.y));
+        vec4 color3 = texture(baseTextureArray, vec3(TexCoord1, texIdx.z));
+        vec2 mask = hasMask ? texture(maskTexture, TexCoord2).rg : vec2(0.0);
+        float shadowMask = hasShadow ? texture(shadowTexture, TexCoord2).r : 0.0;
 
         float mr = clamp(mask.r, 0.0, 1.0);
         float mg = clamp(mask.g, 0.0, 1.0);
-        float mb = clamp(mask.b, 0.0, 1.0);
+        float mb = clamp(shadowMask, 0.0, 1.0);
 
         float w1 = TexBlendWeights.b * max(0.0, 1.0 - mr - mg);
         float w2 = TexBlendWeights.r * mr;
@@ -74,7 +87,12 @@ if (renderMode == 1)
         FragColor = vec4(0.4f, 0.2f, 0.1f, 1.0f);
     else if (renderMode == 3)
     {
-        float minB = min(min(Barycentric.x, Barycentric.y), Barycentric.z);
+        // barycentric coords within the cell's triangle (each cell of chunk's LOD level is split along its (0, 0) – (1, 1) diagonal; cells at chunk edges facing coarser chunks are approximated)
+        ivec2 chunk = clamp(ivec2(GridPos / 8.0), 0, 7);
+        vec2 f = fract(GridPos / float(chunkLodSteps[chunk.y * 8 + chunk.x]));
+        vec3 barycentric = (f.x <= f.y) ? vec3(1.0 - f.y, f.y - f.x, f.x) : vec3(1.0 - f.x, f.y, f.x - f.y);
+
+        float minB = min(min(barycentric.x, barycentric.y), barycentric.z);
         float w = fwidth(minB) * 0.2;
         float edgeFactor = smoothstep(w * 0.5, w, minB);
 
@@ -1,39 +1,46 @@
 #version 330 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoord1;   // main textures coords
-layout (location = 3) in vec2 aTexCoord2;   // mask texture coords
-layout (location = 4) in vec3 aTexIdx;      // main textures indices into per tile texture array
-layout (location = 5) in vec4 aColor;       // main textures blending weights
-layout (location = 6) in vec3 aBary;        // barycentric coords (for wireframe mode optimization)
-
-uniform mat4 projection;
-uniform mat4 view;
+// terrain surface is a 65 x 65 vertex grid per tile: x and z of a vertex are implied by its index in the grid (gl_VertexID), only the rest is stored per vertex
+layout (location = 0) in vec3 aPos;         // position (physics and navigation meshes); for the terrain grid, aPos.x holds the height in 1/100 units
+layout (location = 1) in vec3 aNormal;      // normal vector (terrain grid only)
+layout (location = 2) in vec4 aColor;       // main textures blending weights (terrain grid only)
+
+// frame-constant data shared by all shaders, updated once per frame (see FrameData in shader.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    bool lighting;
+};
+
 uniform mat4 model;
+uniform bool gridMesh;                      // whether the terrain grid is rendered
+uniform vec2 tileOrigin;                    // tile's corner in world space (x, z)
 
 out vec3 PosWorldSpace;
 out vec3 Normal;
 out vec2 TexCoord1;
 out vec2 TexCoord2;
-out float TexIdx1;
-out float TexIdx2;
-out float TexIdx3;
 out vec4 TexBlendWeights;
-out vec3 Barycentric;
+out vec2 GridPos;                           // position in tile's grid in square units (selects chunk textures and draws wireframe in fragment shader)
 
 void main()
 {
-    PosWorldSpace = vec3(model * vec4(aPos, 1.0));
+    vec3 pos = aPos;
+    GridPos = vec2(0.0);
+
+    if (gridMesh)
+    {
+        GridPos = vec2(gl_VertexID % 65, gl_VertexID / 65);
+        pos = vec3(tileOrigin.x + GridPos.x, aPos.x * 0.01, tileOrigin.y + GridPos.y);
+    }
+
+    PosWorldSpace = vec3(model * vec4(pos, 1.0));
     Normal = aNormal;
-    TexCoord1 = aTexCoord1;
-    TexCoord2 = aTexCoord2;
-    TexIdx1 = aTexIdx.x;
-    TexIdx2 = aTexIdx.y; 
-    TexIdx3 = aTexIdx.z; 
+    TexCoord1 = GridPos / 8.0;  // main textures repeat per chunk
+    TexCoord2 = GridPos / 64.0; // mask texture spans the whole tile
     TexBlendWeights = aColor;
 
-    vec4 clipPos = projection * view * model * vec4(aPos, 1.0);
-    Barycentric = aBary * clipPos.w; // scale for perspective-correct interpolation in fragment shader
-    gl_Position = clipPos;
-}
\ No newline at end of file
+    gl_Position = projection * view * model * vec4(pos, 1.0);
+}
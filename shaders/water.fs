@@ -6,10 +6,17 @@ in vec2 TexCoord;
 
 out vec4 FragColor;
 
-uniform vec3 cameraPos;
+// frame-constant data shared by all shaders, updated once per frame (see FrameData in shader.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    bool lighting;
+};
+
 uniform sampler2D waterTexture;
 
-uniform bool lighting;
 uniform vec3 lightPos;
 uniform vec3 lightColor;
 uniform float ambientStrength;
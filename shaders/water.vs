@@ -1,14 +1,19 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location=  1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoord;
+layout (location = 0) in vec3 aPos;  // water surface is flat, so normal and texture coordinates are derived from the position
 
 out vec3 PosWorldSpace;
 out vec3 Normal;
 out vec2 TexCoord;
 
-uniform mat4 projection;
-uniform mat4 view;
+// frame-constant data shared by all shaders, updated once per frame (see FrameData in shader.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    bool lighting;
+};
+
 uniform mat4 model;
 uniform float textureOffset;
 uniform float textureScale;
@@ -16,7 +21,7 @@ uniform float textureScale;
 void main()
 {
     PosWorldSpace = vec3(model * vec4(aPos, 1.0));
-    Normal = aNormal;
-    TexCoord = aTexCoord * textureScale + vec2(textureOffset, 0.0);  // animate water by offsetting texture coordinates horizontally
+    Normal = vec3(0.0, 1.0, 0.0);
+    TexCoord = aPos.xz * textureScale + vec2(textureOffset, 0.0);  // animate water by offsetting texture coordinates horizontally
     gl_Position = projection * view * vec4(PosWorldSpace, 1.0);
 }
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include "terrain.h"
 #include <filesystem>
+#include <climits>
+#include <cstddef>
+#if defined(__SSE2__)
+#include <emmintrin.h> // SSE intrinsics for batched culling of models (see cullModelInstances)
+#endif
 #include "libs/stb_image.h"
 #include "libs/glm/glm.hpp"
 #include "libs/glm/fwd.hpp"
@@ -11,116 +16,221 @@
 #include "parserTRN.h"
 #include "parserITM.h"
 
-//! CPU-side map loading (called once on map startup, pre-loads all tiles for selected map): opens resource archives, calls parsers for each asset type and each map's tile, then builds vertex and index data.
-void Terrain::load(const char *fpath, Sound &sound)
+// mask is a per-pixel value that modulates some effect (like texture blending or shadow intensity)
+// mask layer file stores these values as 1 byte per pixel, though each value is in range [0, 255]
+#ifdef BETA_GAME_VERSION
+const int MASK_MAP_RESOLUTION = 512;
+#else
+const int MASK_MAP_RESOLUTION = 256;
+#endif
+
+const int TERRAIN_TEXTURE_RESOLUTION = 256;
+const int TERRAIN_TEXTURE_MIP_LEVELS = 9;		// 256 x 256 → 1 x 1
+const int TERRAIN_TEXTURE_MIN_ARRAY_LAYERS = 64; // initial capacity of the global texture array
+
+// position of a chunk triangulation in Terrain::chunkPatterns
+static inline int chunkPatternIndex(int level, int north, int east, int south, int west)
 {
-	reset();
+	return (((level * ChunkLodLevels + north) * ChunkLodLevels + east) * ChunkLodLevels + south) * ChunkLodLevels + west;
+}
 
-	// open map's resource archives (de-facto ZIP archives but formally named with the same file extension as the assets they contain)
-	CZipResReader *terrainArchive = new CZipResReader(fpath, true, false);
+//! Builds the index buffer shared by all tiles' terrain surface: one triangulation of an 8 x 8 unit chunk per LOD level and combination of coarser neighbors (edges facing a coarser chunk skip its missing vertices, so no cracks appear).
+void Terrain::createGridIndexBuffer()
+{
+	const int size = UnitsInChunkRow; // chunk side in units (8)
 
-	CZipResReader *itemsArchive = new CZipResReader(std::string(fpath).replace(std::strlen(fpath) - 4, 4, ".itm").c_str(), true, false);
+	std::vector<unsigned short> indices;
+	chunkPatterns.assign(ChunkLodLevels * ChunkLodLevels * ChunkLodLevels * ChunkLodLevels * ChunkLodLevels, ChunkPattern{0, 0});
 
-	CZipResReader *masksArchive = new CZipResReader(std::string(fpath).replace(std::strlen(fpath) - 4, 4, ".msk").c_str(), true, false);
+	// index of a vertex relative to chunk's corner vertex (x → column, z → row); chunk's position in the tile is added as base vertex when drawing
+	auto vertexIndex = [](int x, int z) -> unsigned short
+	{ return (unsigned short)(z * VerticesInTileCol + x); };
 
-	CZipResReader *navigationArchive = new CZipResReader(std::string(fpath).replace(std::strlen(fpath) - 4, 4, ".nav").c_str(), true, false);
+	//! Lambda function to triangulate a strip between chunk's edge and the row of vertices one cell (of size 'step') inside it, using every 'edgeStep'-th vertex on the edge. Points are given as (x, z) of the start and direction along the edge, and the inward direction.
+	auto addBorderStrip = [&](int step, int edgeStep, glm::ivec2 start, glm::ivec2 along, glm::ivec2 inward)
+	{
+		// outer points at positions 0, edgeStep, .., 8; inner points at positions step, 2 * step, .., 8 - step
+		std::vector<int> outer, inner;
 
-	CZipResReader *physicsArchive = new CZipResReader("data/terrain/physics.zip", true, false);
+		for (int t = 0; t <= size; t += edgeStep)
+			outer.push_back(t);
+		for (int t = step; t <= size - step; t += step)
+			inner.push_back(t);
 
-	// dtNavMesh *navMesh = new dtNavMesh();
+		auto outerVertex = [&](int t) { glm::ivec2 p = start + along * t; return vertexIndex(p.x, p.y); };
+		auto innerVertex = [&](int t) { glm::ivec2 p = start + along * t + inward * step; return vertexIndex(p.x, p.y); };
 
-	struct tmp_TileTerrain
-	{
-		int tileX;
-		int tileZ;
-		TileTerrain *tileData;
+		// zip both rows together, always advancing the row whose next point is closer
+		for (int i = 0, j = 0; i < (int)outer.size() - 1 || j < (int)inner.size() - 1;)
+		{
+			if (i < (int)outer.size() - 1 && (j == (int)inner.size() - 1 || outer[i + 1] <= inner[j + 1]))
+			{
+				indices.insert(indices.end(), {outerVertex(outer[i]), outerVertex(outer[i + 1]), innerVertex(inner[j])});
+				i++;
+			}
+			else
+			{
+				indices.insert(indices.end(), {outerVertex(outer[i]), innerVertex(inner[j + 1]), innerVertex(inner[j])});
+				j++;
+			}
+		}
 	};
 
-	// we will first store map's tile data in a temporary vector of TileTerrain objects (we cannot just push back a loaded tile to the main 2D vector; at the same time, we cannot resize it, since dimensions of the terrain are yet unknown)
-	std::vector<tmp_TileTerrain> tmp_tiles;
-
-	// loop through each tile in the terrain (it is equal to the number of .trn files in the terrain archive)
-	for (int i = 0, n = terrainArchive->getFileCount(); i < n; i++)
+	for (int level = 0; level < ChunkLodLevels; level++)
+	for (int north = level; north < ChunkLodLevels; north++)
+	for (int east = level; east < ChunkLodLevels; east++)
+	for (int south = level; south < ChunkLodLevels; south++)
+	for (int west = level; west < ChunkLodLevels; west++)
 	{
-		IReadResFile *trnFile = terrainArchive->openFile(i); // open i-th .trn file inside the archive and return memory-read file object with the decompressed content
+		int firstIndex = indices.size();
+		int step = 1 << level;				   // distance between used vertices in units
+		int cells = size / step;			   // number of square cells per chunk side
 
-		if (trnFile)
+		if (cells == 1) // whole chunk is 1 quad (no neighbor can be coarser)
+			indices.insert(indices.end(), {vertexIndex(0, 0), vertexIndex(0, size), vertexIndex(size, size), vertexIndex(0, 0), vertexIndex(size, size), vertexIndex(size, 0)});
+		else
 		{
-			int tileX, tileZ;														   // variables that will be assigned tile's position on the grid
-			TileTerrain *tile = TileTerrain::load(trnFile, tileX, tileZ, *this);	   // .trn: parse tile's terrain surface data
-			loadTileEntities(itemsArchive, physicsArchive, tileX, tileZ, tile, *this); // .itm: parse tile's 3D objects info, then parse their model data (.phy and .bdae files)
-			loadTileMasks(masksArchive, tileX, tileZ, tile);						   // .msk, .shw: parse tile's mask layers (for terrain surface textures)
-			// loadTileNavigation(navigationArchive, navMesh, tileX, tileZ);
+			/* 1 inner cell (quad = 2 triangles)
 
-			if (tile)
+			 (row, col)   (row, col+1)
+					•───────•
+					│ \     │
+					│   \   │
+					│     \ │
+					•───────•
+			 (row+1, col)  (row + 1, col + 1) */
+
+			for (int row = 1; row < cells - 1; row++)
 			{
-				tmp_tiles.push_back(tmp_TileTerrain{tileX, tileZ, tile});
-
-				// update Class variables that track the min and max tile indices (grid borders)
-				if (tileX < tileMinX)
-					tileMinX = tileX;
-				if (tileX > tileMaxX)
-					tileMaxX = tileX;
-				if (tileZ < tileMinZ)
-					tileMinZ = tileZ;
-				if (tileZ > tileMaxZ)
-					tileMaxZ = tileZ;
+				for (int col = 1; col < cells - 1; col++)
+				{
+					unsigned short v00 = vertexIndex(col * step, row * step);
+					unsigned short v10 = vertexIndex((col + 1) * step, row * step);
+					unsigned short v01 = vertexIndex(col * step, (row + 1) * step);
+					unsigned short v11 = vertexIndex((col + 1) * step, (row + 1) * step);
+
+					indices.insert(indices.end(), {v00, v01, v11, v00, v11, v10});
+				}
 			}
 
-			trnFile->drop();
+			// outer ring of cells: 4 trapezoids between chunk's edges and the inner cells (they meet at the diagonals of corner cells)
+			addBorderStrip(step, 1 << north, glm::ivec2(0, 0), glm::ivec2(1, 0), glm::ivec2(0, 1));	 // north edge (z = 0)
+			addBorderStrip(step, 1 << south, glm::ivec2(0, size), glm::ivec2(1, 0), glm::ivec2(0, -1)); // south edge (z = 8)
+			addBorderStrip(step, 1 << west, glm::ivec2(0, 0), glm::ivec2(0, 1), glm::ivec2(1, 0));	 // west edge (x = 0)
+			addBorderStrip(step, 1 << east, glm::ivec2(size, 0), glm::ivec2(0, 1), glm::ivec2(-1, 0)); // east edge (x = 8)
 		}
+
+		chunkPatterns[chunkPatternIndex(level, north, east, south, west)] = ChunkPattern{firstIndex, (int)indices.size() - firstIndex};
 	}
 
-	if (terrainArchive)
-		delete terrainArchive;
+	glBindVertexArray(0); // do not record the binding in any VAO yet
+	glGenBuffers(1, &gridEBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+//! Returns the triangulation of a chunk at LOD 'level' whose north / east / south / west edges are shared with chunks at the given LOD levels (not finer than 'level').
+const Terrain::ChunkPattern &Terrain::getChunkPattern(int level, int north, int east, int south, int west) const
+{
+	return chunkPatterns[chunkPatternIndex(level, north, east, south, west)];
+}
 
-	if (itemsArchive)
-		delete itemsArchive;
+//! Returns LOD level of the chunk with the corner at (x, z) in world space, based on horizontal distance from camera to chunk's center (it depends on position only, so neighbor chunks agree on it even across tile borders).
+int Terrain::getChunkLod(float x, float z) const
+{
+	float dx = camera.Position.x - (x + 0.5f * UnitsInChunkRow);
+	float dz = camera.Position.z - (z + 0.5f * UnitsInChunkCol);
+	float distance = std::sqrt(dx * dx + dz * dz);
 
-	if (masksArchive)
-		delete masksArchive;
+	// level 0 up to chunkLodDistance, then each level covers twice the distance of the previous one
+	int level = 0;
 
-	if (navigationArchive)
-		delete navigationArchive;
+	for (float limit = chunkLodDistance; distance >= limit && level < ChunkLodLevels - 1; limit *= 2.0f)
+		level++;
 
-	if (physicsArchive)
-		delete physicsArchive;
+	return level;
+}
 
-	/* initialize Class variables inside the Terrain object
-		– terrain borders
-		– terrain size
-		– map's tile data */
+//! Map loading (called once on map startup): only scans the terrain archive for tile positions; tiles themselves are streamed in around the camera (see updateStreaming).
+void Terrain::load(const char *fpath, Sound &sound)
+{
+	reset();
 
-	// terrain borders in world space coordinates
-	minX = (float)tileMinX * ChunksInTile;
-	minZ = (float)tileMinZ * ChunksInTile;
-	maxX = (float)tileMaxX * ChunksInTile;
-	maxZ = (float)tileMaxZ * ChunksInTile;
+	// open map's terrain archive (de-facto ZIP archive but formally named with the same file extension as the assets it contains)
+	CZipResReader *terrainArchive = new CZipResReader(fpath, true, false);
+	int fileCount = terrainArchive->getFileCount();
 
-	// 2D array for storing data of all tiles on the terrain
-	// (basically 1D temp tmp_tiles vector is converted into a 2D array)
-	tilesX = (tileMaxX - tileMinX) + 1; // number of tiles in X direction
-	tilesZ = (tileMaxZ - tileMinZ) + 1; // number of tiles in Z direction
+	// CZipResReader *navigationArchive = new CZipResReader(std::string(fpath).replace(std::strlen(fpath) - 4, 4, ".nav").c_str(), true, false);
+	// dtNavMesh *navMesh = new dtNavMesh();
 
-	tiles.assign(tilesX, std::vector<TileTerrain *>(tilesZ, NULL)); // resize to terrain dimensions
+	// 1. find each tile's position on the grid (the number of tiles is equal to the number of .trn files in the terrain archive)
+	// .trn files are named after their grid position, so the archive's file list is enough; tile data is not read here
+	std::vector<glm::ivec2> tileGridPos(fileCount, glm::ivec2(INT_MIN));
 
-	for (int i = 0, n = tmp_tiles.size(); i < n; i++)
+	for (int i = 0; i < fileCount; i++)
 	{
-		int indexX = tmp_tiles[i].tileX - tileMinX; // convert from [-128, 127] range to [0, 255]
-		int indexZ = tmp_tiles[i].tileZ - tileMinZ;
-		tiles[indexX][indexZ] = tmp_tiles[i].tileData;
+		int tileX, tileZ;
+		const SZipResFileEntry *entry = terrainArchive->getFileInfo(i);
+
+		if (entry && sscanf(std::filesystem::path(entry->simpleFileName).filename().string().c_str(), "%d_%d.trn", &tileX, &tileZ) == 2)
+			tileGridPos[i] = glm::ivec2(tileX, tileZ);
+		else if (IReadResFile *trnFile = terrainArchive->openFile(i)) // unexpected file name — read grid position from .trn file header
+		{
+			TRNFileHeader header;
+
+			if (trnFile->read(&header, sizeof(TRNFileHeader)) == sizeof(TRNFileHeader))
+				tileGridPos[i] = glm::ivec2(header.gridX, header.gridZ);
+
+			trnFile->drop();
+		}
+
+		if (tileGridPos[i].x == INT_MIN)
+			continue;
+
+		// update Class variables that track the min and max tile indices (grid borders)
+		tileMinX = std::min(tileMinX, tileGridPos[i].x);
+		tileMaxX = std::max(tileMaxX, tileGridPos[i].x);
+		tileMinZ = std::min(tileMinZ, tileGridPos[i].y);
+		tileMaxZ = std::max(tileMaxZ, tileGridPos[i].y);
 	}
 
-	tmp_tiles.clear();
+	delete terrainArchive;
 
-	// build meshes (vertex and index data) in world space coordinates
-	getTerrainVertices();
+	/* initialize Class variables inside the Terrain object
+		– terrain borders
+		– terrain size
+		– map's tile grid (tiles are loaded on demand, see updateStreaming) */
 
-	getWaterVertices();
+	if (tileMinX <= tileMaxX && tileMinZ <= tileMaxZ)
+	{
+		// terrain borders in world space coordinates
+		minX = (float)tileMinX * ChunksInTile;
+		minZ = (float)tileMinZ * ChunksInTile;
+		maxX = (float)tileMaxX * ChunksInTile;
+		maxZ = (float)tileMaxZ * ChunksInTile;
+
+		tilesX = (tileMaxX - tileMinX) + 1; // number of tiles in X direction
+		tilesZ = (tileMaxZ - tileMinZ) + 1; // number of tiles in Z direction
+	}
+	else
+		std::cout << "[Warning] No terrain tiles found in " << fpath << std::endl;
 
-	getPhysicsVertices();
+	tiles.assign(tilesX, std::vector<TileTerrain *>(tilesZ, NULL)); // resize to terrain dimensions
+	tileFileIndices.assign(tilesX, std::vector<int>(tilesZ, -1));
+	tilesLoading.assign(tilesX, std::vector<bool>(tilesZ, false));
 
-	// getNavigationVertices(navMesh);
+	for (int i = 0; i < fileCount; i++)
+	{
+		if (tileGridPos[i].x == INT_MIN)
+			continue;
+
+		int indexX = tileGridPos[i].x - tileMinX; // convert from [-128, 127] range to [0, 255]
+		int indexZ = tileGridPos[i].y - tileMinZ;
+		tileFileIndices[indexX][indexZ] = i;
+	}
+
+	archivePath = fpath;
 
 	// load skybox and hillbox
 	std::string terrainFileName = std::filesystem::path(fpath).filename().string();
@@ -131,12 +241,12 @@ void Terrain::load(const char *fpath, Sound &sound)
 	sky.load(skyName.c_str(), sound, true);
 	// hill.load(hillName.c_str(), sound, true);
 
+	sky.renderPass = hill.renderPass = RENDER_PASS_SKY;
+
 	if (sky.modelLoaded)
 	{
-		sky.EBOs.resize(sky.totalSubmeshCount);
 		glGenVertexArrays(1, &sky.VAO);
 		glGenBuffers(1, &sky.VBO);
-		glGenBuffers(sky.totalSubmeshCount, sky.EBOs.data());
 		glBindVertexArray(sky.VAO);
 		glBindBuffer(GL_ARRAY_BUFFER, sky.VBO);
 		glBufferData(GL_ARRAY_BUFFER, sky.vertices.size() * sizeof(Vertex), sky.vertices.data(), GL_STATIC_DRAW);
@@ -147,11 +257,7 @@ void Terrain::load(const char *fpath, Sound &sound)
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(6 * sizeof(float)));
 
-		for (int i = 0; i < sky.totalSubmeshCount; i++)
-		{
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sky.EBOs[i]);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sky.indices[i].size() * sizeof(unsigned short), sky.indices[i].data(), GL_STATIC_DRAW);
-		}
+		sky.uploadIndices();
 
 		glBindVertexArray(0);
 	}
@@ -160,10 +266,8 @@ void Terrain::load(const char *fpath, Sound &sound)
 
 		if (hill.modelLoaded)
 		{
-			hill.EBOs.resize(hill.totalSubmeshCount);
 			glGenVertexArrays(1, &hill.VAO);
 			glGenBuffers(1, &hill.VBO);
-			glGenBuffers(hill.totalSubmeshCount, hill.EBOs.data());
 			glBindVertexArray(hill.VAO);
 			glBindBuffer(GL_ARRAY_BUFFER, hill.VBO);
 			glBufferData(GL_ARRAY_BUFFER, hill.vertices.size() * sizeof(float), hill.vertices.data(), GL_STATIC_DRAW);
@@ -174,11 +278,7 @@ void Terrain::load(const char *fpath, Sound &sound)
 			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
 			glEnableVertexAttribArray(2);
 
-			for (int i = 0; i < hill.totalSubmeshCount; i++)
-			{
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hill.EBOs[i]);
-				glBufferData(GL_ELEMENT_ARRAY_BUFFER, hill.indices[i].size() * sizeof(unsigned short), hill.indices[i].data(), GL_STATIC_DRAW);
-			}
+			hill.uploadIndices();
 
 			glBindVertexArray(0);
 		}
@@ -208,19 +308,161 @@ void Terrain::load(const char *fpath, Sound &sound)
 	terrainLoaded = true;
 }
 
-//! Processes .msk and .shw files for a terrain tile and packs all 3 mask layers in 1 texture where each channel encodes the whole layer (R → primary mask, G → secondary mask, B → pre-rendered shadows).
-void Terrain::loadTileMasks(CZipResReader *masksArchive, int gridX, int gridZ, TileTerrain *tile)
+//! Takes an idle worker state for a background job, or opens a new set of archive handles (thread-safe).
+Terrain::TileLoadContext *Terrain::acquireContext()
 {
-	if (!masksArchive || !tile)
-		return;
+	TileLoadContext *ctx = NULL;
 
-	// mask is a per-pixel value that modulates some effect (like texture blending or shadow intensity)
-	// mask layer file stores these values as 1 byte per pixel, though each value is in range [0, 255]
-#ifdef BETA_GAME_VERSION
-	const int MASK_MAP_RESOLUTION = 512;
-#else
-	const int MASK_MAP_RESOLUTION = 256;
-#endif
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+
+		if (!freeContexts.empty())
+		{
+			ctx = freeContexts.back();
+			freeContexts.pop_back();
+		}
+	}
+
+	if (!ctx)
+	{
+		ctx = new TileLoadContext();
+		ctx->terrainArchive = new CZipResReader(archivePath.c_str(), true, false);
+		ctx->itemsArchive = new CZipResReader(std::string(archivePath).replace(archivePath.size() - 4, 4, ".itm").c_str(), true, false);
+		ctx->masksArchive = new CZipResReader(std::string(archivePath).replace(archivePath.size() - 4, 4, ".msk").c_str(), true, false);
+		ctx->physicsArchive = new CZipResReader("data/terrain/physics.zip", true, false);
+	}
+
+	return ctx;
+}
+
+//! Returns a worker state taken by acquireContext (thread-safe).
+void Terrain::releaseContext(TileLoadContext *ctx)
+{
+	std::lock_guard<std::mutex> lock(streamMutex);
+	freeContexts.push_back(ctx);
+}
+
+//! Loads a terrain tile on a worker thread (.trn, .itm files, surface textures, meshes) and queues it for the main thread; mask layers are read later, when the tile comes near the camera (see requestTileMasks).
+void Terrain::loadTile(int fileIndex, int indexX, int indexZ)
+{
+	TileLoadContext *ctx = acquireContext();
+	TileTerrain *tile = NULL;
+	IReadResFile *trnFile = ctx->terrainArchive->openFile(fileIndex); // open .trn file inside the archive and return memory-read file object with the decompressed content
+
+	if (trnFile)
+	{
+		int tileX, tileZ;													  // variables that will be assigned tile's position on the grid
+		tile = TileTerrain::load(trnFile, tileX, tileZ, ctx->fileBuffer); // .trn: parse tile's terrain surface data
+		trnFile->drop();
+
+		if (tile)
+		{
+			loadTileEntities(ctx->itemsArchive, ctx->physicsArchive, tileX, tileZ, tile, *this); // .itm: parse tile's 3D objects info, then parse their model data (.phy and .bdae files)
+			// loadTileNavigation(navigationArchive, navMesh, tileX, tileZ);
+
+			for (const std::string &textureName : tile->textureNames)
+				tile->textureImages.push_back(loadTerrainTexture(textureName));
+
+			// build meshes (vertex data in world space coordinates)
+			getTerrainVertices(tile);
+			getWaterVertices(tile);
+			getPhysicsVertices(tile);
+
+			// wait until tile's .bdae models are parsed, so that the main thread never blocks on them
+			for (PendingModel &pending : tile->pendingModels)
+				pending.request.wait();
+		}
+	}
+
+	releaseContext(ctx);
+
+	std::lock_guard<std::mutex> lock(streamMutex);
+	streamedTiles.push_back(StreamedTile{indexX, indexZ, tile});
+}
+
+//! Returns true if Model objects for all .bdae models requested by tile's entities can be created without waiting; data consumed by models freed since the request is requested again.
+bool Terrain::tileModelsReady(TileTerrain *tile)
+{
+	bool ready = true;
+
+	for (PendingModel &pending : tile->pendingModels)
+	{
+		if (bdaeModelCache.find(pending.fileName) != bdaeModelCache.end())
+			continue;
+
+		if (pending.request.wait_for(std::chrono::seconds(0)) != std::future_status::ready) // parsed again (see below)
+		{
+			ready = false;
+			continue;
+		}
+
+		std::shared_ptr<ModelData> data = pending.request.get();
+
+		// the request was issued before a model made of its data was freed (see updateStreaming) — parse the file again on a worker thread
+		if (data && data->fileName.empty())
+		{
+			pending.request = modelLoader.request(pending.fileName, true);
+			ready = false;
+		}
+	}
+
+	return ready;
+}
+
+//! Creates Model objects on the main thread (GPU upload) for .bdae models requested by tile's entities and attaches them to the tile.
+void Terrain::resolveTileModels(TileTerrain *tile)
+{
+	for (PendingModel &pending : tile->pendingModels)
+	{
+		std::shared_ptr<Model> bdaeModel;
+
+		auto it = bdaeModelCache.find(pending.fileName);
+
+		if (it != bdaeModelCache.end()) // reuse cached model (failed models are cached as expired pointers, so they are reported once)
+			bdaeModel = it->second.lock();
+		else
+		{
+			std::shared_ptr<ModelData> data = pending.request.get(); // already parsed (see loadTile and tileModelsReady)
+
+			if (data)
+			{
+				// Model constructor compiles shaders and load uploads textures, so this part must run on the main thread
+				bdaeModel = std::make_shared<Model>("shaders/model.vs", "shaders/model.fs");
+				bdaeModel->load(std::move(*data), true);
+				OcclusionBuffer::buildOccluderMesh(*bdaeModel, bdaeModel->occluderTriangles);
+				data->clear(); // mark parsed data as consumed
+			}
+			else
+				std::cout << "[Warning] Failed to load 3D model: " << pending.fileName << std::endl;
+
+			bdaeModelCache[pending.fileName] = bdaeModel; // add to global cache with filename as a key for quick lookup
+		}
+
+		if (bdaeModel)
+		{
+			ModelInstance instance{bdaeModel, pending.model, AnimationState{0, 0.0f}}; // add to tile's data (entities may use the same .bdae model, but located / scaled differently in world space, so we store shared pointer + model matrix + own playback state)
+
+			if (bdaeModel->boundsMin.x <= bdaeModel->boundsMax.x)
+				transformBounds(instance.transform, bdaeModel->boundsMin, bdaeModel->boundsMax, instance.boundsCenter, instance.boundsExtent);
+			else
+			{
+				instance.boundsCenter = glm::vec3(instance.transform[3]); // model without geometry
+				instance.boundsExtent = glm::vec3(0.0f);
+			}
+
+			tile->models.push_back(instance);
+		}
+	}
+
+	modelCount += tile->models.size();
+	std::vector<PendingModel>().swap(tile->pendingModels);
+}
+
+//! Processes .msk and .shw files for a terrain tile: packs both mask layers in 1 RG image (R → primary mask, G → secondary mask) and keeps pre-rendered shadows as a separate 1-channel image; CPU only, see uploadTileMasks.
+void Terrain::loadTileMasks(CZipResReader *masksArchive, int gridX, int gridZ, StreamedMask &masks, std::vector<unsigned char> &scratch)
+{
+	if (!masksArchive)
+		return;
 
 	const int expectedFileSize = MASK_MAP_RESOLUTION * MASK_MAP_RESOLUTION;
 
@@ -229,11 +471,14 @@ void Terrain::loadTileMasks(CZipResReader *masksArchive, int gridX, int gridZ, T
 	sprintf(tmpName1, "%04d_%04d_1.msk", gridX, gridZ);
 	sprintf(tmpName2, "%04d_%04d.shw", gridX, gridZ);
 
-	unsigned char bufferMask0[expectedFileSize];
+	// worker's scratch memory holds the 2 mask layers one after another (heap, not stack: worker threads may have small stacks)
+	scratch.resize(expectedFileSize * 2);
+
+	unsigned char *bufferMask0 = scratch.data();
+	unsigned char *bufferMask1 = bufferMask0 + expectedFileSize;
 
-	// if mask layer files not exist, these masks remain zeros (no influence)
-	unsigned char bufferMask1[expectedFileSize] = {0};
-	unsigned char bufferShadow[expectedFileSize] = {0};
+	// if secondary mask layer file not exists, this mask remains zeros (no influence)
+	memset(bufferMask1, 0, expectedFileSize);
 
 	//! Lambda function to read binary content of .msk or .shw file into buffer.
 	auto readFileToBuffer = [&](const char *fname, unsigned char *buffer) -> bool
@@ -258,31 +503,117 @@ void Terrain::loadTileMasks(CZipResReader *masksArchive, int gridX, int gridZ, T
 		return true;
 	};
 
-	// read required primary mask + optional secondary and shadow masks
+	// read required primary mask + optional secondary mask
 	if (!readFileToBuffer(tmpName0, bufferMask0))
 		return;
 
 	readFileToBuffer(tmpName1, bufferMask1);
-	readFileToBuffer(tmpName2, bufferShadow);
 
-	// pack into RGB texture
-	unsigned char rgb[expectedFileSize * 3];
+	// pack into RG image (uploaded to GPU on the main thread)
+	masks.blend.resize(expectedFileSize * 2);
+	unsigned char *rg = masks.blend.data();
 
 	for (int i = 0; i < expectedFileSize; i++)
 	{
-		rgb[3 * i + 0] = bufferMask0[i];
-		rgb[3 * i + 1] = bufferMask1[i];
-		rgb[3 * i + 2] = bufferShadow[i];
+		rg[2 * i + 0] = bufferMask0[i];
+		rg[2 * i + 1] = bufferMask1[i];
 	}
 
-	glGenTextures(1, &tile->maskTexture);
-	glBindTexture(GL_TEXTURE_2D, tile->maskTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, MASK_MAP_RESOLUTION, MASK_MAP_RESOLUTION, 0, GL_RGB, GL_UNSIGNED_BYTE, rgb);
+	// optional shadow mask is read as is (most tiles have none, so it is not interleaved with the blend layers)
+	masks.shadow.resize(expectedFileSize);
+
+	if (!readFileToBuffer(tmpName2, masks.shadow.data()))
+		std::vector<unsigned char>().swap(masks.shadow);
+}
+
+//! Starts reading tile's mask layers in the background (called when the tile comes near the camera).
+void Terrain::requestTileMasks(int indexX, int indexZ)
+{
+	TileTerrain *tile = tiles[indexX][indexZ];
+
+	if (!tile || tile->maskRequested)
+		return;
+
+	tile->maskRequested = true;
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	int gridX = indexX + tileMinX;
+	int gridZ = indexZ + tileMinZ;
+
+	// mask layers are not kept in CPU memory between activations — they are read from the archive again (the file is already in the OS cache most of the time)
+	tileJobs.push_back(loadPool.enqueue([this, indexX, indexZ, gridX, gridZ]()
+										{
+		TileLoadContext *ctx = acquireContext();
+		StreamedMask masks{indexX, indexZ};
+		loadTileMasks(ctx->masksArchive, gridX, gridZ, masks, ctx->maskBuffer);
+		releaseContext(ctx);
+
+		std::lock_guard<std::mutex> lock(streamMutex);
+		streamedMasks.push_back(std::move(masks)); }));
+}
+
+//! Uploads mask layers read in the background to GPU, at most maxMaskUploadsPerFrame per frame (main thread only).
+void Terrain::uploadTileMasks()
+{
+	std::vector<StreamedMask> readyMasks;
+
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+
+		int count = std::min((int)streamedMasks.size(), maxMaskUploadsPerFrame);
+		readyMasks.insert(readyMasks.end(), std::make_move_iterator(streamedMasks.begin()), std::make_move_iterator(streamedMasks.begin() + count));
+		streamedMasks.erase(streamedMasks.begin(), streamedMasks.begin() + count);
+	}
+
+	//! Lambda function to create a mask texture from a CPU image.
+	auto createMaskTexture = [](GLint internalFormat, GLenum format, const std::vector<unsigned char> &image) -> unsigned int
+	{
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, MASK_MAP_RESOLUTION, MASK_MAP_RESOLUTION, 0, format, GL_UNSIGNED_BYTE, image.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		return texture;
+	};
+
+	for (StreamedMask &ready : readyMasks)
+	{
+		TileTerrain *tile = tiles.empty() ? NULL : tiles[ready.indexX][ready.indexZ];
+
+		// drop results for tiles that were released from GPU (or evicted) while their masks were being read
+		if (!tile || !tile->activated || !tile->maskRequested || tile->maskTexture)
+			continue;
+
+		if (!ready.blend.empty())
+			tile->maskTexture = createMaskTexture(GL_RG8, GL_RG, ready.blend);
+
+		if (!ready.shadow.empty())
+			tile->shadowTexture = createMaskTexture(GL_R8, GL_RED, ready.shadow);
+	}
+}
+
+//! Releases tile's mask textures from GPU.
+void Terrain::releaseTileMasks(TileTerrain *tile)
+{
+	if (tile->maskTexture)
+	{
+		glDeleteTextures(1, &tile->maskTexture);
+		tile->maskTexture = 0;
+	}
+
+	if (tile->shadowTexture)
+	{
+		glDeleteTextures(1, &tile->shadowTexture);
+		tile->shadowTexture = 0;
+	}
+
+	tile->maskRequested = false;
 }
 
 //! Processes a single .nav file for a terrain tile and adds its data to the Detour navigation system.
@@ -309,281 +640,375 @@ void Terrain::loadTileNavigation(CZipResReader *navigationArchive, dtNavMesh *na
 	int tileRef = navMesh->addTile(buffer, fileSize, DT_TILE_FREE_DATA, 0);
 }
 
-//! Builds terrain surface vertex data for each square unit and loads textures (terrain is rendered per square unit, however some data is defined per chunk or even per tile, so it must be mapped to square units).
-void Terrain::getTerrainVertices()
+//! Registers tile's texture names in terrain's global list of unique names and remaps chunk texture indices to it (main thread).
+void Terrain::registerTileTextures(TileTerrain *tile)
 {
-	const int TERRAIN_TEXTURE_RESOLUTION = 256;
+	int textureCount = tile->textureNames.size();
+	std::vector<int> newTexNameIndex(textureCount);
 
-	//! Lambda function to allocate a 256 x 256 RGBA image filled with white pixels.
-	auto alloc_white_256 = []() -> unsigned char *
+	for (int i = 0; i < textureCount; i++)
 	{
-		int size = TERRAIN_TEXTURE_RESOLUTION * TERRAIN_TEXTURE_RESOLUTION * 4; // image size in bytes: 256 * 256 pixels * 4 channels
-		unsigned char *data = (unsigned char *)malloc(size);
+		// register texture per-terrain – globally: check if texture name already exists in the list of unique names (if it doesn't, add it and assign a new index; if it does, reuse the existing index)
+		std::vector<std::string>::iterator namePos = std::find(uniqueTextureNames.begin(), uniqueTextureNames.end(), tile->textureNames[i]);
 
-		if (!data)
-			return NULL;
+		if (namePos == uniqueTextureNames.end())
+		{
+			uniqueTextureNames.push_back(tile->textureNames[i]);
+			newTexNameIndex[i] = (int)uniqueTextureNames.size() - 1;
+		}
+		else
+			newTexNameIndex[i] = (int)std::distance(uniqueTextureNames.begin(), namePos);
 
-		// if allocation succeeded, fill all bytes with 255 (white color, full alpha)
-		memset(data, 255, size);
+		tile->textureIndices.push_back(newTexNameIndex[i]);
+	}
 
-		return data;
-	};
+	for (int index = 0; index < ChunksInTile; index++)
+	{
+		ChunkInfo &chunk = tile->chunks[index];
+
+		if (chunk.texNameIndex1 != -1)
+			chunk.texNameIndex1 = newTexNameIndex[chunk.texNameIndex1];
+		if (chunk.texNameIndex2 != -1)
+			chunk.texNameIndex2 = newTexNameIndex[chunk.texNameIndex2];
+		if (chunk.texNameIndex3 != -1)
+			chunk.texNameIndex3 = newTexNameIndex[chunk.texNameIndex3];
 
-	//! Lambda function to resize an RGBA image to 256 x 256 resolution using nearest-neighbor sampling (returns a resized copy).
-	auto resize_to_256 = [](unsigned char *src, int srcWidth, int srcHeight) -> unsigned char *
+		tile->chunkTextures[index] = glm::ivec3(std::max<short>(chunk.texNameIndex1, 0), std::max<short>(chunk.texNameIndex2, 0), std::max<short>(chunk.texNameIndex3, 0)); // layers of the global texture array
+	}
+}
+
+//! Returns a decoded terrain surface texture normalized to 256 x 256 RGBA, followed by its mipmap chain; returns NULL if the texture is already on GPU. Images are shared while any tile being loaded holds them (thread-safe).
+std::shared_ptr<std::vector<unsigned char>> Terrain::loadTerrainTexture(const std::string &name)
+{
 	{
-		unsigned char *data = (unsigned char *)malloc(TERRAIN_TEXTURE_RESOLUTION * TERRAIN_TEXTURE_RESOLUTION * 4);
+		std::lock_guard<std::mutex> lock(textureImageCacheMutex);
 
-		if (!data)
+		if (uploadedTextureNames.count(name))
 			return NULL;
 
+		auto it = textureImageCache.find(name);
+
+		if (it != textureImageCache.end())
+			if (std::shared_ptr<std::vector<unsigned char>> image = it->second.lock())
+				return image;
+	}
+
+	// allocate a 256 x 256 RGBA image filled with white pixels (fallback if the texture cannot be loaded), with room for its mipmaps
+	int imageSize = 0;
+
+	for (int level = 0; level < TERRAIN_TEXTURE_MIP_LEVELS; level++)
+		imageSize += (TERRAIN_TEXTURE_RESOLUTION >> level) * (TERRAIN_TEXTURE_RESOLUTION >> level) * 4;
+
+	std::shared_ptr<std::vector<unsigned char>> image = std::make_shared<std::vector<unsigned char>>(imageSize, 255);
+
+	// adjust texture path: fix slashes, insert 'unsorted/' after 'texture/', and prepend 'data/'
+	std::string textureName = name;
+	std::replace(textureName.begin(), textureName.end(), '\\', '/');
+
+	auto pos = textureName.find("texture/");
+
+	if (pos != std::string::npos)
+		textureName.insert(pos + 8, "unsorted/");
+
+	textureName = "data/" + textureName;
+
+	// load texture as RGBA (4 channels)
+	int width = 0, height = 0, nrChannels = 0;
+	unsigned char *data = stbi_load(textureName.c_str(), &width, &height, &nrChannels, 4);
+
+	if (!data) // load failed — use 256 x 256 white fallback
+	{
+		std::cout << "[Warning] Failed to load texture: " << textureName << "\n"
+				  << "          Using fallback white 256x256 texture." << std::endl;
+	}
+	else if (width != TERRAIN_TEXTURE_RESOLUTION || height != TERRAIN_TEXTURE_RESOLUTION) // load success but resolution mismatch — resize to 256 x 256 using nearest-neighbor sampling
+	{
 		// loop through each pixel in the new image
 		for (int destY = 0; destY < TERRAIN_TEXTURE_RESOLUTION; destY++)
 		{
 			// map new pixel y coordinate to source pixel y coordinate using nearest-neighbor
-			int srcY = (destY * srcHeight) / TERRAIN_TEXTURE_RESOLUTION;
+			int srcY = (destY * height) / TERRAIN_TEXTURE_RESOLUTION;
 
 			for (int destX = 0; destX < TERRAIN_TEXTURE_RESOLUTION; destX++)
 			{
-				int srcX = (destX * srcWidth) / TERRAIN_TEXTURE_RESOLUTION;
-
-				// get source and destination pixel pointers
-				unsigned char *srcPixel = src + (srcY * srcWidth + srcX) * 4;
-				unsigned char *destPixel = data + (destY * TERRAIN_TEXTURE_RESOLUTION + destX) * 4;
+				int srcX = (destX * width) / TERRAIN_TEXTURE_RESOLUTION;
 
 				// copy one pixel (R, G, B, A) = 4 bytes from source to destination
-				memcpy(destPixel, srcPixel, 4);
+				memcpy(image->data() + (destY * TERRAIN_TEXTURE_RESOLUTION + destX) * 4, data + (srcY * width + srcX) * 4, 4);
 			}
 		}
 
-		return data;
-	};
+		std::cout << "[Info] Resized texture " << textureName << " from " << width << "x" << height << " to " << TERRAIN_TEXTURE_RESOLUTION << "x" << TERRAIN_TEXTURE_RESOLUTION << "." << std::endl;
+	}
+	else // load success (normal case)
+		memcpy(image->data(), data, TERRAIN_TEXTURE_RESOLUTION * TERRAIN_TEXTURE_RESOLUTION * 4);
 
-	// load all terrain's unique surface textures and normalize to 256 x 256 RGBA if needed
-	int terrainTextureCount = uniqueTextureNames.size();
-	std::vector<unsigned char *> trnTextures(terrainTextureCount, NULL);
+	if (data)
+		stbi_image_free(data);
 
-	for (int i = 0; i < terrainTextureCount; i++)
+	// build mipmap chain on this thread (each level averages 2 x 2 pixels of the previous one), so that the main thread only uploads it
+	unsigned char *src = image->data();
+
+	for (int level = 1; level < TERRAIN_TEXTURE_MIP_LEVELS; level++)
 	{
-		// adjust texture path: fix slashes, insert 'unsorted/' after 'texture/', and prepend 'data/'
-		std::string textureName = uniqueTextureNames[i];
-		std::replace(textureName.begin(), textureName.end(), '\\', '/');
+		int srcSize = TERRAIN_TEXTURE_RESOLUTION >> (level - 1);
+		int size = srcSize / 2;
+		unsigned char *dest = src + srcSize * srcSize * 4;
+
+		for (int y = 0; y < size; y++)
+			for (int x = 0; x < size; x++)
+				for (int c = 0; c < 4; c++)
+					dest[(y * size + x) * 4 + c] = (unsigned char)((src[((2 * y) * srcSize + 2 * x) * 4 + c] + src[((2 * y) * srcSize + 2 * x + 1) * 4 + c] +
+																	src[((2 * y + 1) * srcSize + 2 * x) * 4 + c] + src[((2 * y + 1) * srcSize + 2 * x + 1) * 4 + c] + 2) / 4);
 
-		auto pos = textureName.find("texture/");
+		src = dest;
+	}
 
-		if (pos != std::string::npos)
-			textureName.insert(pos + 8, "unsorted/");
+	std::lock_guard<std::mutex> lock(textureImageCacheMutex);
 
-		textureName = "data/" + textureName;
+	std::weak_ptr<std::vector<unsigned char>> &cached = textureImageCache[name];
 
-		// load texture as RGBA (4 channels)
-		int width = 0, height = 0, nrChannels = 0;
-		unsigned char *data = stbi_load(textureName.c_str(), &width, &height, &nrChannels, 4);
+	if (std::shared_ptr<std::vector<unsigned char>> existing = cached.lock()) // another thread decoded the same texture meanwhile
+		return existing;
+
+	cached = image;
+	return image;
+}
 
-		if (!data) // load failed — use 256 x 256 white fallback
+//! Builds tile's terrain surface vertex data: one compact vertex per grid point (65 x 65), drawn with terrain's shared grid index buffer; position x / z, texture coords and chunk textures are derived in shaders.
+void Terrain::getTerrainVertices(TileTerrain *tile)
+{
+	tile->terrainVertices.resize(VerticesInTileRow * VerticesInTileCol);
+
+	// loop through each vertex in tile (row → z axis, col → x axis)
+	for (int v = 0, row = 0; row < VerticesInTileRow; row++)
+	{
+		for (int col = 0; col < VerticesInTileCol; col++, v++)
 		{
-			std::cout << "[Warning] Failed to load texture: " << textureName << "\n"
-					  << "          Using fallback white 256x256 texture." << std::endl;
-			trnTextures[i] = alloc_white_256();
+			TerrainVertex &vertex = tile->terrainVertices[v];
+			glm::vec3 n = tile->normals[row][col];
+
+			vertex.height = (short)std::lround(tile->Y[row][col] * 100.0f); // back to .trn units; shader applies height scaling
+			vertex.padding = 0;
+			vertex.normal = glm::i8vec4(std::lround(n.x * 127.0f), std::lround(n.y * 127.0f), std::lround(n.z * 127.0f), 0);
+			vertex.color = tile->colors[row][col]; // "vertex color" in combination with mask layer texture determine blending weights for 3 main textures in fragment shader
 		}
-		else if (width != TERRAIN_TEXTURE_RESOLUTION || height != TERRAIN_TEXTURE_RESOLUTION) // load success but resolution mismatch — resize to 256 x 256
+	}
+
+	tile->terrainVertexCount = tile->terrainVertices.size();
+
+	// height range of each chunk
+	for (int index = 0, row = 0; row < ChunksInTileRow; row++)
+	{
+		for (int col = 0; col < ChunksInTileCol; col++, index++)
 		{
-			unsigned char *resized = resize_to_256(data, width, height);
-			stbi_image_free(data);
+			tile->chunkMinY[index] = FLT_MAX;
+			tile->chunkMaxY[index] = -FLT_MAX;
 
-			if (resized) // resize success
-			{
-				std::cout << "[Info] Resized texture " << textureName << " from " << width << "x" << height << " to " << TERRAIN_TEXTURE_RESOLUTION << "x" << TERRAIN_TEXTURE_RESOLUTION << "." << std::endl;
-				trnTextures[i] = resized;
-			}
-			else // resize failed — use 256 x 256 white fallback
+			for (int r = row * UnitsInChunkCol; r <= (row + 1) * UnitsInChunkCol; r++)
 			{
-				std::cout << "[Warning] Failed to resize texture: " << textureName << std::endl;
-				trnTextures[i] = alloc_white_256();
+				for (int c = col * UnitsInChunkRow; c <= (col + 1) * UnitsInChunkRow; c++)
+				{
+					tile->chunkMinY[index] = std::min(tile->chunkMinY[index], tile->Y[r][c]);
+					tile->chunkMaxY[index] = std::max(tile->chunkMaxY[index], tile->Y[r][c]);
+				}
 			}
 		}
-		else // load success (normal case)
-			trnTextures[i] = data;
 	}
 
-	// loop through each tile in the terrain
-	for (int i = 0; i < tilesX; i++)
+	// coarse height map for occlusion culling: each vertex takes the lowest height of the cells around it, so the coarse surface never rises above the real one (an occluder may hide less than it should, but never more)
+	for (int row = 0; row < OccluderVerticesInTileRow; row++)
 	{
-		for (int j = 0; j < tilesZ; j++)
+		for (int col = 0; col < OccluderVerticesInTileRow; col++)
 		{
-			TileTerrain *tile = tiles[i][j];
+			int r0 = std::max(0, (row - 1) * OccluderCellSize), r1 = std::min(UnitsInTileCol, (row + 1) * OccluderCellSize);
+			int c0 = std::max(0, (col - 1) * OccluderCellSize), c1 = std::min(UnitsInTileRow, (col + 1) * OccluderCellSize);
+			float minY = FLT_MAX;
 
-			if (!tile)
-				continue;
+			for (int r = r0; r <= r1; r++)
+				for (int c = c0; c <= c1; c++)
+					minY = std::min(minY, tile->Y[r][c]);
+
+			tile->occluderY[row][col] = minY;
+		}
+	}
+}
+
+//! Makes room for at least 'layerCount' layers in the global texture array, copying already uploaded layers into a larger array if needed (main thread only).
+void Terrain::reserveTextureLayers(int layerCount)
+{
+	if (layerCount <= textureArrayCapacity)
+		return;
 
-			// reserve expected capacity to avoid repeated reallocation (6 vertices per square unit, 20 floats per vertex)
-			tile->terrainVertices.reserve(UnitsInTileRow * UnitsInTileCol * 6 * 20);
+	int maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+	int capacity = std::max(textureArrayCapacity, TERRAIN_TEXTURE_MIN_ARRAY_LAYERS);
+
+	while (capacity < layerCount)
+		capacity *= 2;
+
+	capacity = std::min(capacity, maxLayers);
+
+	if (capacity <= textureArrayCapacity)
+		return;
 
-			// build hash table (index in terrain's global texture list → index in tile's local texture array on GPU [0, 1, 2, ..]) to allow O(1) lookup when assigning texture indices to each chunk without scanning tile's texture list every time
-			std::unordered_map<int, int> mapGlobalToLocalTexIdx;
+	unsigned int newArray;
+	glGenTextures(1, &newArray);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, newArray);
 
-			for (int k = 0; k < tile->textureIndices.size(); k++)
-				mapGlobalToLocalTexIdx[tile->textureIndices[k]] = k;
+	for (int level = 0; level < TERRAIN_TEXTURE_MIP_LEVELS; level++)
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, TERRAIN_TEXTURE_RESOLUTION >> level, TERRAIN_TEXTURE_RESOLUTION >> level, capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL); // [FIX] for Windows compatibility
 
-			// loop through each square unit in tile
-			for (int col = 0; col < UnitsInTileCol; col++)
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, TERRAIN_TEXTURE_MIP_LEVELS - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	// copy uploaded layers GPU-side (each layer of each mip level is attached to a framebuffer as the copy source)
+	if (textureArray)
+	{
+		unsigned int framebuffer;
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+
+		for (int level = 0; level < TERRAIN_TEXTURE_MIP_LEVELS; level++)
+		{
+			for (int layer = 0; layer < textureArrayLayers; layer++)
 			{
-				for (int row = 0; row < UnitsInTileRow; row++)
-				{
-					/* 1 square unit (quad = 2 triangles = 6 vertices)
-
-					 (row, col)   (row, col+1)
-							•───────•
-							│     / │
-							│   /   │
-							│ /     │
-							•───────•
-					 (row+1, col)  (row + 1, col + 1) */
-
-					// values per square unit
-					float x0 = tile->startX + col;
-					float z0 = tile->startZ + row;
-					float x1 = x0 + 1.0f;
-					float z1 = z0 + 1.0f;
-
-					float y00 = tile->Y[row][col];
-					float y10 = tile->Y[row][col + 1];
-					float y01 = tile->Y[row + 1][col];
-					float y11 = tile->Y[row + 1][col + 1];
-
-					glm::vec3 n00 = tile->normals[row][col];
-					glm::vec3 n10 = tile->normals[row][col + 1];
-					glm::vec3 n01 = tile->normals[row + 1][col];
-					glm::vec3 n11 = tile->normals[row + 1][col + 1];
-
-					// "vertex color" in combination with mask layer texture determine blending weights for 3 main textures in fragment shader
-					// convert from [0, 255] to range [0, 1]
-					glm::vec4 blend00 = glm::vec4(tile->colors[row][col]) / 255.0f;
-					glm::vec4 blend10 = glm::vec4(tile->colors[row][col + 1]) / 255.0f;
-					glm::vec4 blend01 = glm::vec4(tile->colors[row + 1][col]) / 255.0f;
-					glm::vec4 blend11 = glm::vec4(tile->colors[row + 1][col + 1]) / 255.0f;
-
-					// values per 8 x 8 square units (per chunk)
-					float base_u0 = col / 8.0f;
-					float base_u1 = (col + 1) / 8.0f;
-					float base_v0 = row / 8.0f;
-					float base_v1 = (row + 1) / 8.0f;
-
-					ChunkInfo &chunk = tile->chunks[(row / 8) * ChunksInTileCol + col / 8]; // parent chunk that contains this square unit
-
-					float texIdx1 = mapGlobalToLocalTexIdx[chunk.texNameIndex1];
-					float texIdx2 = mapGlobalToLocalTexIdx[chunk.texNameIndex2];
-					float texIdx3 = mapGlobalToLocalTexIdx[chunk.texNameIndex3];
-
-					// values per 64 x 64 square units (per tile)
-					float mask_u0 = col / 64.0f;
-					float mask_u1 = (col + 1) / 64.0f;
-					float mask_v0 = row / 64.0f;
-					float mask_v1 = (row + 1) / 64.0f;
-
-					// 2 triangles forming a terrain surface quad (per square unit)
-					// each vertex is 20 floats: position coords (x, y, z), normal vector (nx, ny, nz), main texture coords (u, v), mask texture coords, 3 texture indices, vertex color (r, g, b, a), 3 barycentric coords
-					float quad[] = {
-						x0, y00, z0, n00.x, n00.y, n00.z, base_u0, base_v0, mask_u0, mask_v0, texIdx1, texIdx2, texIdx3, blend00[0], blend00[1], blend00[2], blend00[3], 1.0f, 0.0f, 0.0f,
-						x0, y01, z1, n01.x, n01.y, n01.z, base_u0, base_v1, mask_u0, mask_v1, texIdx1, texIdx2, texIdx3, blend01[0], blend01[1], blend01[2], blend01[3], 0.0f, 1.0f, 0.0f,
-						x1, y11, z1, n11.x, n11.y, n11.z, base_u1, base_v1, mask_u1, mask_v1, texIdx1, texIdx2, texIdx3, blend11[0], blend11[1], blend11[2], blend11[3], 0.0f, 0.0f, 1.0f,
-
-						x0, y00, z0, n00.x, n00.y, n00.z, base_u0, base_v0, mask_u0, mask_v0, texIdx1, texIdx2, texIdx3, blend00[0], blend00[1], blend00[2], blend00[3], 1.0f, 0.0f, 0.0f,
-						x1, y11, z1, n11.x, n11.y, n11.z, base_u1, base_v1, mask_u1, mask_v1, texIdx1, texIdx2, texIdx3, blend11[0], blend11[1], blend11[2], blend11[3], 0.0f, 0.0f, 1.0f,
-						x1, y10, z0, n10.x, n10.y, n10.z, base_u1, base_v0, mask_u1, mask_v0, texIdx1, texIdx2, texIdx3, blend10[0], blend10[1], blend10[2], blend10[3], 0.0f, 1.0f, 0.0f};
-
-					tile->terrainVertices.insert(tile->terrainVertices.end(), std::begin(quad), std::end(quad));
-				}
+				glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureArray, level, layer);
+				glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, 0, 0, TERRAIN_TEXTURE_RESOLUTION >> level, TERRAIN_TEXTURE_RESOLUTION >> level);
 			}
+		}
 
-			// upload tile's surface textures into a texture array on GPU — array where each element is a full image of the same size and format (it is more efficient than individual textures as binding several textures per draw call is slow; instead, fragment shader will sample from a single texture array using texture indices defined per chunk (not forget, each chunk has up to 3 textures))
-			if (!tile->textureIndices.empty())
-			{
-				int tileTextureCount = tile->textureIndices.size();
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &textureArray);
+	}
 
-				glGenTextures(1, &tile->textureMap);
-				glBindTexture(GL_TEXTURE_2D_ARRAY, tile->textureMap);
-				glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, TERRAIN_TEXTURE_RESOLUTION, TERRAIN_TEXTURE_RESOLUTION, tileTextureCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL); // [FIX] for Windows compatibility
+	textureArray = newArray;
+	textureArrayCapacity = capacity;
+}
 
-				for (int k = 0; k < tileTextureCount; k++)
-				{
-					int globalIdx = tile->textureIndices[k];
-					glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, k, TERRAIN_TEXTURE_RESOLUTION, TERRAIN_TEXTURE_RESOLUTION, 1, GL_RGBA, GL_UNSIGNED_BYTE, trnTextures[globalIdx]);
-				}
+//! Uploads tile's newly registered surface textures into the global texture array, then releases their CPU copies (main thread only).
+void Terrain::uploadTileTextures(TileTerrain *tile)
+{
+	// upload surface textures into terrain's global texture array on GPU — array where each element is a full image of the same size and format (it is more efficient than individual textures as binding several textures per draw call is slow; instead, fragment shader will sample from a single texture array using texture indices defined per chunk (not forget, each chunk has up to 3 textures))
+	// each unique texture is uploaded once, when the first tile that uses it is handed over (new names are registered at the end of the list, so they map to the next free layers)
+	for (int k = 0, n = tile->textureIndices.size(); k < n; k++)
+	{
+		int layer = tile->textureIndices[k];
 
-				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
-				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			}
+		if (layer < textureArrayLayers)
+			continue;
 
-			if (tile->terrainVertices.empty())
-				tile->terrainVertexCount = 0;
-			else
-				tile->terrainVertexCount = (int)(tile->terrainVertices.size() / 20);
+		reserveTextureLayers(layer + 1);
+
+		if (layer >= textureArrayCapacity)
+		{
+			std::cout << "[Warning] Terrain texture array is full, texture not uploaded: " << tile->textureNames[k] << std::endl;
+			continue;
 		}
+
+		if (!tile->textureImages[k]) // not expected: images are only skipped for textures already on GPU
+			continue;
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+
+		const unsigned char *mip = tile->textureImages[k]->data();
+
+		for (int level = 0; level < TERRAIN_TEXTURE_MIP_LEVELS; level++)
+		{
+			int size = TERRAIN_TEXTURE_RESOLUTION >> level;
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE, mip);
+			mip += size * size * 4;
+		}
+
+		textureArrayLayers = layer + 1;
+
+		std::lock_guard<std::mutex> lock(textureImageCacheMutex);
+		uploadedTextureNames.insert(tile->textureNames[k]);
 	}
 
-	for (int i = 0, n = trnTextures.size(); i < n; i++)
-		if (trnTextures[i])
-			stbi_image_free(trnTextures[i]);
+	std::vector<std::shared_ptr<std::vector<unsigned char>>>().swap(tile->textureImages); // release decoded images (freed once no tile being loaded shares them)
 }
 
-//! Builds flat water surface vertex data for each terrain chunk that contains water (water is defined and rendered per chunk, not per unit).
-void Terrain::getWaterVertices()
+//! Builds tile's flat water surface vertex data: water is defined per chunk, and neighbor chunks with the same water level are merged into larger rectangles (greedy meshing).
+void Terrain::getWaterVertices(TileTerrain *tile)
 {
 	const float UnitsInChunk = UnitsInTileRow / ChunksInTileRow; // length of one chunk in world space units along 1 dimension
 
-	// loop through each tile in the terrain
-	for (int i = 0; i < tilesX; i++)
+	// water level of each chunk in a tile (0 → no water)
+	int level[ChunksInTileCol][ChunksInTileRow];
+
+	for (int col = 0; col < ChunksInTileCol; col++)
 	{
-		for (int j = 0; j < tilesZ; j++)
+		for (int row = 0; row < ChunksInTileRow; row++)
 		{
-			TileTerrain *tile = tiles[i][j];
+			ChunkInfo &chunk = tile->chunks[col * ChunksInTileRow + row];
 
-			if (!tile || !tile->chunks)
-				continue;
+			// [TODO] differ by liquid type
+			// skip chunks without water or with invalid water level
+			if (!(chunk.flag & TRNF_HASWATER) || chunk.waterLevel == 0 || chunk.waterLevel == -5000)
+				level[col][row] = 0;
+			else
+				level[col][row] = chunk.waterLevel;
+		}
+	}
 
-			// loop through each chunk in a tile
-			for (int col = 0; col < ChunksInTileCol; col++)
-			{
-				for (int row = 0; row < ChunksInTileRow; row++)
-				{
-					ChunkInfo &chunk = tile->chunks[col * ChunksInTileRow + row];
+	// take the first chunk with water not covered yet, grow a rectangle from it along X as far as the water level stays the same, then along Z while whole rows match
+	for (int col = 0; col < ChunksInTileCol; col++)
+	{
+		for (int row = 0; row < ChunksInTileRow; row++)
+		{
+			int waterLevel = level[col][row];
 
-					// [TODO] differ by liquid type
-					// skip chunks without water or with invalid water level
-					if (!(chunk.flag & TRNF_HASWATER) || chunk.waterLevel == 0 || chunk.waterLevel == -5000)
-						continue;
+			if (waterLevel == 0)
+				continue;
 
-					// chunk water height in world space coordinates
-					float y = chunk.waterLevel * 0.01f;
+			int width = 1, height = 1;
 
-					// chunk corners in world space coordinates
-					float x0 = tile->startX + row * UnitsInChunk;
-					float z0 = tile->startZ + col * UnitsInChunk;
-					float x1 = x0 + UnitsInChunk;
-					float z1 = z0 + UnitsInChunk;
+			while (row + width < ChunksInTileRow && level[col][row + width] == waterLevel)
+				width++;
 
-					// texture coordinates (simple mapping)
-					float u0 = x0, v0 = z0, u1 = x1, v1 = z1;
+			while (col + height < ChunksInTileCol)
+			{
+				int k = 0;
 
-					// 2 triangles forming a water surface quad (per chunk square)
-					// each vertex is 8 floats: position coords (x, y, z), normal vector (nx, ny, nz), texture coords (u, v)
-					float quad[] = {
-						x0, y, z0, 0.0f, 1.0f, 0.0f, u0, v0,
-						x1, y, z0, 0.0f, 1.0f, 0.0f, u1, v0,
-						x1, y, z1, 0.0f, 1.0f, 0.0f, u1, v1,
+				while (k < width && level[col + height][row + k] == waterLevel)
+					k++;
 
-						x0, y, z0, 0.0f, 1.0f, 0.0f, u0, v0,
-						x1, y, z1, 0.0f, 1.0f, 0.0f, u1, v1,
-						x0, y, z1, 0.0f, 1.0f, 0.0f, u0, v1};
+				if (k < width)
+					break;
 
-					tile->water.vertices.insert(tile->water.vertices.end(), std::begin(quad), std::end(quad));
-				}
+				height++;
 			}
 
-			tile->water.waterVertexCount = tile->water.vertices.size() / 8;
+			// mark covered chunks
+			for (int c = col; c < col + height; c++)
+				for (int r = row; r < row + width; r++)
+					level[c][r] = 0;
+
+			// rectangle's water height and corners in world space coordinates
+			float y = waterLevel * 0.01f;
+			float x0 = tile->startX + row * UnitsInChunk;
+			float z0 = tile->startZ + col * UnitsInChunk;
+			float x1 = x0 + width * UnitsInChunk;
+			float z1 = z0 + height * UnitsInChunk;
+
+			// 2 triangles forming a water surface quad
+			// each vertex is 3 floats: position coords (x, y, z); normal vector and texture coordinates are derived from them in the shader
+			float quad[] = {
+				x0, y, z0,
+				x1, y, z0,
+				x1, y, z1,
+
+				x0, y, z0,
+				x1, y, z1,
+				x0, y, z1};
+
+			tile->waterVertices.insert(tile->waterVertices.end(), std::begin(quad), std::end(quad));
 		}
 	}
 }
@@ -787,152 +1212,145 @@ void Terrain::getWaterVertices()
 	}
 */
 
-void Terrain::getPhysicsVertices()
+//! Builds tile's physics geometry vertex data and releases parsed physics models.
+void Terrain::getPhysicsVertices(TileTerrain *tile)
 {
-	for (int i = 0; i < tilesX; i++)
+	if (tile->physicsGeometry.empty())
+		return;
+
+	for (Physics *headGeom : tile->physicsGeometry)
 	{
-		for (int j = 0; j < tilesZ; j++)
+		for (Physics *geom = headGeom; geom; geom = geom->pNext)
 		{
-			TileTerrain *tile = tiles[i][j];
+			int type = geom->geometryType;
 
-			if (!tile || tile->physicsGeometry.empty())
-				continue;
-
-			for (Physics *headGeom : tile->physicsGeometry)
+			if (type == PHYSICS_GEOM_TYPE_BOX)
 			{
-				for (Physics *geom = headGeom; geom; geom = geom->pNext)
+				VEC3 &h = geom->halfSize;
+
+				VEC3 v[8] = {
+					{-h.X, +h.Y, -h.Z},
+					{+h.X, +h.Y, -h.Z},
+					{+h.X, -h.Y, -h.Z},
+					{-h.X, -h.Y, -h.Z},
+					{-h.X, +h.Y, +h.Z},
+					{+h.X, +h.Y, +h.Z},
+					{+h.X, -h.Y, +h.Z},
+					{-h.X, -h.Y, +h.Z}};
+
+				for (VEC3 &vv : v)
+					geom->model.transformVect(vv);
+
+				int F[6][4] = {
+					{0, 1, 2, 3},
+					{5, 4, 7, 6},
+					{0, 3, 7, 4},
+					{1, 5, 6, 2},
+					{0, 4, 5, 1},
+					{3, 2, 6, 7}};
+
+				for (int f = 0; f < 6; f++)
 				{
-					int type = geom->geometryType;
-
-					if (type == PHYSICS_GEOM_TYPE_BOX)
-					{
-						VEC3 &h = geom->halfSize;
-
-						VEC3 v[8] = {
-							{-h.X, +h.Y, -h.Z},
-							{+h.X, +h.Y, -h.Z},
-							{+h.X, -h.Y, -h.Z},
-							{-h.X, -h.Y, -h.Z},
-							{-h.X, +h.Y, +h.Z},
-							{+h.X, +h.Y, +h.Z},
-							{+h.X, -h.Y, +h.Z},
-							{-h.X, -h.Y, +h.Z}};
-
-						for (VEC3 &vv : v)
-							geom->model.transformVect(vv);
-
-						int F[6][4] = {
-							{0, 1, 2, 3},
-							{5, 4, 7, 6},
-							{0, 3, 7, 4},
-							{1, 5, 6, 2},
-							{0, 4, 5, 1},
-							{3, 2, 6, 7}};
-
-						for (int f = 0; f < 6; f++)
-						{
-							int a = F[f][0], b = F[f][1], c = F[f][2], d = F[f][3];
-							tile->physicsVertices.insert(tile->physicsVertices.end(), {v[a].X, v[a].Y, v[a].Z, v[b].X, v[b].Y, v[b].Z, v[c].X, v[c].Y, v[c].Z,
-																					   v[a].X, v[a].Y, v[a].Z, v[c].X, v[c].Y, v[c].Z, v[d].X, v[d].Y, v[d].Z});
-						}
-					}
-					else if (type == PHYSICS_GEOM_TYPE_CYLINDER)
-					{
-						const int CUT_NUM = 16;
-						const float pi = 3.14159265359f;
-						float angle_step = 2.0f * pi / CUT_NUM;
-						float radius = geom->halfSize.X;
-						float height = geom->halfSize.Y;
+					int a = F[f][0], b = F[f][1], c = F[f][2], d = F[f][3];
+					tile->physicsVertices.insert(tile->physicsVertices.end(), {v[a].X, v[a].Y, v[a].Z, v[b].X, v[b].Y, v[b].Z, v[c].X, v[c].Y, v[c].Z,
+																			   v[a].X, v[a].Y, v[a].Z, v[c].X, v[c].Y, v[c].Z, v[d].X, v[d].Y, v[d].Z});
+				}
+			}
+			else if (type == PHYSICS_GEOM_TYPE_CYLINDER)
+			{
+				const int CUT_NUM = 16;
+				const float pi = 3.14159265359f;
+				float angle_step = 2.0f * pi / CUT_NUM;
+				float radius = geom->halfSize.X;
+				float height = geom->halfSize.Y;
 
-						int myoffset = 0.0f;
+				int myoffset = 0.0f;
 
-						VEC3 centerBottom(myoffset, -height, -myoffset);
-						VEC3 centerTop(myoffset, height, -myoffset);
-						geom->model.transformVect(centerBottom);
-						geom->model.transformVect(centerTop);
+				VEC3 centerBottom(myoffset, -height, -myoffset);
+				VEC3 centerTop(myoffset, height, -myoffset);
+				geom->model.transformVect(centerBottom);
+				geom->model.transformVect(centerTop);
 
-						for (int s = 0; s < CUT_NUM; s++)
-						{
-							float angle0 = s * angle_step;
-							float angle1 = (s + 1) * angle_step;
+				for (int s = 0; s < CUT_NUM; s++)
+				{
+					float angle0 = s * angle_step;
+					float angle1 = (s + 1) * angle_step;
 
-							float x0 = radius * cosf(angle0) + myoffset, z0 = radius * sinf(angle0) - myoffset;
-							float x1 = radius * cosf(angle1) + myoffset, z1 = radius * sinf(angle1) - myoffset;
+					float x0 = radius * cosf(angle0) + myoffset, z0 = radius * sinf(angle0) - myoffset;
+					float x1 = radius * cosf(angle1) + myoffset, z1 = radius * sinf(angle1) - myoffset;
 
-							VEC3 b0(x0, -height, z0);
-							VEC3 b1(x1, -height, z1);
-							VEC3 t0(x0, +height, z0);
-							VEC3 t1(x1, +height, z1);
+					VEC3 b0(x0, -height, z0);
+					VEC3 b1(x1, -height, z1);
+					VEC3 t0(x0, +height, z0);
+					VEC3 t1(x1, +height, z1);
 
-							geom->model.transformVect(b0);
-							geom->model.transformVect(b1);
-							geom->model.transformVect(t0);
-							geom->model.transformVect(t1);
+					geom->model.transformVect(b0);
+					geom->model.transformVect(b1);
+					geom->model.transformVect(t0);
+					geom->model.transformVect(t1);
 
-							tile->physicsVertices.insert(tile->physicsVertices.end(), {b1.X, b1.Y, b1.Z,
-																					   b0.X, b0.Y, b0.Z,
-																					   centerBottom.X, centerBottom.Y, centerBottom.Z});
+					tile->physicsVertices.insert(tile->physicsVertices.end(), {b1.X, b1.Y, b1.Z,
+																			   b0.X, b0.Y, b0.Z,
+																			   centerBottom.X, centerBottom.Y, centerBottom.Z});
 
-							tile->physicsVertices.insert(tile->physicsVertices.end(), {t0.X, t0.Y, t0.Z,
-																					   t1.X, t1.Y, t1.Z,
-																					   centerTop.X, centerTop.Y, centerTop.Z});
+					tile->physicsVertices.insert(tile->physicsVertices.end(), {t0.X, t0.Y, t0.Z,
+																			   t1.X, t1.Y, t1.Z,
+																			   centerTop.X, centerTop.Y, centerTop.Z});
 
-							tile->physicsVertices.insert(tile->physicsVertices.end(), {b0.X, b0.Y, b0.Z,
-																					   t0.X, t0.Y, t0.Z,
-																					   t1.X, t1.Y, t1.Z});
+					tile->physicsVertices.insert(tile->physicsVertices.end(), {b0.X, b0.Y, b0.Z,
+																			   t0.X, t0.Y, t0.Z,
+																			   t1.X, t1.Y, t1.Z});
 
-							tile->physicsVertices.insert(tile->physicsVertices.end(), {b0.X, b0.Y, b0.Z,
-																					   t1.X, t1.Y, t1.Z,
-																					   b1.X, b1.Y, b1.Z});
-						}
-					}
-					else if (type == PHYSICS_GEOM_TYPE_MESH)
-					{
-						const auto *facePtr = geom->mesh ? &geom->mesh->second : nullptr;
-						const auto *vertPtr = geom->mesh ? &geom->mesh->first : nullptr;
+					tile->physicsVertices.insert(tile->physicsVertices.end(), {b0.X, b0.Y, b0.Z,
+																			   t1.X, t1.Y, t1.Z,
+																			   b1.X, b1.Y, b1.Z});
+				}
+			}
+			else if (type == PHYSICS_GEOM_TYPE_MESH)
+			{
+				const auto *facePtr = geom->mesh ? &geom->mesh->second : nullptr;
+				const auto *vertPtr = geom->mesh ? &geom->mesh->first : nullptr;
 
-						if (!facePtr || !vertPtr || facePtr->empty() || vertPtr->empty())
-							continue;
+				if (!facePtr || !vertPtr || facePtr->empty() || vertPtr->empty())
+					continue;
 
-						const float RENDER_H_OFF = 0.10f;
-						int F = static_cast<int>(facePtr->size() / PHYSICS_FACE_SIZE);
-						const auto &face = *facePtr;
-						const auto &vert = *vertPtr;
+				const float RENDER_H_OFF = 0.10f;
+				int F = static_cast<int>(facePtr->size() / PHYSICS_FACE_SIZE);
+				const auto &face = *facePtr;
+				const auto &vert = *vertPtr;
 
-						for (int f = 0; f < F; ++f)
-						{
-							int a = face[4 * f];
-							int b = face[4 * f + 1];
-							int c = face[4 * f + 2];
+				for (int f = 0; f < F; ++f)
+				{
+					int a = face[4 * f];
+					int b = face[4 * f + 1];
+					int c = face[4 * f + 2];
 
-							// guard against bad indices
-							if ((3 * a + 2) >= (int)vert.size() || (3 * b + 2) >= (int)vert.size() || (3 * c + 2) >= (int)vert.size())
-								continue;
+					// guard against bad indices
+					if ((3 * a + 2) >= (int)vert.size() || (3 * b + 2) >= (int)vert.size() || (3 * c + 2) >= (int)vert.size())
+						continue;
 
-							VEC3 v0(vert[3 * a], vert[3 * a + 1] + RENDER_H_OFF, -vert[3 * a + 2]);
-							VEC3 v1(vert[3 * b], vert[3 * b + 1] + RENDER_H_OFF, -vert[3 * b + 2]);
-							VEC3 v2(vert[3 * c], vert[3 * c + 1] + RENDER_H_OFF, -vert[3 * c + 2]);
+					VEC3 v0(vert[3 * a], vert[3 * a + 1] + RENDER_H_OFF, -vert[3 * a + 2]);
+					VEC3 v1(vert[3 * b], vert[3 * b + 1] + RENDER_H_OFF, -vert[3 * b + 2]);
+					VEC3 v2(vert[3 * c], vert[3 * c + 1] + RENDER_H_OFF, -vert[3 * c + 2]);
 
-							geom->model.transformVect(v0);
-							geom->model.transformVect(v1);
-							geom->model.transformVect(v2);
+					geom->model.transformVect(v0);
+					geom->model.transformVect(v1);
+					geom->model.transformVect(v2);
 
-							tile->physicsVertices.insert(tile->physicsVertices.end(), {v0.X, v0.Y, v0.Z,
-																					   v2.X, v2.Y, v2.Z,
-																					   v1.X, v1.Y, v1.Z});
-						}
-					}
+					tile->physicsVertices.insert(tile->physicsVertices.end(), {v0.X, v0.Y, v0.Z,
+																			   v2.X, v2.Y, v2.Z,
+																			   v1.X, v1.Y, v1.Z});
 				}
 			}
-
-			tile->physicsVertexCount = tile->physicsVertices.size() / 3;
-
-			for (Physics *p : tile->physicsGeometry)
-				delete p;
-
-			tile->physicsGeometry.clear();
 		}
 	}
+
+	tile->physicsVertexCount = tile->physicsVertices.size() / 3;
+
+	for (Physics *p : tile->physicsGeometry)
+		delete p;
+
+	tile->physicsGeometry.clear();
 }
 
 //! Uploads tile to GPU (GPU-side tile loading, called per-frame for all tiles that need to be activated).
@@ -947,37 +1365,14 @@ void Terrain::activateTile(TileTerrain *tile)
 		glGenBuffers(1, &tile->trnVBO);
 		glBindVertexArray(tile->trnVAO);
 		glBindBuffer(GL_ARRAY_BUFFER, tile->trnVBO);
-		glBufferData(GL_ARRAY_BUFFER, tile->terrainVertices.size() * sizeof(float), tile->terrainVertices.data(), GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 20 * sizeof(float), (void *)0);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 20 * sizeof(float), (void *)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 20 * sizeof(float), (void *)(6 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 20 * sizeof(float), (void *)(8 * sizeof(float)));
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 20 * sizeof(float), (void *)(10 * sizeof(float)));
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 20 * sizeof(float), (void *)(13 * sizeof(float)));
-		glEnableVertexAttribArray(5);
-		glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, 20 * sizeof(float), (void *)(17 * sizeof(float)));
-		glEnableVertexAttribArray(6);
-		glBindVertexArray(0);
-	}
-
-	if (!tile->water.vertices.empty())
-	{
-		glGenVertexArrays(1, &tile->water.VAO);
-		glGenBuffers(1, &tile->water.VBO);
-		glBindVertexArray(tile->water.VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, tile->water.VBO);
-		glBufferData(GL_ARRAY_BUFFER, tile->water.vertices.size() * sizeof(float), tile->water.vertices.data(), GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, tile->terrainVertices.size() * sizeof(TerrainVertex), tile->terrainVertices.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 1, GL_SHORT, GL_FALSE, sizeof(TerrainVertex), (void *)offsetof(TerrainVertex, height));
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
+		glVertexAttribPointer(1, 3, GL_BYTE, GL_TRUE, sizeof(TerrainVertex), (void *)offsetof(TerrainVertex, normal));
 		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TerrainVertex), (void *)offsetof(TerrainVertex, color));
 		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridEBO); // shared by all tiles, recorded in tile's VAO
 		glBindVertexArray(0);
 	}
 
@@ -1005,36 +1400,10 @@ void Terrain::activateTile(TileTerrain *tile)
 		glBindVertexArray(0);
 	}
 
-	for (auto &m : tile->models)
-	{
-		std::shared_ptr<Model> model = m.first;
-
-		if (model && model->modelLoaded)
-		{
-			model->EBOs.resize(model->totalSubmeshCount);
-			glGenVertexArrays(1, &model->VAO);
-			glGenBuffers(1, &model->VBO);
-			glGenBuffers(model->totalSubmeshCount, model->EBOs.data());
-			glBindVertexArray(model->VAO);
-			glBindBuffer(GL_ARRAY_BUFFER, model->VBO);
-			glBufferData(GL_ARRAY_BUFFER, model->vertices.size() * sizeof(Vertex), model->vertices.data(), GL_STATIC_DRAW);
-
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(3 * sizeof(float)));
-			glEnableVertexAttribArray(1);
-			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(6 * sizeof(float)));
-			glEnableVertexAttribArray(2);
-
-			for (int i = 0; i < model->totalSubmeshCount; i++)
-			{
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->EBOs[i]);
-				glBufferData(GL_ELEMENT_ARRAY_BUFFER, model->indices[i].size() * sizeof(unsigned short), model->indices[i].data(), GL_STATIC_DRAW);
-			}
-
-			glBindVertexArray(0);
-		}
-	}
+	// 3D models are shared between tiles: their buffers are uploaded by the first active tile that places them
+	for (ModelInstance &instance : tile->models)
+		if (instance.model)
+			instance.model->acquireGPU();
 
 	tile->activated = true;
 }
@@ -1057,18 +1426,6 @@ void Terrain::deactivateTile(TileTerrain *tile)
 		tile->trnVBO = 0;
 	}
 
-	if (tile->water.VAO)
-	{
-		glDeleteVertexArrays(1, &tile->water.VAO);
-		tile->water.VAO = 0;
-	}
-
-	if (tile->water.VBO)
-	{
-		glDeleteBuffers(1, &tile->water.VBO);
-		tile->water.VBO = 0;
-	}
-
 	if (tile->phyVAO)
 	{
 		glDeleteVertexArrays(1, &tile->phyVAO);
@@ -1093,33 +1450,183 @@ void Terrain::deactivateTile(TileTerrain *tile)
 		tile->navVBO = 0;
 	}
 
-	for (auto &m : tile->models)
+	releaseTileMasks(tile);
+
+	// ... and released with the last one
+	for (ModelInstance &instance : tile->models)
+		if (instance.model)
+			instance.model->releaseGPU();
+
+	tile->activated = false;
+}
+
+//! Per-frame tile streaming: hands over tiles loaded in the background, starts loading tiles that entered the prefetch radius and frees tiles beyond the eviction radius or over the memory cap.
+void Terrain::updateStreaming()
+{
+	if (!terrainLoaded || tilesX == 0 || tilesZ == 0)
+		return;
+
+	frameCounter++;
+
+	// 1. hand over tiles loaded in the background: register and upload their textures, create their 3D models (main thread)
+	std::vector<StreamedTile> readyTiles;
+
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+
+		int count = std::min((int)streamedTiles.size(), maxTilesAddedPerFrame);
+		readyTiles.assign(streamedTiles.begin(), streamedTiles.begin() + count);
+		streamedTiles.erase(streamedTiles.begin(), streamedTiles.begin() + count);
+	}
+
+	for (StreamedTile &ready : readyTiles)
 	{
-		std::shared_ptr<Model> model = m.first;
+		// some of tile's models are parsed again — hand the tile over in a later frame instead of waiting here
+		if (ready.tile && !tileModelsReady(ready.tile))
+		{
+			std::lock_guard<std::mutex> lock(streamMutex);
+			streamedTiles.push_back(ready);
+			continue;
+		}
+
+		tilesLoading[ready.indexX][ready.indexZ] = false;
 
-		if (model && model->modelLoaded)
+		if (!ready.tile) // loading failed — do not retry
 		{
-			if (!model->EBOs.empty())
-			{
-				glDeleteBuffers(model->EBOs.size(), model->EBOs.data());
-				model->EBOs.clear();
-			}
+			tileFileIndices[ready.indexX][ready.indexZ] = -1;
+			continue;
+		}
 
-			if (model->VBO)
-			{
-				glDeleteBuffers(1, &model->VBO);
-				model->VBO = 0;
-			}
+		registerTileTextures(ready.tile);
+		uploadTileTextures(ready.tile);
+		resolveTileModels(ready.tile);
+
+		ready.tile->lastUsedFrame = frameCounter;
+		tiles[ready.indexX][ready.indexZ] = ready.tile;
+		loadedTileCount++;
+	}
+
+	// upload mask layers of tiles near the camera, read in the background
+	uploadTileMasks();
+
+	// forget finished jobs
+	tileJobs.erase(std::remove_if(tileJobs.begin(), tileJobs.end(), [](std::future<void> &job)
+								  { return job.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }),
+				   tileJobs.end());
+
+	// 2. start loading tiles inside the prefetch radius, nearest first
+	int cameraTileX = (int)std::floor(camera.Position.x / UnitsInTileRow) - tileMinX; // grid position of the tile the camera is currently above (may be outside the grid)
+	int cameraTileZ = (int)std::floor(camera.Position.z / UnitsInTileCol) - tileMinZ;
+
+	int x0 = std::max(0, cameraTileX - prefetchRadiusTiles);
+	int x1 = std::min(tilesX - 1, cameraTileX + prefetchRadiusTiles);
+	int z0 = std::max(0, cameraTileZ - prefetchRadiusTiles);
+	int z1 = std::min(tilesZ - 1, cameraTileZ + prefetchRadiusTiles);
+
+	std::vector<std::pair<float, glm::ivec2>> tilesToLoad; // (squared distance to camera, grid position)
+
+	for (int i = x0; i <= x1; i++)
+	{
+		for (int j = z0; j <= z1; j++)
+		{
+			// compute distance from camera to tile's center in world space coordinates
+			float dx = camera.Position.x - ((i + tileMinX) * UnitsInTileRow + 0.5f * UnitsInTileRow);
+			float dz = camera.Position.z - ((j + tileMinZ) * UnitsInTileCol + 0.5f * UnitsInTileCol);
+			float distSq = dx * dx + dz * dz;
+
+			if (distSq > prefetchRadiusSq)
+				continue;
+
+			if (tiles[i][j])
+				tiles[i][j]->lastUsedFrame = frameCounter;
+			else if (!tilesLoading[i][j] && tileFileIndices[i][j] != -1)
+				tilesToLoad.push_back({distSq, glm::ivec2(i, j)});
+		}
+	}
+
+	std::sort(tilesToLoad.begin(), tilesToLoad.end(), [](const std::pair<float, glm::ivec2> &a, const std::pair<float, glm::ivec2> &b)
+			  { return a.first < b.first; });
+
+	for (std::pair<float, glm::ivec2> &entry : tilesToLoad)
+	{
+		int indexX = entry.second.x;
+		int indexZ = entry.second.y;
+		int fileIndex = tileFileIndices[indexX][indexZ];
+
+		tilesLoading[indexX][indexZ] = true;
+		tileJobs.push_back(loadPool.enqueue([this, fileIndex, indexX, indexZ]()
+											{ loadTile(fileIndex, indexX, indexZ); }));
+	}
+
+	// 3. free tiles beyond the eviction radius, then least recently used tiles while over the memory cap
+	// (eviction radius is larger than the unload radius, so a tile is released from GPU before it is freed)
+	std::vector<std::pair<unsigned int, glm::ivec2>> evictionCandidates; // (last used frame, grid position)
+	int evictedCount = 0;
+
+	for (int i = 0; i < tilesX; i++)
+	{
+		for (int j = 0; j < tilesZ; j++)
+		{
+			TileTerrain *tile = tiles[i][j];
+
+			if (!tile)
+				continue;
 
-			if (model->VAO)
+			float dx = camera.Position.x - (tile->startX + 0.5f * UnitsInTileRow);
+			float dz = camera.Position.z - (tile->startZ + 0.5f * UnitsInTileCol);
+
+			if (dx * dx + dz * dz > evictRadiusSq)
 			{
-				glDeleteVertexArrays(1, &model->VAO);
-				model->VAO = 0;
+				evictTile(i, j);
+				evictedCount++;
 			}
+			else if (tile->lastUsedFrame != frameCounter) // tiles inside the prefetch radius are never evicted
+				evictionCandidates.push_back({tile->lastUsedFrame, glm::ivec2(i, j)});
 		}
 	}
 
-	tile->activated = false;
+	if (loadedTileCount > maxLoadedTiles)
+	{
+		std::sort(evictionCandidates.begin(), evictionCandidates.end(), [](const std::pair<unsigned int, glm::ivec2> &a, const std::pair<unsigned int, glm::ivec2> &b)
+				  { return a.first < b.first; });
+
+		for (int k = 0; k < (int)evictionCandidates.size() && loadedTileCount > maxLoadedTiles; k++)
+		{
+			evictTile(evictionCandidates[k].second.x, evictionCandidates[k].second.y);
+			evictedCount++;
+		}
+	}
+
+	// drop 3D models that are no longer used by any tile, so that their next request parses the file again
+	if (evictedCount > 0)
+	{
+		for (auto it = bdaeModelCache.begin(); it != bdaeModelCache.end();)
+		{
+			if (it->second.expired() && modelLoader.forget(it->first)) // failed models stay cached (see ModelLoader::forget)
+				it = bdaeModelCache.erase(it);
+			else
+				++it;
+		}
+	}
+}
+
+//! Frees tile from GPU and CPU memory.
+void Terrain::evictTile(int indexX, int indexZ)
+{
+	TileTerrain *tile = tiles[indexX][indexZ];
+
+	if (!tile)
+		return;
+
+	if (tile->activated)
+		deactivateTile(tile);
+
+	modelCount -= tile->models.size();
+	loadedTileCount--;
+
+	delete tile; // releases tile's textures and its references to shared 3D models
+	water.dirty = true; // water renderer may still hold tile's water surface (and a new tile may get the same memory)
+	tiles[indexX][indexZ] = NULL;
 }
 
 //! Computes which tiles will be rendered in the current frame based on camera position and orientation (distance-based culling + frustum culling).
@@ -1169,6 +1676,15 @@ void Terrain::updateVisibleTiles(glm::mat4 view, glm::mat4 projection)
 				activateTile(tile);
 			else if (distSq > unloadRadiusSq && tile->activated)
 				deactivateTile(tile);
+
+			// same scheme with a smaller radius for mask layers: they are only needed for chunks drawn in detail, and take most of tile's GPU memory
+			if (tile->activated)
+			{
+				if (distSq <= maskLoadRadiusSq && !tile->maskRequested)
+					requestTileMasks(i, j);
+				else if (distSq > maskUnloadRadiusSq && tile->maskRequested)
+					releaseTileMasks(tile);
+			}
 		}
 	}
 
@@ -1243,8 +1759,8 @@ void Terrain::updateVisibleTiles(glm::mat4 view, glm::mat4 projection)
 		return dist < 0.0f;
 	};
 
-	// build view frustum planes
-	glm::vec4 planes[6];
+	// build view frustum planes (kept for culling of 3D models, see cullModelInstances)
+	glm::vec4 *planes = frustumPlanes;
 
 	planes[0] = extractPlane(0, false); // left (w + x)
 	planes[1] = extractPlane(0, true);	// right (w - x)
@@ -1301,11 +1817,188 @@ void Terrain::updateVisibleTiles(glm::mat4 view, glm::mat4 projection)
 	}
 }
 
+//! Appends instance's world space bounding box to the batch.
+void Terrain::ModelCullBatch::add(ModelInstance &instance)
+{
+	centerX.push_back(instance.boundsCenter.x);
+	centerY.push_back(instance.boundsCenter.y);
+	centerZ.push_back(instance.boundsCenter.z);
+	extentX.push_back(instance.boundsExtent.x);
+	extentY.push_back(instance.boundsExtent.y);
+	extentZ.push_back(instance.boundsExtent.z);
+	instances.push_back(&instance);
+}
+
+//! Culls model instances collected in modelCullBatch: instances whose bounding box lies outside the view frustum or covers less than minModelScreenSize of the screen are marked invisible.
+void Terrain::cullModelInstances(float projectionScale)
+{
+	ModelCullBatch &batch = modelCullBatch;
+	int count = batch.instances.size();
+
+	batch.visible.resize(count);
+
+	const float *centerX = batch.centerX.data(), *centerY = batch.centerY.data(), *centerZ = batch.centerZ.data();
+	const float *extentX = batch.extentX.data(), *extentY = batch.extentY.data(), *extentZ = batch.extentZ.data();
+	unsigned char *visible = batch.visible.data();
+
+	// copy planes to local arrays: normals, their absolute values (project box's half size onto the normal) and distances
+	float nx[6], ny[6], nz[6], ax[6], ay[6], az[6], d[6];
+
+	for (int k = 0; k < 6; k++)
+	{
+		nx[k] = frustumPlanes[k].x, ax[k] = std::abs(nx[k]);
+		ny[k] = frustumPlanes[k].y, ay[k] = std::abs(ny[k]);
+		nz[k] = frustumPlanes[k].z, az[k] = std::abs(nz[k]);
+		d[k] = frustumPlanes[k].w;
+	}
+
+	// projected size of a bounding sphere (as a fraction of the screen height) ≈ radius * projectionScale / distance, compared squared to avoid square roots
+	float minSizeSq = (minModelScreenSize * minModelScreenSize) / (projectionScale * projectionScale);
+	float cameraX = camera.Position.x, cameraY = camera.Position.y, cameraZ = camera.Position.z;
+
+	int i = 0;
+
+#if defined(__SSE2__)
+	// 4 boxes per iteration: the same math as the scalar loop below, 1 box per SIMD lane
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(centerX + i), cy = _mm_loadu_ps(centerY + i), cz = _mm_loadu_ps(centerZ + i);
+		__m128 ex = _mm_loadu_ps(extentX + i), ey = _mm_loadu_ps(extentY + i), ez = _mm_loadu_ps(extentZ + i);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (int k = 0; k < 6; k++)
+		{
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(nx[k]), cx), _mm_mul_ps(_mm_set1_ps(ny[k]), cy)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(nz[k]), cz), _mm_set1_ps(d[k])));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(ax[k]), ex), _mm_mul_ps(_mm_set1_ps(ay[k]), ey)), _mm_mul_ps(_mm_set1_ps(az[k]), ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, radius), zero));
+		}
+
+		__m128 dx = _mm_sub_ps(cx, _mm_set1_ps(cameraX)), dy = _mm_sub_ps(cy, _mm_set1_ps(cameraY)), dz = _mm_sub_ps(cz, _mm_set1_ps(cameraZ));
+		__m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 radiusSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez));
+		__m128 largeEnough = _mm_cmpge_ps(radiusSq, _mm_mul_ps(_mm_set1_ps(minSizeSq), distSq));
+
+		int mask = _mm_movemask_ps(_mm_and_ps(inside, largeEnough)); // 1 bit per box
+
+		for (int j = 0; j < 4; j++)
+			visible[i + j] = (mask >> j) & 1;
+	}
+#endif
+
+	// remaining boxes (all of them without SSE)
+	for (; i < count; i++)
+	{
+		bool inside = true;
+
+		for (int k = 0; k < 6; k++)
+		{
+			// signed distance from the plane to the box center, plus box's half size projected onto plane normal: if negative, the whole box is behind the plane
+			float dist = nx[k] * centerX[i] + ny[k] * centerY[i] + nz[k] * centerZ[i] + d[k];
+			float radius = ax[k] * extentX[i] + ay[k] * extentY[i] + az[k] * extentZ[i];
+			inside &= (dist + radius >= 0.0f);
+		}
+
+		float dx = centerX[i] - cameraX, dy = centerY[i] - cameraY, dz = centerZ[i] - cameraZ;
+		float radiusSq = extentX[i] * extentX[i] + extentY[i] * extentY[i] + extentZ[i] * extentZ[i];
+		bool largeEnough = radiusSq >= minSizeSq * (dx * dx + dy * dy + dz * dz);
+
+		visible[i] = inside & largeEnough;
+	}
+}
+
+//! Rasterizes occluders of the current frame into the occlusion buffer and builds its hierarchical-Z pyramid: coarse terrain height maps of visible tiles within occluderRadiusTiles and the nearest large buildings that passed frustum culling.
+void Terrain::updateOcclusion(const glm::mat4 &view, const glm::mat4 &projection)
+{
+	occlusion.begin(projection * view);
+
+	// terrain near the camera (hills hide most of what is behind them; farther tiles cover too little of the screen to hide much)
+	float occluderRadius = (occluderRadiusTiles + 0.5f) * UnitsInTileRow;
+
+	for (TileTerrain *tile : tilesVisible)
+	{
+		if (!tile)
+			continue;
+
+		float dx = camera.Position.x - (tile->startX + 0.5f * UnitsInTileRow);
+		float dz = camera.Position.z - (tile->startZ + 0.5f * UnitsInTileCol);
+
+		if (dx * dx + dz * dz <= occluderRadius * occluderRadius)
+			occlusion.addHeightfield(&tile->occluderY[0][0], OccluderVerticesInTileRow, tile->startX, tile->startZ, OccluderCellSize);
+	}
+
+	// large buildings: model instances that passed frustum culling, have an occluder mesh and cover a large part of the screen (see cullModelInstances for the size estimate)
+	ModelCullBatch &batch = modelCullBatch;
+	float minSizeSq = (minOccluderScreenSize * minOccluderScreenSize) / (projection[1][1] * projection[1][1]);
+
+	auto distanceSq = [&](int i) -> float
+	{
+		float dx = batch.centerX[i] - camera.Position.x, dy = batch.centerY[i] - camera.Position.y, dz = batch.centerZ[i] - camera.Position.z;
+		return dx * dx + dy * dy + dz * dz;
+	};
+
+	occluderCandidates.clear();
+
+	for (int i = 0, n = (int)batch.instances.size(); i < n; i++)
+	{
+		if (!batch.visible[i] || batch.instances[i]->model->occluderTriangles.empty())
+			continue;
+
+		float radiusSq = batch.extentX[i] * batch.extentX[i] + batch.extentY[i] * batch.extentY[i] + batch.extentZ[i] * batch.extentZ[i];
+
+		if (radiusSq >= minSizeSq * distanceSq(i))
+			occluderCandidates.push_back(i);
+	}
+
+	// keep the nearest ones
+	if ((int)occluderCandidates.size() > maxOccludersPerFrame)
+	{
+		std::nth_element(occluderCandidates.begin(), occluderCandidates.begin() + maxOccludersPerFrame, occluderCandidates.end(), [&](int a, int b)
+						 { return distanceSq(a) < distanceSq(b); });
+		occluderCandidates.resize(maxOccludersPerFrame);
+	}
+
+	for (int i : occluderCandidates)
+	{
+		const ModelInstance &instance = *batch.instances[i];
+		const std::vector<glm::vec3> &triangles = instance.model->occluderTriangles;
+
+		occlusion.addTriangles(triangles.data(), triangles.size(), instance.transform);
+	}
+
+	occlusion.buildHiZ();
+}
+
 //! Clears CPU memory (resets viewer state).
 void Terrain::reset()
 {
 	terrainLoaded = false;
 
+	// wait for background tile loading, then free tiles it produced and its worker states
+	for (std::future<void> &job : tileJobs)
+		job.wait();
+
+	tileJobs.clear();
+
+	for (StreamedTile &streamed : streamedTiles)
+		delete streamed.tile;
+
+	streamedTiles.clear();
+	streamedMasks.clear();
+	water.dirty = true;
+
+	for (TileLoadContext *ctx : freeContexts)
+	{
+		delete ctx->terrainArchive;
+		delete ctx->itemsArchive;
+		delete ctx->masksArchive;
+		delete ctx->physicsArchive;
+		delete ctx;
+	}
+
+	freeContexts.clear();
+
 	tileMinX = tileMinZ = 1000;
 	tileMaxX = tileMaxZ = -1000;
 	tilesX = tilesZ = 0;
@@ -1319,15 +2012,31 @@ void Terrain::reset()
 	hill.reset();
 
 	tiles.clear();
+	tileFileIndices.clear();
+	tilesLoading.clear();
 	tilesVisible.clear();
 	sounds.clear();
+	archivePath.clear();
+	loadedTileCount = 0;
+	animationClock = 0.0f;
 
+	modelLoader.clear();
 	bdaeModelCache.clear();
 	physicsModelCache.clear();
+	textureImageCache.clear();
+	uploadedTextureNames.clear();
 	uniqueTextureNames.clear();
+
+	if (textureArray)
+	{
+		glDeleteTextures(1, &textureArray);
+		textureArray = 0;
+	}
+
+	textureArrayCapacity = textureArrayLayers = 0;
 }
 
-//! Renders terrain (.trn + .phy + .nav + .bdae).
+//! Renders terrain (.trn + .phy + .nav + .bdae): all draws of the frame are queued and submitted at once, sorted by state (see RenderQueue).
 void Terrain::draw(glm::mat4 view, glm::mat4 projection, bool simple, bool renderNavMesh, bool renderPhysics, float dt)
 {
 	if (!terrainLoaded)
@@ -1335,22 +2044,48 @@ void Terrain::draw(glm::mat4 view, glm::mat4 projection, bool simple, bool rende
 
 	shader.use();
 	shader.setMat4("model", glm::mat4(1.0f));
-	shader.setMat4("view", view);
-	shader.setMat4("projection", projection);
-	shader.setBool("lighting", light.showLighting);
 	shader.setVec3("lightPos", glm::vec3(camera.Position.x, camera.Position.y + 600.0f, camera.Position.z));
-	shader.setVec3("cameraPos", camera.Position);
 
-	// activate / deactivate tiles based on camera position and view
+	animationClock += dt; // advanced once per frame, not per drawn instance
+
+	// stream tiles in and out of memory, activate / deactivate them based on camera position and view
+	updateStreaming();
 	updateVisibleTiles(view, projection);
 
-	// render terrain
-	if (!simple)
-		shader.setInt("renderMode", 1);
-	else
-		shader.setInt("renderMode", 3);
+	// collect 3D models of visible tiles near the camera and test their bounding boxes at once (tiles are culled as a whole, but a visible tile may still hold many models behind the camera or too far to see)
+	for (TileTerrain *tile : tilesVisible)
+	{
+		if (!tile || tile->models.empty())
+			continue;
+
+		float dx = camera.Position.x - (tile->startX + 0.5f * UnitsInTileRow);
+		float dz = camera.Position.z - (tile->startZ + 0.5f * UnitsInTileCol);
+
+		if (dx * dx + dz * dz > modelVisibleRadiusSq)
+			continue;
+
+		for (ModelInstance &instance : tile->models)
+		{
+			if (instance.model)
+				modelCullBatch.add(instance);
+		}
+	}
 
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	cullModelInstances(projection[1][1]);
+
+	// software occlusion culling: terrain and large buildings near the camera are rasterized into a coarse depth buffer on CPU, and tiles, chunks and models hidden behind them are not submitted for drawing
+	updateOcclusion(view, projection);
+	occlusion.cullBoxes(modelCullBatch.centerX.data(), modelCullBatch.centerY.data(), modelCullBatch.centerZ.data(),
+						modelCullBatch.extentX.data(), modelCullBatch.extentY.data(), modelCullBatch.extentZ.data(),
+						modelCullBatch.instances.size(), modelCullBatch.visible.data());
+
+	// queue terrain
+	RenderItem item = {};
+	item.shader = &shader;
+	item.texture = textureArray; // surface textures of all tiles
+	item.textureTarget = GL_TEXTURE_2D_ARRAY;
+	item.submit = submitTile;
+	item.renderMode = simple ? 3 : 1;
 
 	for (TileTerrain *tile : tilesVisible)
 	{
@@ -1358,22 +2093,57 @@ void Terrain::draw(glm::mat4 view, glm::mat4 projection, bool simple, bool rende
 			continue;
 
 		// [TODO] fix minor valgrind runtime errors
-		if (tile->trnVAO == 0 || tile->trnVBO == 0 || tile->terrainVertexCount == 0 || !tile->textureMap)
+		if (tile->trnVAO == 0 || tile->trnVBO == 0 || tile->terrainVertexCount == 0)
 			continue;
 
-		glBindVertexArray(tile->trnVAO);
+		glm::vec3 tileBBoxMin(tile->BBox.MinEdge.X, tile->BBox.MinEdge.Y, tile->BBox.MinEdge.Z);
+		glm::vec3 tileBBoxMax(tile->BBox.MaxEdge.X, tile->BBox.MaxEdge.Y, tile->BBox.MaxEdge.Z);
+
+		if (!occlusion.isVisible(0.5f * (tileBBoxMin + tileBBoxMax), 0.5f * (tileBBoxMax - tileBBoxMin)))
+			continue;
+
+		// select LOD level of each chunk and of its neighbors (including chunks of neighbor tiles, as LOD depends on position only)
+		int lod[ChunksInTileRow + 2][ChunksInTileCol + 2];
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D_ARRAY, tile->textureMap);
+		for (int row = -1; row <= ChunksInTileRow; row++)
+			for (int col = -1; col <= ChunksInTileCol; col++)
+				lod[row + 1][col + 1] = getChunkLod(tile->startX + col * UnitsInChunkRow, tile->startZ + row * UnitsInChunkCol);
 
-		if (tile->maskTexture)
+		// record all chunks of the tile that are not hidden by occluders for 1 draw call: each chunk uses the triangulation for its level and its neighbors' levels, shifted to its position in the tile's grid by base vertex
+		tile->chunkDrawCount = 0;
+
+		for (int index = 0, row = 0; row < ChunksInTileRow; row++)
 		{
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, tile->maskTexture);
+			for (int col = 0; col < ChunksInTileCol; col++, index++)
+			{
+				int level = lod[row + 1][col + 1];
+				tile->chunkLodSteps[index] = 1 << level; // indexed by chunk position (see terrain fragment shader), so it is set for hidden chunks too
+
+				glm::vec3 chunkCenter(tile->startX + (col + 0.5f) * UnitsInChunkRow, 0.5f * (tile->chunkMinY[index] + tile->chunkMaxY[index]), tile->startZ + (row + 0.5f) * UnitsInChunkCol);
+				glm::vec3 chunkExtent(0.5f * UnitsInChunkRow, 0.5f * (tile->chunkMaxY[index] - tile->chunkMinY[index]), 0.5f * UnitsInChunkCol);
+
+				if (!occlusion.isVisible(chunkCenter, chunkExtent))
+					continue;
+
+				const ChunkPattern &pattern = getChunkPattern(level,
+															  std::max(level, lod[row][col + 1]),	  // north (z - 1)
+															  std::max(level, lod[row + 1][col + 2]), // east (x + 1)
+															  std::max(level, lod[row + 2][col + 1]), // south (z + 1)
+															  std::max(level, lod[row + 1][col]));	  // west (x - 1)
+
+				int draw = tile->chunkDrawCount++;
+				tile->chunkDrawCounts[draw] = pattern.indexCount;
+				tile->chunkDrawOffsets[draw] = (const void *)(pattern.firstIndex * sizeof(unsigned short));
+				tile->chunkDrawBaseVertices[draw] = row * UnitsInChunkCol * VerticesInTileCol + col * UnitsInChunkRow;
+			}
 		}
 
-		glDrawArrays(GL_TRIANGLES, 0, tile->terrainVertexCount);
-		glBindVertexArray(0);
+		if (tile->chunkDrawCount == 0)
+			continue;
+
+		item.vao = tile->trnVAO;
+		item.object = tile;
+		RenderQueue::add(RENDER_PASS_TERRAIN, item);
 	}
 
 	/*
@@ -1400,9 +2170,13 @@ void Terrain::draw(glm::mat4 view, glm::mat4 projection, bool simple, bool rende
 		}
 	*/
 
-	// render physics
+	// queue physics: translucent faces and their edges
 	if (renderPhysics)
 	{
+		RenderItem physicsItem = {};
+		physicsItem.shader = &shader;
+		physicsItem.submit = submitPhysics;
+
 		for (TileTerrain *tile : tilesVisible)
 		{
 			if (!tile)
@@ -1411,53 +2185,155 @@ void Terrain::draw(glm::mat4 view, glm::mat4 projection, bool simple, bool rende
 			if (tile->phyVAO == 0 || tile->phyVBO == 0)
 				continue;
 
-			glBindVertexArray(tile->phyVAO);
+			physicsItem.vao = tile->phyVAO;
+			physicsItem.count = tile->physicsVertexCount;
 
-			shader.setInt("renderMode", 4);
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			glDrawArrays(GL_TRIANGLES, 0, tile->physicsVertexCount);
+			physicsItem.renderMode = 4;
+			RenderQueue::add(RENDER_PASS_TRANSLUCENT, physicsItem);
 
-			shader.setInt("renderMode", 2);
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-			glDrawArrays(GL_TRIANGLES, 0, tile->physicsVertexCount);
-
-			glBindVertexArray(0);
+			physicsItem.renderMode = 2;
+			RenderQueue::add(RENDER_PASS_WIREFRAME, physicsItem);
 		}
 	}
 
-	// render water and 3D models
+	// queue water and 3D models
 	for (TileTerrain *tile : tilesVisible)
 	{
 		if (!tile)
 			continue;
 
-		tile->water.draw(view, projection, light.showLighting, simple, dt, camera.Position);
+		water.add(tile->waterVertices);
+	}
+
+	// models that passed frustum and occlusion culling (see above); culled instances do no animation work at all, as their playback time is derived from the shared clock when they are drawn again
+	animationStats = {0, 0, 0, 0};
+	Model::poseEvaluations = Model::poseTableSamples = 0;
 
-		if (tile->models.empty())
+	for (int i = 0, n = (int)modelCullBatch.instances.size(); i < n; i++)
+	{
+		if (!modelCullBatch.visible[i])
 			continue;
 
-		for (auto &model : tile->models)
+		ModelInstance &instance = *modelCullBatch.instances[i];
+		Model *modelData = instance.model.get();
+
+		// instances play from the shared clock, so a model is posed once per frame for all its instances with the same clip and phase
+		float clock = animationClock + instance.animation.phase;
+		float nextClock = clock, blend = 0.0f;
+
+		if (modelData->animationsLoaded && instance.animation.clip >= 0)
 		{
-			const std::shared_ptr<Model> &modelData = model.first;
-			const glm::mat4 &modelWorldTransform = model.second;
+			// farther instances update at the rate of their distance tier: the pose is blended between the tier's last and next update, whose poses are kept and shared until the update after
+			float dx = modelCullBatch.centerX[i] - camera.Position.x;
+			float dy = modelCullBatch.centerY[i] - camera.Position.y;
+			float dz = modelCullBatch.centerZ[i] - camera.Position.z;
+			float distanceSq = dx * dx + dy * dy + dz * dz;
+			float rate = 0.0f;
+
+			for (const AnimationTier &tier : animationTiers)
+			{
+				if (distanceSq >= tier.distance * tier.distance)
+					rate = tier.rate;
+			}
 
-			if (!modelData)
-				continue;
+			if (rate > 0.0f)
+			{
+				float update = std::floor(clock * rate);
+				blend = clock * rate - update;
+				clock = update / rate;
+				nextClock = (update + 1.0f) / rate;
+				animationStats.throttled++;
+			}
 
-			modelData->draw(modelWorldTransform, view, projection, camera.Position, dt, light.showLighting, simple);
+			animationStats.animated++;
 		}
+
+		float time = modelData->getClipTime(instance.animation.clip, clock);
+		float nextTime = modelData->getClipTime(instance.animation.clip, nextClock);
+		modelDrawList.push_back(ModelDrawItem{modelData, instance.animation.clip, time, nextTime, blend, &instance.transform});
+	}
+
+	modelCullBatch.clear();
+
+	// group visible instances by model and pose across all visible tiles, then draw each group with instanced draw calls (draw calls scale with unique models, not with placed entities)
+	std::sort(modelDrawList.begin(), modelDrawList.end(), [](const ModelDrawItem &a, const ModelDrawItem &b)
+			  {
+				  if (a.model != b.model)
+					  return a.model < b.model;
+				  if (a.clip != b.clip)
+					  return a.clip < b.clip;
+				  if (a.time != b.time)
+					  return a.time < b.time;
+				  if (a.nextTime != b.nextTime)
+					  return a.nextTime < b.nextTime;
+				  return a.blend < b.blend; });
+
+	for (size_t first = 0, last = 0; first < modelDrawList.size(); first = last)
+	{
+		const ModelDrawItem &group = modelDrawList[first];
+		instanceTransforms.clear();
+
+		for (last = first; last < modelDrawList.size() && modelDrawList[last].model == group.model && modelDrawList[last].clip == group.clip && modelDrawList[last].time == group.time && modelDrawList[last].nextTime == group.nextTime && modelDrawList[last].blend == group.blend; last++)
+			instanceTransforms.push_back(*modelDrawList[last].transform);
+
+		group.model->drawInstances(glm::mat4(1.0f), instanceTransforms.data(), instanceTransforms.size(), group.clip, group.time, simple, group.nextTime, group.blend);
 	}
 
-	// render skybox
+	modelDrawList.clear();
+
+	animationStats.poseEvaluations = Model::poseEvaluations;
+	animationStats.poseTableSamples = Model::poseTableSamples;
+
+	water.draw(dt); // water of all visible tiles with 1 draw call
+
+	// queue skybox (drawn last, behind everything, see RENDER_PASS_SKY)
 	if (!simple)
 	{
-		glDepthMask(GL_FALSE);
-		glDepthFunc(GL_LEQUAL);
-		sky.draw(glm::mat4(1.0f), glm::mat4(glm::mat3(view)), projection, camera.Position, dt, false, false);
-		hill.draw(glm::mat4(1.0f), glm::mat4(glm::mat3(view)), projection, camera.Position, dt, false, false);
-		glDepthFunc(GL_LESS);
-		glDepthMask(GL_TRUE);
+		sky.draw(glm::mat4(1.0f), -1, 0.0f, false); // skybox shader drops the camera translation from the view matrix itself
+		hill.draw(glm::mat4(1.0f), -1, 0.0f, false);
+	}
+
+	RenderQueue::flush();
+}
+
+//! Sets tile's uniforms and textures and issues its queued chunk draws (called by RenderQueue::flush with terrain's program, tile's vertex array and the surface texture array bound).
+void Terrain::submitTile(const RenderItem &item)
+{
+	TileTerrain *tile = (TileTerrain *)item.object;
+	Shader &shader = *item.shader;
+
+	shader.setInt("renderMode", item.renderMode);
+	shader.setBool("gridMesh", true);
+	shader.setVec2("tileOrigin", glm::vec2(tile->startX, tile->startZ));
+	shader.setIvec3Array("chunkTextures", ChunksInTile, tile->chunkTextures);
+	shader.setIntArray("chunkLodSteps", ChunksInTile, tile->chunkLodSteps);
+
+	// tiles far from the camera have no mask layers on GPU (see requestTileMasks) — they are drawn with the primary texture only
+	shader.setBool("hasMask", tile->maskTexture != 0);
+	shader.setBool("hasShadow", tile->shadowTexture != 0);
+
+	if (tile->maskTexture)
+	{
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, tile->maskTexture);
 	}
 
-	glBindVertexArray(0);
+	if (tile->shadowTexture)
+	{
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, tile->shadowTexture);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, tile->chunkDrawCounts, GL_UNSIGNED_SHORT, tile->chunkDrawOffsets, tile->chunkDrawCount, tile->chunkDrawBaseVertices);
+}
+
+//! Issues a queued draw of tile's physics geometry (called by RenderQueue::flush).
+void Terrain::submitPhysics(const RenderItem &item)
+{
+	item.shader->setInt("renderMode", item.renderMode);
+	item.shader->setBool("gridMesh", false);
+
+	glDrawArrays(GL_TRIANGLES, 0, item.count);
 }
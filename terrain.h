@@ -3,11 +3,17 @@
 
 #include <string>
 #include <vector>
+#include <mutex>
+#include <future>
+#include <unordered_map>
+#include <unordered_set>
 #include "libs/glm/glm.hpp"
 #include "shader.h"
 #include "camera.h"
 #include "sound.h"
 #include "light.h"
+#include "water.h"
+#include "occlusion.h"
 #include "libs/glm/fwd.hpp"
 #include "libs/glm/gtc/type_ptr.hpp"
 #include "libs/glm/gtc/constants.hpp"
@@ -15,10 +21,13 @@
 #include "libs/glm/ext/vector_uint4.hpp"
 #include "libs/glm/gtc/type_precision.hpp"
 #include "model.h"
+#include "modelLoader.h"
+#include "threadPool.h"
 #include "CZipResReader.h"
 #include "DetourNavMesh.h"
 
 class TileTerrain;
+struct ModelInstance;
 
 // Class for loading and rendering terrain.
 // ________________________________________
@@ -31,6 +40,7 @@ class Terrain
 	Light &light;
 	Model sky;
 	Model hill;
+	Water water; // renders water of all visible tiles
 	std::string fileName;
 	int fileSize, vertexCount, faceCount, modelCount;
 	std::vector<std::string> sounds;
@@ -40,19 +50,130 @@ class Terrain
 	int tileMinX, tileMinZ, tileMaxX, tileMaxZ;	   // terrain borders in tile numbers (indices)
 	int tilesX, tilesZ;							   // terrain size in tiles
 	bool terrainLoaded;
+	unsigned int gridEBO; // index buffer with triangulations of one 8 x 8 unit chunk of a tile's 65 x 65 vertex grid, shared by all chunks of all tiles
+
+	// range of gridEBO that triangulates a chunk at some LOD level, stitched to its neighbors' LOD levels
+	struct ChunkPattern
+	{
+		int firstIndex;
+		int indexCount;
+	};
+
+	std::vector<ChunkPattern> chunkPatterns; // indexed by (LOD level, north, east, south, west neighbor LOD level), see getChunkPattern
 
 	std::vector<std::string> uniqueTextureNames; // global unique texture names for terrain surface
+	unsigned int textureArray;					 // terrain's global texture array on GPU (one layer per unique texture name, with mipmaps)
+	int textureArrayCapacity;					 // number of allocated layers in textureArray (grows by doubling as new texture names are streamed in)
+	int textureArrayLayers;						 // number of uploaded layers in textureArray
+
+	ModelLoader modelLoader; // parses .bdae models of terrain entities on worker threads
+
+	// per-worker state for background tile loading (archive readers are not shared between threads)
+	struct TileLoadContext
+	{
+		CZipResReader *terrainArchive, *itemsArchive, *masksArchive, *physicsArchive;
+		std::vector<unsigned char> fileBuffer; // .trn read buffer
+		std::vector<unsigned char> maskBuffer; // .msk read buffer
+	};
+
+	// tile loaded in the background, waiting to be handed over to the main thread
+	struct StreamedTile
+	{
+		int indexX, indexZ; // position in the tiles grid
+		TileTerrain *tile;	// NULL if loading failed
+	};
+
+	// mask layers of a tile read in the background, waiting for GPU upload
+	struct StreamedMask
+	{
+		int indexX, indexZ;				   // position in the tiles grid
+		std::vector<unsigned char> blend;  // primary + secondary mask layers (RG), empty if the tile has no masks
+		std::vector<unsigned char> shadow; // pre-rendered shadows (R), empty if the tile has none
+	};
+
+	ThreadPool loadPool;									 // worker threads for background tile loading and mesh building
+	std::string archivePath;								 // .trn archive of the loaded map (.itm and .msk archives have the same name)
+	std::vector<std::vector<int>> tileFileIndices;			 // 2D grid of .trn file indices in the terrain archive (-1 → no tile at this position)
+	std::vector<std::vector<bool>> tilesLoading;			 // 2D grid of flags for tiles that are being loaded in the background
+	std::vector<std::future<void>> tileJobs;				 // background tile loading jobs in flight
+	std::vector<StreamedTile> streamedTiles;				 // loaded tiles, not yet handed over to the main thread
+	std::vector<StreamedMask> streamedMasks;				 // mask layers read in the background, not yet uploaded to GPU
+	std::vector<TileLoadContext *> freeContexts;			 // idle worker states, reused across jobs
+	std::mutex streamMutex;									 // guards streamedTiles, streamedMasks and freeContexts
+	std::unordered_map<std::string, std::weak_ptr<std::vector<unsigned char>>> textureImageCache; // decoded surface textures shared by tiles being loaded (key — texture name)
+	std::unordered_set<std::string> uploadedTextureNames;										 // surface textures already in textureArray (not decoded again)
+	std::mutex textureImageCacheMutex;															 // guards textureImageCache and uploadedTextureNames
+	unsigned int frameCounter;								 // number of streaming updates (timestamps for least recently used eviction)
+	int loadedTileCount;									 // number of tiles in CPU memory
+	float animationClock;									 // shared playback clock of all terrain model instances (see AnimationState)
+	std::vector<AnimationTier> animationTiers;				 // distance tiers of animation updates, sorted by distance (configurable; see AnimationTier); terrain models load no animation clips yet, so until they do, tiers and animationStats stay inactive
+
+	// animation work of the last frame
+	struct AnimationStats
+	{
+		int animated;		  // visible instances playing a clip
+		int throttled;		  // of them, instances in a tier that blends the pose between updates
+		int poseEvaluations;  // poses evaluated from animation tracks
+		int poseTableSamples; // poses read from pose tables
+	};
+
+	AnimationStats animationStats;
+
+	// visible model instance queued for instanced rendering (see draw)
+	struct ModelDrawItem
+	{
+		Model *model;
+		int clip;					// animation pose shared by the instances of one draw
+		float time;
+		float nextTime;				// throttled instances: pose blended from 'time' towards 'nextTime' by 'blend' (see AnimationTier)
+		float blend;
+		const glm::mat4 *transform; // instance's world matrix
+	};
+
+	// model instances of the current frame tested for visibility in 1 batch; stored as a structure of arrays, so that the test runs on several boxes per SIMD instruction (see cullModelInstances)
+	struct ModelCullBatch
+	{
+		std::vector<float> centerX, centerY, centerZ; // world space bounding box center
+		std::vector<float> extentX, extentY, extentZ; // world space bounding box half size
+		std::vector<ModelInstance *> instances;
+		std::vector<unsigned char> visible; // test result (1 → instance is drawn)
+
+		//! Appends instance's world space bounding box to the batch.
+		void add(ModelInstance &instance);
+
+		void clear()
+		{
+			centerX.clear(), centerY.clear(), centerZ.clear();
+			extentX.clear(), extentY.clear(), extentZ.clear();
+			instances.clear();
+			visible.clear();
+		}
+	};
+
+	glm::vec4 frustumPlanes[6];				   // view frustum planes of the current frame in world space (see updateVisibleTiles)
+	ModelCullBatch modelCullBatch;			   // model instances of visible tiles, before culling
+	OcclusionBuffer occlusion;				   // coarse CPU depth buffer of terrain and large buildings near the camera (see updateOcclusion)
+	std::vector<int> occluderCandidates;	   // large model instances of the current frame that may be rasterized as occluders (indices into modelCullBatch)
+	std::vector<ModelDrawItem> modelDrawList;  // visible model instances of the current frame, grouped by model and pose before drawing
+	std::vector<glm::mat4> instanceTransforms; // world matrices of one instanced draw
 
 	Terrain(Camera &cam, Light &light)
 		: shader("shaders/terrain.vs", "shaders/terrain.fs"),
-		  sky("shaders/skybox.vs", "shaders/skybox.fs"),
-		  hill("shaders/skybox.vs", "shaders/skybox.fs"),
 		  camera(cam),
 		  light(light),
+		  sky("shaders/skybox.vs", "shaders/skybox.fs"),
+		  hill("shaders/skybox.vs", "shaders/skybox.fs"),
 		  vertexCount(0), faceCount(0), modelCount(0),
 		  tileMinX(-1), tileMinZ(-1),
 		  tileMaxX(1), tileMaxZ(1),
-		  terrainLoaded(false)
+		  terrainLoaded(false),
+		  gridEBO(0),
+		  textureArray(0), textureArrayCapacity(0), textureArrayLayers(0),
+		  modelLoader(streamingThreadCount(true)),
+		  loadPool(streamingThreadCount(false)),
+		  frameCounter(0), loadedTileCount(0), animationClock(0.0f),
+		  animationTiers(std::begin(defaultAnimationTiers), std::end(defaultAnimationTiers)),
+		  animationStats{0, 0, 0, 0}
 	{
 		shader.use();
 		shader.setVec3("lightColor", lightColor);
@@ -61,26 +182,94 @@ class Terrain
 		shader.setFloat("specularStrength", specularStrength);
 		shader.setInt("baseTextureArray", 0);
 		shader.setInt("maskTexture", 1);
+		shader.setInt("shadowTexture", 2);
+
+		createGridIndexBuffer();
 	};
 
-	~Terrain() { reset(); }
+	~Terrain()
+	{
+		reset();
+		glDeleteBuffers(1, &gridEBO);
+	}
+
+	//! Splits hardware threads between model parsing and tile loading: tile workers mostly wait for their models (see loadTile), so both pools together match the core count.
+	static unsigned int streamingThreadCount(bool modelParsing)
+	{
+		unsigned int cores = std::max(2u, std::thread::hardware_concurrency());
+		unsigned int tileThreads = cores / 2;
+
+		return modelParsing ? cores - tileThreads : tileThreads;
+	}
 
-	//! CPU-side map loading (called once on map startup, pre-loads all tiles for selected map): opens resource archives, calls parsers for each asset type and each map's tile, then builds vertex and index data.
+	//! Builds the index buffer shared by all tiles' terrain surface: one triangulation of an 8 x 8 unit chunk per LOD level and combination of coarser neighbors (edges facing a coarser chunk skip its missing vertices, so no cracks appear).
+	void createGridIndexBuffer();
+
+	//! Returns the triangulation of a chunk at LOD 'level' whose north / east / south / west edges are shared with chunks at the given LOD levels (not finer than 'level').
+	const ChunkPattern &getChunkPattern(int level, int north, int east, int south, int west) const;
+
+	//! Returns LOD level of the chunk with the corner at (x, z) in world space, based on horizontal distance from camera to chunk's center (it depends on position only, so neighbor chunks agree on it even across tile borders).
+	int getChunkLod(float x, float z) const;
+
+	//! Map loading (called once on map startup): only scans the terrain archive for tile positions; tiles themselves are streamed in around the camera (see updateStreaming).
 	void load(const char *fpath, Sound &sound);
 
-	//! Processes .msk and .shw files for a terrain tile and packs all 3 mask layers in 1 texture where each channel encodes the whole layer (R → primary mask, G → secondary mask, B → pre-rendered shadows).
-	void loadTileMasks(CZipResReader *masksArchive, int gridX, int gridZ, TileTerrain *tile);
+	//! Loads a terrain tile on a worker thread (.trn, .itm, .msk files, surface textures, meshes) and queues it for the main thread.
+	void loadTile(int fileIndex, int indexX, int indexZ);
+
+	//! Takes an idle worker state for a background job, or opens a new set of archive handles (thread-safe).
+	TileLoadContext *acquireContext();
+
+	//! Returns a worker state taken by acquireContext (thread-safe).
+	void releaseContext(TileLoadContext *ctx);
+
+	//! Processes .msk and .shw files for a terrain tile: packs both mask layers in 1 RG image (R → primary mask, G → secondary mask) and keeps pre-rendered shadows as a separate 1-channel image; CPU only, see uploadTileMasks.
+	void loadTileMasks(CZipResReader *masksArchive, int gridX, int gridZ, StreamedMask &masks, std::vector<unsigned char> &scratch);
+
+	//! Starts reading tile's mask layers in the background (called when the tile comes near the camera).
+	void requestTileMasks(int indexX, int indexZ);
+
+	//! Uploads mask layers read in the background to GPU, at most maxMaskUploadsPerFrame per frame (main thread only).
+	void uploadTileMasks();
+
+	//! Releases tile's mask textures from GPU.
+	void releaseTileMasks(TileTerrain *tile);
+
+	//! Returns a decoded terrain surface texture normalized to 256 x 256 RGBA, followed by its mipmap chain; returns NULL if the texture is already on GPU. Images are shared while any tile being loaded holds them (thread-safe).
+	std::shared_ptr<std::vector<unsigned char>> loadTerrainTexture(const std::string &name);
+
+	//! Registers tile's texture names in terrain's global list of unique names and remaps chunk texture indices to it (main thread).
+	void registerTileTextures(TileTerrain *tile);
+
+	//! Makes room for at least 'layerCount' layers in the global texture array, copying already uploaded layers into a larger array if needed (main thread only).
+	void reserveTextureLayers(int layerCount);
+
+	//! Uploads tile's newly registered surface textures into the global texture array, then releases their CPU copies (main thread only).
+	void uploadTileTextures(TileTerrain *tile);
+
+	//! Returns true if Model objects for all .bdae models requested by tile's entities can be created without waiting; data consumed by models freed since the request is requested again.
+	bool tileModelsReady(TileTerrain *tile);
+
+	//! Creates Model objects on the main thread (GPU upload) for .bdae models requested by tile's entities and attaches them to the tile.
+	void resolveTileModels(TileTerrain *tile);
+
+	//! Per-frame tile streaming: hands over tiles loaded in the background, starts loading tiles that entered the prefetch radius and frees tiles beyond the eviction radius or over the memory cap.
+	void updateStreaming();
+
+	//! Frees tile from GPU and CPU memory.
+	void evictTile(int indexX, int indexZ);
 
 	//! Processes a single .nav file of a terrain tile and adds its data to the Detour navigation system.
 	void loadTileNavigation(CZipResReader *navigationArchive, dtNavMesh *navMesh, int gridX, int gridZ);
 
-	//! Builds terrain surface vertex data for each square unit and loads textures (terrain is rendered per square unit, however some data is defined per chunk or even per tile, so it must be mapped to square units).
-	void getTerrainVertices();
+	//! Builds tile's terrain surface vertex data for each square unit (terrain is rendered per square unit, however some data is defined per chunk or even per tile, so it must be mapped to square units).
+	void getTerrainVertices(TileTerrain *tile);
 
-	//! Builds flat water surface vertex data for each terrain chunk that contains water (water is defined and rendered per chunk, not per unit).
-	void getWaterVertices();
+	//! Builds tile's flat water surface vertex data: water is defined per chunk, and neighbor chunks with the same water level are merged into larger rectangles (greedy meshing).
+	void getWaterVertices(TileTerrain *tile);
 
-	void getPhysicsVertices();
+	//! Builds tile's physics geometry vertex data and releases parsed physics models.
+	void getPhysicsVertices(TileTerrain *tile);
 
 	// void getNavigationVertices(dtNavMesh *navMesh);
 
@@ -93,10 +282,22 @@ class Terrain
 	//! Computes which tiles will be rendered in the current frame based on camera position and orientation (distance-based culling + frustum culling).
 	void updateVisibleTiles(glm::mat4 view, glm::mat4 projection);
 
-	//! Clears CPU memory (resets viewer state).
+	//! Culls model instances collected in modelCullBatch: instances whose bounding box lies outside the view frustum or covers less than minModelScreenSize of the screen are marked invisible ('projectionScale' — element [1][1] of projection matrix).
+	void cullModelInstances(float projectionScale);
+
+	//! Sets tile's uniforms and textures and issues its queued chunk draws (called by RenderQueue::flush with terrain's program, tile's vertex array and the surface texture array bound).
+	static void submitTile(const RenderItem &item);
+
+	//! Issues a queued draw of tile's physics geometry (called by RenderQueue::flush).
+	static void submitPhysics(const RenderItem &item);
+
+	//! Rasterizes occluders of the current frame into the occlusion buffer and builds its hierarchical-Z pyramid: coarse terrain height maps of visible tiles within occluderRadiusTiles and the nearest large buildings that passed frustum culling (call after cullModelInstances).
+	void updateOcclusion(const glm::mat4 &view, const glm::mat4 &projection);
+
+	//! Clears CPU memory (resets viewer state); waits for background tile loading to finish.
 	void reset();
 
-	//! Renders terrain (.trn + .phy + .nav + .bdae).
+	//! Renders terrain (.trn + .phy + .nav + .bdae): all draws of the frame are queued and submitted at once, sorted by state (see RenderQueue).
 	void draw(glm::mat4 view, glm::mat4 projection, bool simple, bool renderNavMesh, bool renderPhysics, float dt);
 };
 
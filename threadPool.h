@@ -0,0 +1,99 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+// Class for running CPU-side jobs (e.g. file parsing) on a fixed set of worker threads.
+// Jobs must not make OpenGL calls — the GL context is bound to the main thread only.
+// ________________________________________
+
+class ThreadPool
+{
+  public:
+	ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency())
+		: stopping(false)
+	{
+		if (threadCount == 0)
+			threadCount = 1;
+
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		condition.notify_all();
+
+		for (std::thread &worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	//! Queues a job and returns a future for its result.
+	template <typename F>
+	std::future<typename std::invoke_result<F>::type> enqueue(F job)
+	{
+		typedef typename std::invoke_result<F>::type Result;
+
+		std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+		std::future<Result> result = task->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push([task]()
+					  { (*task)(); });
+		}
+
+		condition.notify_one();
+		return result;
+	}
+
+	//! Returns the number of worker threads.
+	unsigned int size() const { return (unsigned int)workers.size(); }
+
+  private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping;
+
+	//! Worker thread body: takes jobs from the queue until the pool is destroyed (remaining jobs are finished first).
+	void workerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> job;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this]()
+							   { return stopping || !jobs.empty(); });
+
+				if (stopping && jobs.empty())
+					return;
+
+				job = std::move(jobs.front());
+				jobs.pop();
+			}
+
+			job();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,111 @@
+// Headless .bdae parser benchmark: links only libbdae.a and libio, no window or OpenGL context is required.
+// Usage: bdae_bench <threads> <iterations> <file.bdae> [more .bdae files]
+// Accepts both outer .bdae archives and raw inner .bdae files (starting with 'BRES').
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "parserBDAE.h"
+#include "PackPatchReader.h"
+
+//! Reads the inner .bdae file fully into memory, so that the benchmark measures parsing only.
+static bool readBDAE(const char *fpath, std::string &content)
+{
+	std::ifstream in(fpath, std::ios::binary);
+
+	if (!in)
+		return false;
+
+	std::stringstream ss;
+	ss << in.rdbuf();
+	content = ss.str();
+
+	if (content.size() >= 4 && std::memcmp(content.data(), "BRES", 4) == 0) // raw inner file
+		return true;
+
+	CPackPatchReader bdaeArchive(fpath, true, false); // outer archive
+	IReadResFile *bdaeFile = bdaeArchive.openFile("little_endian_not_quantized.bdae");
+
+	if (!bdaeFile)
+		return false;
+
+	content.resize(bdaeFile->getSize());
+	bdaeFile->read(&content[0], content.size());
+	delete bdaeFile;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 4)
+	{
+		std::cerr << "Usage: " << argv[0] << " <threads> <iterations> <file.bdae> [more .bdae files]\n";
+		return 1;
+	}
+
+	int threadCount = std::max(1, std::atoi(argv[1]));
+	int iterations = std::max(1, std::atoi(argv[2]));
+
+	std::vector<std::string> files;
+
+	for (int i = 3; i < argc; i++)
+	{
+		std::string content;
+
+		if (!readBDAE(argv[i], content))
+		{
+			std::cerr << "Failed to read " << argv[i] << "\n";
+			return 1;
+		}
+
+		files.push_back(std::move(content));
+	}
+
+	std::atomic<int> nextJob(0), failed(0);
+	long long vertexTotal = 0;
+	std::vector<long long> vertexCounts(threadCount, 0);
+	int jobCount = iterations * (int)files.size();
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+
+	for (int t = 0; t < threadCount; t++)
+	{
+		threads.emplace_back([&, t]()
+							 {
+			for (int job = nextJob++; job < jobCount; job = nextJob++)
+			{
+				std::string &content = files[job % files.size()];
+				IReadResFile *file = createMemoryReadFile(&content[0], content.size(), "little_endian_not_quantized.bdae", false);
+
+				ModelData model;
+
+				if (model.init(file) != 0)
+					failed++;
+				else
+					vertexCounts[t] += model.vertexCount;
+
+				delete file;
+			} });
+	}
+
+	for (int t = 0; t < threadCount; t++)
+		threads[t].join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (int t = 0; t < threadCount; t++)
+		vertexTotal += vertexCounts[t];
+
+	std::cout << jobCount << " parses on " << threadCount << " thread(s): " << seconds * 1000.0 << " ms total, "
+			  << seconds * 1e6 / jobCount << " us per file, " << vertexTotal << " vertices, " << failed << " failed\n";
+
+	return failed ? 1 : 0;
+}
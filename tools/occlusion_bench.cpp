@@ -0,0 +1,176 @@
+// Headless software occlusion culling benchmark: runs OcclusionBuffer (occlusion.h) on a generated hilly terrain with boxes scattered over it, no window or OpenGL context is required.
+// Usage: occlusion_bench <frames> [building.bdae ...]
+// Given .bdae models (outer archives or raw inner files) are placed on the terrain as occluders, the same way terrain viewer uses large buildings.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "occlusion.h"
+#include "PackPatchReader.h"
+#include "libs/glm/gtc/matrix_transform.hpp"
+
+const int tileCount = 16;								// generated terrain is tileCount x tileCount tiles
+const int tileUnits = 64;								// tile size in world space units (as in terrain viewer)
+const int occluderStep = 4;								// heightfield resolution in units (as in terrain viewer, see OccluderCellSize)
+const int heightfieldSize = tileUnits / occluderStep + 1; // heightfield vertices per tile row
+const int boxCount = 20000;								// tested bounding boxes (models and chunks)
+const int buildingCount = 200;							// placed occluder models (if any .bdae file is given)
+
+//! Terrain height at (x, z): a few overlapping waves, giving hills up to ~40 units high.
+static float terrainHeight(float x, float z)
+{
+	return 12.0f * std::sin(x * 0.011f) * std::cos(z * 0.013f) + 8.0f * std::sin(x * 0.031f + z * 0.017f) + 20.0f;
+}
+
+//! Reads the inner .bdae file fully into memory.
+static bool readBDAE(const char *fpath, std::string &content)
+{
+	std::ifstream in(fpath, std::ios::binary);
+
+	if (!in)
+		return false;
+
+	std::stringstream ss;
+	ss << in.rdbuf();
+	content = ss.str();
+
+	if (content.size() >= 4 && std::memcmp(content.data(), "BRES", 4) == 0) // raw inner file
+		return true;
+
+	CPackPatchReader bdaeArchive(fpath, true, false); // outer archive
+	IReadResFile *bdaeFile = bdaeArchive.openFile("little_endian_not_quantized.bdae");
+
+	if (!bdaeFile)
+		return false;
+
+	content.resize(bdaeFile->getSize());
+	bdaeFile->read(&content[0], content.size());
+	delete bdaeFile;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " <frames> [building.bdae ...]\n";
+		return 1;
+	}
+
+	int frames = std::max(1, std::atoi(argv[1]));
+
+	// occluder meshes of given models
+	std::vector<std::vector<glm::vec3>> meshes;
+
+	for (int i = 2; i < argc; i++)
+	{
+		std::string content;
+		ModelData model;
+
+		if (!readBDAE(argv[i], content))
+			continue;
+
+		IReadResFile *file = createMemoryReadFile(&content[0], content.size(), "little_endian_not_quantized.bdae", false);
+
+		if (model.init(file) == 0)
+		{
+			model.computeBounds();
+			meshes.emplace_back();
+			OcclusionBuffer::buildOccluderMesh(model, meshes.back());
+
+			if (meshes.back().empty())
+				meshes.pop_back();
+		}
+
+		delete file;
+	}
+
+	if (argc > 2)
+		std::cout << meshes.size() << " of " << argc - 2 << " model(s) are suited as occluders\n";
+
+	// generate the scene
+	std::vector<std::vector<float>> heightfields(tileCount * tileCount, std::vector<float>(heightfieldSize * heightfieldSize));
+
+	for (int t = 0; t < tileCount * tileCount; t++)
+		for (int row = 0; row < heightfieldSize; row++)
+			for (int col = 0; col < heightfieldSize; col++)
+				heightfields[t][row * heightfieldSize + col] = terrainHeight((t % tileCount) * tileUnits + col * occluderStep, (t / tileCount) * tileUnits + row * occluderStep);
+
+	std::mt19937 random(1);
+	float mapSize = (float)tileCount * tileUnits;
+	std::uniform_real_distribution<float> position(0.0f, mapSize), size(0.5f, 4.0f);
+
+	std::vector<float> centerX(boxCount), centerY(boxCount), centerZ(boxCount), extentX(boxCount), extentY(boxCount), extentZ(boxCount);
+
+	for (int i = 0; i < boxCount; i++)
+	{
+		centerX[i] = position(random), centerZ[i] = position(random);
+		extentX[i] = size(random), extentY[i] = size(random), extentZ[i] = size(random);
+		centerY[i] = terrainHeight(centerX[i], centerZ[i]) + extentY[i];
+	}
+
+	std::vector<glm::mat4> buildings;
+
+	for (int i = 0; !meshes.empty() && i < buildingCount; i++)
+	{
+		float x = position(random), z = position(random);
+		buildings.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(x, terrainHeight(x, z), z)));
+	}
+
+	// fly the camera around the map center close to the ground
+	OcclusionBuffer occlusion;
+	std::vector<unsigned char> visible(boxCount);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+	double rasterizeTime = 0.0, pyramidTime = 0.0, testTime = 0.0;
+	long long triangles = 0, tested = 0, occluded = 0;
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		float angle = frame * 0.05f;
+		glm::vec3 eye(mapSize * 0.5f + 200.0f * std::cos(angle), 0.0f, mapSize * 0.5f + 200.0f * std::sin(angle));
+		eye.y = terrainHeight(eye.x, eye.z) + 3.0f;
+		glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(-std::sin(angle), 0.0f, std::cos(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+
+		auto start = std::chrono::steady_clock::now();
+
+		occlusion.begin(projection * view);
+
+		for (int t = 0; t < tileCount * tileCount; t++)
+			occlusion.addHeightfield(heightfields[t].data(), heightfieldSize, (t % tileCount) * tileUnits, (t / tileCount) * tileUnits, occluderStep);
+
+		for (int i = 0; i < (int)buildings.size(); i++)
+		{
+			const std::vector<glm::vec3> &mesh = meshes[i % meshes.size()];
+			occlusion.addTriangles(mesh.data(), mesh.size(), buildings[i]);
+		}
+
+		auto rasterized = std::chrono::steady_clock::now();
+
+		occlusion.buildHiZ();
+
+		auto built = std::chrono::steady_clock::now();
+
+		std::fill(visible.begin(), visible.end(), 1);
+		occlusion.cullBoxes(centerX.data(), centerY.data(), centerZ.data(), extentX.data(), extentY.data(), extentZ.data(), boxCount, visible.data());
+
+		auto checked = std::chrono::steady_clock::now();
+
+		rasterizeTime += std::chrono::duration<double>(rasterized - start).count();
+		pyramidTime += std::chrono::duration<double>(built - rasterized).count();
+		testTime += std::chrono::duration<double>(checked - built).count();
+		triangles += occlusion.trianglesRasterized;
+		tested += occlusion.boxesTested;
+		occluded += occlusion.boxesOccluded;
+	}
+
+	std::cout << frames << " frames, per frame: rasterize " << rasterizeTime * 1000.0 / frames << " ms (" << triangles / frames << " triangles), "
+			  << "pyramid " << pyramidTime * 1000.0 / frames << " ms, test " << testTime * 1000.0 / frames << " ms (" << tested / frames << " boxes), "
+			  << "occluded " << (tested ? 100.0 * occluded / tested : 0.0) << "%\n";
+
+	return 0;
+}
@@ -2,8 +2,10 @@
 #define WATER_H
 
 #include <vector>
+#include <algorithm>
 #include "shader.h"
 #include "light.h"
+#include "renderQueue.h"
 #include "libs/glad/glad.h"
 #include "libs/glm/glm.hpp"
 #include "libs/stb_image.h"
@@ -11,35 +13,51 @@
 const float waterTextureSpeed = 0.5f;
 const float waterTextureScale = 0.8f;
 
-// Class for loading and rendering water.
+// Class for rendering water of all terrain tiles (one shader program, one texture and one vertex buffer shared by all tiles).
+// Tiles keep their water surface as CPU vertex data (see Terrain::getWaterVertices); visible tiles add it to the batch each frame, and the whole batch is queued as 1 draw call.
 // ______________________________________
 
 class Water
 {
   public:
-	Shader shader;
+	Shader *shader; // created on first use (see setup), so that the object can be created before the GL context
 	unsigned int VAO, VBO;
 	unsigned int texture;
-	unsigned int waterVertexCount;
-	std::vector<float> vertices;
+	unsigned int waterVertexCount;						 // number of vertices in VBO
+	int bufferCapacity;									 // size of VBO in floats (grows by doubling)
+	std::vector<float> vertices;						 // batch of visible water surfaces for the current frame, 3 floats per vertex (x, y, z)
+	std::vector<const std::vector<float> *> batch;		 // water surfaces added in the current frame
+	std::vector<const std::vector<float> *> uploadBatch; // water surfaces that VBO currently holds (the batch is only re-uploaded when it changes)
+	bool dirty;											 // flag that forces re-upload (set when tiles are freed, as their memory may be reused by new tiles)
 	float waterOffset;
 
 	Water()
-		: shader("shaders/water.vs", "shaders/water.fs"),
-		  waterOffset(0.0f),
-		  waterVertexCount(0),
+		: shader(NULL),
 		  VAO(0), VBO(0),
-		  texture(0)
+		  texture(0),
+		  waterVertexCount(0),
+		  bufferCapacity(0),
+		  dirty(true),
+		  waterOffset(0.0f) {}
+
+	~Water() { release(); }
+
+	//! Compiles water shader, loads water texture and creates the shared vertex buffer (main thread only; does nothing if already done).
+	void setup()
 	{
-		shader.use();
-		shader.setInt("waterTexture", 0);
-		shader.setFloat("textureScale", waterTextureScale);
+		if (shader)
+			return;
+
+		shader = new Shader("shaders/water.vs", "shaders/water.fs");
+		shader->use();
+		shader->setInt("waterTexture", 0);
+		shader->setFloat("textureScale", waterTextureScale);
 
-		shader.setVec3("lightPos", lightPos);
-		shader.setVec3("lightColor", lightColor);
-		shader.setFloat("ambientStrength", waterAmbientStrength);
-		shader.setFloat("diffuseStrength", waterDiffuseStrength);
-		shader.setFloat("specularStrength", waterSpecularStrength);
+		shader->setVec3("lightPos", lightPos);
+		shader->setVec3("lightColor", lightColor);
+		shader->setFloat("ambientStrength", waterAmbientStrength);
+		shader->setFloat("diffuseStrength", waterDiffuseStrength);
+		shader->setFloat("specularStrength", waterSpecularStrength);
 
 		glGenTextures(1, &texture);
 		glBindTexture(GL_TEXTURE_2D, texture);
@@ -54,9 +72,15 @@ class Water
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
 		glGenerateMipmap(GL_TEXTURE_2D);
 		stbi_image_free(data);
-	}
 
-	~Water() { release(); }
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+		glBindVertexArray(0);
+	}
 
 	void release()
 	{
@@ -64,31 +88,80 @@ class Water
 		glDeleteBuffers(1, &VBO);
 		glDeleteTextures(1, &texture);
 		VAO = VBO = texture = waterVertexCount = 0;
+		bufferCapacity = 0;
 		vertices.clear();
+		batch.clear();
+		uploadBatch.clear();
+		dirty = true;
+
+		delete shader; // the program itself is owned by ShaderCache
+		shader = NULL;
 	}
 
-	void draw(glm::mat4 view, glm::mat4 projection, bool lighting, bool simple, float dt, glm::vec3 camera)
+	//! Adds tile's water surface to the current frame's batch (the vector must stay alive until draw).
+	void add(const std::vector<float> &surface)
 	{
-		if (VAO == 0 || VBO == 0 || waterVertexCount == 0 || vertices.empty())
+		if (!surface.empty())
+			batch.push_back(&surface);
+	}
+
+	//! Queues all water surfaces added since the last call for rendering as 1 draw call (see RenderQueue), then clears the batch.
+	void draw(float dt)
+	{
+		// animate water once per frame, even if nothing is visible, so that it does not jump when water comes into view
+		waterOffset += waterTextureSpeed * dt;
+
+		if (batch.empty())
 			return;
 
-		shader.use();
-		shader.setMat4("model", glm::mat4(1.0f));
-		shader.setMat4("view", view);
-		shader.setMat4("projection", projection);
-		shader.setBool("lighting", lighting);
-		shader.setVec3("cameraPos", camera);
+		setup();
 
-		waterOffset += waterTextureSpeed * dt;
-		shader.setFloat("textureOffset", waterOffset);
+		// re-upload only when the set of visible water surfaces changes
+		if (dirty || batch != uploadBatch)
+		{
+			vertices.clear();
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture);
+			for (const std::vector<float> *surface : batch)
+				vertices.insert(vertices.end(), surface->begin(), surface->end());
 
-		glBindVertexArray(VAO);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		glDrawArrays(GL_TRIANGLES, 0, waterVertexCount);
-		glBindVertexArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+			if ((int)vertices.size() > bufferCapacity)
+			{
+				bufferCapacity = std::max((int)vertices.size(), bufferCapacity * 2);
+				glBufferData(GL_ARRAY_BUFFER, bufferCapacity * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+			}
+
+			glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
+
+			waterVertexCount = vertices.size() / 3;
+			uploadBatch.swap(batch);
+			dirty = false;
+		}
+
+		batch.clear();
+
+		RenderItem item = {};
+		item.shader = shader;
+		item.vao = VAO;
+		item.texture = texture;
+		item.textureTarget = GL_TEXTURE_2D;
+		item.submit = submit;
+		item.object = this;
+		item.count = waterVertexCount;
+
+		RenderQueue::add(RENDER_PASS_TRANSLUCENT, item);
+	}
+
+	//! Sets water uniforms and issues the queued draw (called by RenderQueue::flush with water's program, vertex array and texture bound).
+	static void submit(const RenderItem &item)
+	{
+		Water *water = (Water *)item.object;
+
+		item.shader->setMat4("model", glm::mat4(1.0f));
+		item.shader->setFloat("textureOffset", water->waterOffset);
+
+		glDrawArrays(GL_TRIANGLES, 0, item.count);
 	}
 };
 